@@ -0,0 +1,667 @@
+// ctrlroom_bench: microbenchmarks of the master<> and slave<> template
+// layers.
+//
+// All cycles go to memory_bridge, a zero-latency master implementation
+// backed by a block of host memory (every call is a single memcpy), so the
+// measured times are the overhead of the template layers themselves:
+//      * master<>::read/write/read_modify_write for single cycles
+//      * block_transfer() chunking, for the block transfer_specs that a
+//        real master implements (BLT, MD32, MBLT) and the FIFO transfers
+//        (there are no 2eVME benchmarks, as no bridge does 2eVME cycles)
+//      * slave<> base address arithmetic (and the write shadow)
+// Every benchmark is compared to a baseline: a memcpy of the same size,
+// or the master<> call for the slave<> benchmarks.
+// On top of that, the V1729 buffer::unfold() is compared to the
+// per-sample buffer::get() loop it replaces, on a pulse from a simulated
+// board (cf. sim_bridge.hpp). Both are checked to agree sample by sample
+// first, the bench fails if they do not.
+//
+// Output is machine readable (CSV or JSON), one record per benchmark:
+//      * name: layer/addressing/transfer mode/operation
+//      * bytes: bytes moved per operation
+//      * ns_per_op: time per operation (best of --runs runs, in [ns])
+//      * mb_per_s: corresponding throughput (in [MB/s])
+//      * calls_per_op: calls to the master implementation per operation
+//        (i.e. the number of blocks for the block transfers)
+//      * baseline: name of the baseline benchmark
+//      * ratio: ns_per_op relative to the baseline (empty/null if the
+//        baseline was not run, e.g. because of --filter)
+// e.g. to catch regressions in the template layers:
+//      ctrlroom_bench --format json > bench.json
+
+#include <ctrlroom/vme/caen_v1729.hpp>
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/master/memory.hpp>
+#include <ctrlroom/vme/sim_bridge.hpp>
+#include <ctrlroom/vme/slave.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace ctrlroom;
+using namespace ctrlroom::vme;
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+// memory_bridge
+////////////////////////////////////////////////////////////////////////////////
+
+// Zero-latency master module backed by host memory: the (lower bits of
+// the) VME address is an offset in a block of MEMORY_SIZE bytes, for all
+// address modifiers. FIFO transfers stream from/to the memory starting
+// at the FIFO address. There are no IRQs and no bus errors.
+class memory_bridge : public vme::master<memory_bridge> {
+public:
+  using base_type = vme::master<memory_bridge>;
+
+  constexpr static size_t MEMORY_SIZE{1 << 20};
+
+  memory_bridge(const std::string& identifier, const ptree& settings)
+      : memory_bridge::base_type{identifier, settings}
+      , memory_(MEMORY_SIZE)
+      , n_calls_{0} {}
+
+  // there are no IRQs
+  void wait_for_irq() const {}
+  void wait_for_irq(size_t) const {}
+
+  // number of calls to the implementation (transfer hooks) so far
+  size_t n_calls() const { return n_calls_; }
+
+protected:
+  // Single
+  template <addressing_mode A, transfer_mode D>
+  size_t read_single(const typename address_spec<A>::ptr_type address,
+                     typename transfer_spec<D>::ptr_type val) const {
+    return copy(address, val, transfer_spec<D>::WIDTH, 1, true);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_single(const typename address_spec<A>::ptr_type address,
+                      typename transfer_spec<D>::ptr_type val) const {
+    return copy(address, val, transfer_spec<D>::WIDTH, 1, false);
+  }
+  // RMW
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const {
+    typename transfer_spec<D>::value_type previous;
+    copy(address, &previous, transfer_spec<D>::WIDTH, 1, true);
+    copy(address, val, transfer_spec<D>::WIDTH, 1, false);
+    *val = previous;
+    return 1;
+  }
+  // BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_blt(const typename address_spec<A>::ptr_type address,
+                  typename transfer_spec<D>::ptr_type buf,
+                  size_t n_requests) const {
+    return copy(address, buf, transfer_spec<D>::WIDTH, n_requests, true);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_blt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return copy(address, buf, transfer_spec<D>::WIDTH, n_requests, false);
+  }
+  // MD32
+  template <addressing_mode A>
+  size_t read_md32(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                   size_t n_requests) const {
+    return read_blt<A, transfer_mode::MD32>(address, buf, n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_md32(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                    size_t n_requests) const {
+    return write_blt<A, transfer_mode::MD32>(address, buf, n_requests);
+  }
+  // MBLT
+  template <addressing_mode A>
+  size_t read_mblt(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                   size_t n_requests) const {
+    return read_blt<A, transfer_mode::MBLT>(address, buf, n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_mblt(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                    size_t n_requests) const {
+    return write_blt<A, transfer_mode::MBLT>(address, buf, n_requests);
+  }
+  // CBLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return read_blt<A, D>(address, buf, n_requests);
+  }
+  // MULTI (batched single cycles)
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const {
+    for (size_t i{0}; i < n; ++i) {
+      cycles[i].data = 0;
+      copy(cycles[i].address, &cycles[i].data, cycles[i].width, 1, true);
+      st[i] = status::SUCCESS;
+    }
+    return n;
+  }
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const {
+    for (size_t i{0}; i < n; ++i) {
+      copy(cycles[i].address, &cycles[i].data, cycles[i].width, 1, false);
+      st[i] = status::SUCCESS;
+    }
+    return n;
+  }
+  // IRQ
+  template <transfer_mode D>
+  size_t iack(const irq_level,
+              typename transfer_spec<D>::ptr_type vector) const {
+    *vector = 0;
+    return 1;
+  }
+  uint8_t check_irq() const { return 0; }
+  // PING
+  void ping() const {}
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const {
+    return read_blt<A, D>(address, buf, n_requests);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const {
+    return write_blt<A, D>(address, buf, n_requests);
+  }
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const {
+    return read_blt<A, transfer_mode::MBLT>(address, buf, n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const {
+    return write_blt<A, transfer_mode::MBLT>(address, buf, n_requests);
+  }
+
+private:
+  // copy <n> values of <width> bytes between <data> and the memory at
+  // <address>
+  size_t copy(const uint64_t address, void* data, const size_t width,
+              const size_t n, const bool read) const {
+    ++n_calls_;
+    const size_t offset{static_cast<size_t>(address & (MEMORY_SIZE - 1))};
+    tassert(offset + n * width <= MEMORY_SIZE,
+            "Transfer beyond the end of the bridge memory");
+    if (read) {
+      std::memcpy(data, &memory_[offset], n * width);
+    } else {
+      std::memcpy(&memory_[offset], data, n * width);
+    }
+    return n;
+  }
+
+  mutable transfer_vector<uint8_t> memory_;
+  mutable size_t n_calls_;
+
+  VME_FRIEND_MASTER(base_type);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// benchmark driver
+////////////////////////////////////////////////////////////////////////////////
+
+using clock_type = std::chrono::steady_clock;
+
+// keep the compiler from optimizing away the benchmarked copies
+inline void clobber(const void* p) { asm volatile("" : : "r"(p) : "memory"); }
+
+struct result {
+  std::string name;
+  std::string baseline;
+  size_t bytes;
+  double ns_per_op;
+  double calls_per_op;
+};
+
+class bench_runner {
+public:
+  bench_runner(const memory_bridge& bridge, const size_t n_runs,
+               const std::string& filter)
+      : bridge_(bridge), n_runs_{n_runs}, filter_{filter} {}
+
+  // time <n_ops> calls of <op> (moving <bytes> per call), and compare
+  // to the benchmark called <baseline> (none if empty)
+  // Baselines are always run, the other benchmarks only if their name
+  // contains the filter string.
+  template <class Op>
+  void run(const std::string& name, const std::string& baseline,
+           const size_t bytes, const size_t n_ops, Op op) {
+    if (!baseline.empty() && name.find(filter_) == std::string::npos) {
+      return;
+    }
+    const size_t calls_before{bridge_.n_calls()};
+    double best{std::numeric_limits<double>::max()};
+    for (size_t run{0}; run < n_runs_; ++run) {
+      const auto start = clock_type::now();
+      for (size_t i{0}; i < n_ops; ++i) {
+        op();
+      }
+      const std::chrono::duration<double, std::nano> elapsed{
+          clock_type::now() - start};
+      best = std::min(best, elapsed.count() / n_ops);
+    }
+    const double calls{static_cast<double>(bridge_.n_calls() - calls_before) /
+                       (n_ops * n_runs_)};
+    results_.push_back({name, baseline, bytes, best, calls});
+  }
+
+  void write_csv(std::ostream& os) const;
+  void write_json(std::ostream& os) const;
+
+private:
+  // ns_per_op of <r> relative to its baseline (NaN if not run)
+  double ratio(const result& r) const;
+
+  const memory_bridge& bridge_;
+  const size_t n_runs_;
+  const std::string filter_;
+  std::vector<result> results_;
+};
+
+double bench_runner::ratio(const result& r) const {
+  for (const auto& b : results_) {
+    if (b.name == r.baseline) {
+      return r.ns_per_op / b.ns_per_op;
+    }
+  }
+  return r.baseline.empty() ? 1. : std::numeric_limits<double>::quiet_NaN();
+}
+
+void bench_runner::write_csv(std::ostream& os) const {
+  os << "name,bytes,ns_per_op,mb_per_s,calls_per_op,baseline,ratio\n";
+  for (const auto& r : results_) {
+    os << r.name << "," << r.bytes << "," << r.ns_per_op << ","
+       << r.bytes * 1e3 / r.ns_per_op << "," << r.calls_per_op << ","
+       << r.baseline << ",";
+    const double rat{ratio(r)};
+    if (!std::isnan(rat)) {
+      os << rat;
+    }
+    os << "\n";
+  }
+}
+
+void bench_runner::write_json(std::ostream& os) const {
+  os << "[";
+  for (size_t i{0}; i < results_.size(); ++i) {
+    const result& r = results_[i];
+    os << (i ? ",\n " : "\n ") << "{\"name\": \"" << r.name
+       << "\", \"bytes\": " << r.bytes << ", \"ns_per_op\": " << r.ns_per_op
+       << ", \"mb_per_s\": " << r.bytes * 1e3 / r.ns_per_op
+       << ", \"calls_per_op\": " << r.calls_per_op << ", \"baseline\": \""
+       << r.baseline << "\", \"ratio\": ";
+    const double rat{ratio(r)};
+    if (std::isnan(rat)) {
+      os << "null}";
+    } else {
+      os << rat << "}";
+    }
+  }
+  os << "\n]\n";
+}
+
+// master settings for the memory bridge, and slave settings for a slave
+// at <slave_address>
+ptree bench_settings(const uint32_t slave_address, const bool shadow) {
+  ptree settings;
+  settings.put("bridge.model", "memory");
+  settings.put("bridge.linkIndex", 0);
+  settings.put("bridge.boardIndex", 0);
+  settings.put_child("bridge.IRQ", ptree{});
+  settings.put("slave.model", "memory");
+  settings.put("slave.address", std::to_string(slave_address));
+  settings.put("slave.shadowWrites", shadow);
+  return settings;
+}
+
+// BENCHMARKS
+// base address of the slave, and offset of the register/block in the
+// slave (all transfers are from/to base + offset)
+constexpr uint32_t SLAVE_BASE{0x10000};
+constexpr uint32_t OFFSET{0x100};
+
+// master<> single cycles for <A>/<D>, compared to a memcpy of the same
+// width
+template <addressing_mode A, transfer_mode D>
+void bench_single(bench_runner& runner, const memory_bridge& bridge,
+                  const std::string& mode, const size_t n_ops) {
+  using value_type = typename transfer_spec<D>::value_type;
+  const std::string name{"master/" + mode};
+  const std::string baseline{"memcpy/" +
+                             std::to_string(transfer_spec<D>::WIDTH)};
+  const uint32_t address{SLAVE_BASE + OFFSET};
+  value_type val{0};
+  runner.run(name + "/read", baseline, sizeof(val), n_ops, [&]() {
+    bridge.read<A, D>(address, val);
+    clobber(&val);
+  });
+  runner.run(name + "/write", baseline, sizeof(val), n_ops, [&]() {
+    bridge.write<A, D>(address, val);
+    clobber(&val);
+  });
+  runner.run(name + "/rmw", baseline, sizeof(val), n_ops, [&]() {
+    bridge.read_modify_write<A, D>(address, val);
+    clobber(&val);
+  });
+}
+
+// master<> block transfers of <bytes> for <A>/<D>, compared to a memcpy
+// of the same size
+template <addressing_mode A, transfer_mode D>
+void bench_block(bench_runner& runner, const memory_bridge& bridge,
+                 const std::string& mode, const size_t bytes,
+                 const size_t n_ops) {
+  const std::string name{"master/" + mode};
+  const std::string baseline{"memcpy/" + std::to_string(bytes)};
+  const uint32_t address{SLAVE_BASE + OFFSET};
+  transfer_vector<uint64_t> buf(bytes / sizeof(uint64_t));
+  runner.run(name + "/block_read", baseline, bytes, n_ops, [&]() {
+    bridge.read<A, D>(address, buf);
+    clobber(buf.data());
+  });
+  runner.run(name + "/block_write", baseline, bytes, n_ops, [&]() {
+    bridge.write<A, D>(address, buf);
+    clobber(buf.data());
+  });
+}
+
+// master<> FIFO block transfers (BLT and MBLT only)
+template <addressing_mode A, transfer_mode D>
+void bench_fifo(bench_runner& runner, const memory_bridge& bridge,
+                const std::string& mode, const size_t bytes,
+                const size_t n_ops) {
+  const std::string name{"master/" + mode};
+  const std::string baseline{"memcpy/" + std::to_string(bytes)};
+  const uint32_t address{SLAVE_BASE + OFFSET};
+  transfer_vector<uint64_t> buf(bytes / sizeof(uint64_t));
+  runner.run(name + "/fifo_read", baseline, bytes, n_ops, [&]() {
+    bridge.read_fifo<A, D>(address, buf);
+    clobber(buf.data());
+  });
+  runner.run(name + "/fifo_write", baseline, bytes, n_ops, [&]() {
+    bridge.write_fifo<A, D>(address, buf);
+    clobber(buf.data());
+  });
+}
+
+// slave<> address arithmetic (and write shadow), compared to the same
+// master<> call at the resulting address
+template <addressing_mode A, transfer_mode D, transfer_mode DBLT>
+void bench_slave(bench_runner& runner, std::shared_ptr<memory_bridge>& bridge,
+                 const std::string& mode, const size_t bytes,
+                 const size_t n_ops, const size_t n_block_ops) {
+  using slave_type = slave<memory_bridge, A, D, DBLT>;
+  using value_type = typename slave_type::single_data_type;
+  const std::string name{"slave/" + mode};
+  const std::string master_name{"master/" + mode};
+  const slave_type plain{"slave", bench_settings(SLAVE_BASE, false), bridge};
+  const slave_type shadowed{"slave", bench_settings(SLAVE_BASE, true), bridge};
+  value_type val{0};
+  runner.run(name + "/read", master_name + "/read", sizeof(val), n_ops, [&]() {
+    plain.read(OFFSET, val);
+    clobber(&val);
+  });
+  runner.run(name + "/write", master_name + "/write", sizeof(val), n_ops,
+             [&]() {
+    plain.write(OFFSET, val);
+    clobber(&val);
+  });
+  // the write shadow skips writes that would not change the register
+  runner.run(name + "/shadow_write", master_name + "/write", sizeof(val),
+             n_ops, [&]() {
+    shadowed.write(OFFSET, val);
+    clobber(&val);
+  });
+  transfer_vector<uint64_t> buf(bytes / sizeof(uint64_t));
+  runner.run(name + "/block_read", "master/A32/MBLT/block_read", bytes,
+             n_block_ops, [&]() {
+    plain.read(OFFSET, buf);
+    clobber(buf.data());
+  });
+}
+
+// settings for a simulated V1729 board (<id> "adc") on a sim_bridge
+// (<id> "sim")
+ptree v1729_settings() {
+  ptree settings;
+  settings.put("sim.model", "sim");
+  settings.put("sim.linkIndex", 0);
+  settings.put("sim.boardIndex", 0);
+  ptree irq;
+  irq.push_back({"", ptree{"IRQ1"}});
+  settings.put_child("sim.IRQ", irq);
+  ptree devices;
+  devices.push_back({"", ptree{"adc"}});
+  settings.put_child("sim.devices.list", devices);
+  settings.put("sim.devices.adc.model", "V1729");
+  settings.put("sim.devices.adc.address", "0x20000000");
+  settings.put("adc.model", "V1729");
+  settings.put("adc.address", "0x20000000");
+  settings.put("adc.triggerType", "external");
+  ptree trigger;
+  trigger.push_back({"", ptree{"rising"}});
+  settings.put_child("adc.triggerSettings", trigger);
+  settings.put("adc.triggerThreshold", 100);
+  settings.put("adc.preTrig", 20000);
+  settings.put("adc.postTrig", 64);
+  settings.put("adc.samplingFrequency", "2GHz");
+  return settings;
+}
+
+// scratch directory for the V1729 calibration files, removed with all
+// its contents when it goes out of scope
+class scratch_directory {
+public:
+  scratch_directory()
+      : path_{boost::filesystem::temp_directory_path() /
+              boost::filesystem::unique_path("ctrlroom_bench-%%%%-%%%%")} {
+    boost::filesystem::create_directories(path_);
+  }
+  ~scratch_directory() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path_, ec);
+  }
+  std::string path() const { return path_.string(); }
+
+private:
+  const boost::filesystem::path path_;
+};
+
+// V1729 buffer::unfold() of a full pulse, compared to the per-sample
+// get() loop it replaces (both fill the same waveforms)
+// Returns false if unfold() and get() disagree for any sample.
+bool bench_v1729(bench_runner& runner, const size_t megabytes) {
+  using board_type = caen_v1729<sim_bridge, addressing_mode::A32>;
+  using buffer_type = board_type::buffer_type;
+  using value_type = board_type::value_type;
+  const std::string name{"v1729/A32/MBLT"};
+  const ptree settings{v1729_settings()};
+  auto bridge = std::make_shared<sim_bridge>("sim", settings);
+  const scratch_directory calibration;
+  board_type::calibrate_verniers("adc", settings, bridge, calibration.path());
+  board_type::measure_pedestal("adc", settings, bridge, calibration.path(),
+                               10);
+  board_type adc{"adc", settings, bridge, calibration.path()};
+  buffer_type buf;
+  bridge->wait_for_irq();
+  adc.read_pulse(buf);
+
+  buffer_type::waveforms_type wf;
+  buf.unfold(wf);
+  size_t n_bad{0};
+  for (size_t chan{0}; chan < board_type::N_CHANNELS; ++chan) {
+    for (size_t idx{0}; idx < buf.size(); ++idx) {
+      n_bad += (wf.channel(chan)[idx] != buf.get(chan, idx));
+    }
+  }
+  if (n_bad) {
+    std::cerr << name << ": unfold() and get() disagree for " << n_bad
+              << " samples\n";
+    return false;
+  }
+
+  const size_t bytes{board_type::N_CHANNELS * wf.size() *
+                     sizeof(value_type)};
+  const size_t n_ops{std::max<size_t>(16, megabytes * 1000000 / bytes)};
+  runner.run(name + "/get", "", bytes, n_ops, [&]() {
+    for (size_t chan{0}; chan < board_type::N_CHANNELS; ++chan) {
+      value_type* samples{wf.channel(chan)};
+      for (size_t idx{0}; idx < buf.size(); ++idx) {
+        samples[idx] = buf.get(chan, idx);
+      }
+    }
+    clobber(wf.channel(0));
+  });
+  runner.run(name + "/unfold", name + "/get", bytes, n_ops, [&]() {
+    buf.unfold(wf);
+    clobber(wf.channel(0));
+  });
+  return true;
+}
+}
+
+int main(int argc, char* argv[]) {
+  namespace po = boost::program_options;
+  std::string format;
+  std::string filter;
+  size_t bytes{0};
+  size_t n_ops{0};
+  size_t n_runs{0};
+  size_t megabytes{0};
+  po::options_description options{"ctrlroom_bench options"};
+  options.add_options()("help,h", "print this message")(
+      "format", po::value<std::string>(&format)->default_value("csv"),
+      "output format (csv or json)")(
+      "bytes", po::value<size_t>(&bytes)->default_value(16384),
+      "bytes per block transfer (a multiple of 8)")(
+      "ops", po::value<size_t>(&n_ops)->default_value(1000000),
+      "operations per run for the single cycle benchmarks")(
+      "megabytes", po::value<size_t>(&megabytes)->default_value(64),
+      "data moved per run for the block transfer benchmarks (in [MB])")(
+      "runs", po::value<size_t>(&n_runs)->default_value(3),
+      "number of runs per benchmark (the best run is reported)")(
+      "filter", po::value<std::string>(&filter)->default_value(""),
+      "only run the benchmarks with names containing this string")(
+      "verbose", "do not silence the library logging");
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+  } catch (po::error& e) {
+    std::cerr << e.what() << "\n" << options;
+    return 1;
+  }
+  if (vm.count("help")) {
+    std::cout << options;
+    return 0;
+  }
+  if ((format != "csv" && format != "json") || !bytes || bytes % 8 ||
+      bytes > memory_bridge::MEMORY_SIZE / 2 || !n_ops || !n_runs) {
+    std::cerr << "Invalid options\n" << options;
+    return 1;
+  }
+  if (!vm.count("verbose")) {
+    global::logger.set_level(log_level::WARNING);
+  }
+
+  auto bridge = std::make_shared<memory_bridge>(
+      "bridge", bench_settings(SLAVE_BASE, false));
+  bench_runner runner{*bridge, n_runs, filter};
+  const size_t n_block_ops{
+      std::max<size_t>(16, megabytes * 1000000 / bytes)};
+
+  // baselines: memcpy of a single value, and of a block
+  {
+    transfer_vector<uint8_t> src(bytes);
+    transfer_vector<uint8_t> dst(bytes);
+    for (const size_t width : {2, 4}) {
+      runner.run("memcpy/" + std::to_string(width), "", width, n_ops, [&]() {
+        std::memcpy(dst.data(), src.data() + OFFSET % bytes % 8, width);
+        clobber(dst.data());
+      });
+    }
+    runner.run("memcpy/" + std::to_string(bytes), "", bytes, n_block_ops,
+               [&]() {
+      std::memcpy(dst.data(), src.data(), bytes);
+      clobber(dst.data());
+    });
+  }
+
+  // single cycles
+  bench_single<addressing_mode::A24, transfer_mode::D16>(runner, *bridge,
+                                                         "A24/D16", n_ops);
+  bench_single<addressing_mode::A32, transfer_mode::D32>(runner, *bridge,
+                                                         "A32/D32", n_ops);
+
+  // block transfers
+  bench_block<addressing_mode::A32, transfer_mode::D16>(
+      runner, *bridge, "A32/D16", bytes, n_block_ops);
+  bench_block<addressing_mode::A32, transfer_mode::D32>(
+      runner, *bridge, "A32/D32", bytes, n_block_ops);
+  bench_block<addressing_mode::A40, transfer_mode::MD32>(
+      runner, *bridge, "A40/MD32", bytes, n_block_ops);
+  bench_block<addressing_mode::A32, transfer_mode::MBLT>(
+      runner, *bridge, "A32/MBLT", bytes, n_block_ops);
+
+  bench_fifo<addressing_mode::A32, transfer_mode::D16>(runner, *bridge,
+                                                       "A32/D16", bytes,
+                                                       n_block_ops);
+  bench_fifo<addressing_mode::A32, transfer_mode::D32>(runner, *bridge,
+                                                       "A32/D32", bytes,
+                                                       n_block_ops);
+  bench_fifo<addressing_mode::A32, transfer_mode::MBLT>(runner, *bridge,
+                                                        "A32/MBLT", bytes,
+                                                        n_block_ops);
+
+  // slave<> layer
+  bench_slave<addressing_mode::A32, transfer_mode::D32, transfer_mode::MBLT>(
+      runner, bridge, "A32/D32", bytes, n_ops, n_block_ops);
+
+  // V1729 waveform unfolding
+  if (!bench_v1729(runner, megabytes)) {
+    return 1;
+  }
+
+  std::cout << std::setprecision(6);
+  if (format == "json") {
+    runner.write_json(std::cout);
+  } else {
+    runner.write_csv(std::cout);
+  }
+  return 0;
+}
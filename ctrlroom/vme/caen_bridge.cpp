@@ -1,6 +1,8 @@
 #include "caen_bridge.hpp"
 
+#include <algorithm>
 #include <map>
+#include <thread>
 
 using namespace ctrlroom::vme;
 
@@ -10,22 +12,156 @@ namespace {
 // See comments for CVBoardTypes in CAENVMEtypes.h for info
 const std::map<std::string, CVBoardTypes> BOARD_TYPES{{"CAEN_VX1718", cvV1718},
                                                       {"CAEN_VX2718", cvV2718}};
+
+const ctrlroom::translation_map<caen_bridge::irq_wait_mode> IRQ_WAIT_MODES{
+    {"block", caen_bridge::irq_wait_mode::BLOCK},
+    {"poll", caen_bridge::irq_wait_mode::POLL}};
+
+// maximum number of cycles handed to a single MultiRead/MultiWrite call
+// (larger batches are split)
+constexpr size_t MAX_MULTI_CYCLES{256};
 }
 
 caen_bridge::caen_bridge(const std::string& identifier, const ptree& settings)
     : caen_bridge::base_type{identifier, settings}
     , model_{conf_.get(board::MODEL_KEY, BOARD_TYPES)}
-    , irq_mask_{calc_irq_mask()} {
+    , irq_mask_{calc_irq_mask()}
+    , irq_wait_mode_{conf_.get_optional(IRQ_WAIT_MODE_KEY, IRQ_WAIT_MODES)
+                         .get_value_or(irq_wait_mode::BLOCK)}
+    , irq_spin_time_{conf_.get<size_t>(
+          IRQ_SPIN_TIME_KEY, static_cast<size_t>(DEFAULT_IRQ_SPIN_TIME))}
+    , irq_yield_time_{conf_.get<size_t>(
+          IRQ_YIELD_TIME_KEY, static_cast<size_t>(DEFAULT_IRQ_YIELD_TIME))} {
   init();
+  autotune_mblt();
 }
 
 caen_bridge::~caen_bridge() { end(); }
 
-void caen_bridge::wait_for_irq(size_t timeout) const {
+void caen_bridge::wait_for_irq(const std::chrono::microseconds timeout) const {
+  probe_link_if_due();
+  if (irq_wait_mode_ == irq_wait_mode::POLL) {
+    poll_for_irq(timeout);
+  } else {
+    block_for_irq(timeout);
+  }
+}
+
+void caen_bridge::block_for_irq(const std::chrono::microseconds timeout) const {
+  const auto start = transfer_stats::now();
   CVErrorCodes err = CAENVME_IRQEnable(handle_, irq_mask_);
   HANDLE_CAEN_ERROR(err, "Failed to enable IRQ on bridge");
-  err = CAENVME_IRQWait(handle_, irq_mask_, timeout);
+  // IRQWait has a [ms] granularity
+  const uint32_t timeout_ms{
+      static_cast<uint32_t>((timeout.count() + 999) / 1000)};
+  err = CAENVME_IRQWait(handle_, irq_mask_, timeout_ms);
+  if (err == cvTimeoutError) {
+    stats_.record_irq_timeout();
+  }
   HANDLE_CAEN_ERROR(err, "Problem waiting for IRQ");
+  stats_.record_irq(irq_phase::BLOCK, start);
+}
+
+void caen_bridge::poll_for_irq(const std::chrono::microseconds timeout) const {
+  const auto start = transfer_stats::now();
+  const auto deadline = start + timeout;
+  const auto spin_end = start + irq_spin_time_;
+  const auto yield_end = spin_end + irq_yield_time_;
+  // start of the last check that did not see the IRQ
+  auto absent = start;
+  auto check = start;
+  while (true) {
+    const irq_phase phase{check < spin_end ? irq_phase::SPIN
+                                           : irq_phase::YIELD};
+    if (pending_irqs() & irq_mask_) {
+      stats_.record_irq(phase, absent);
+      return;
+    }
+    absent = check;
+    check = transfer_stats::now();
+    if (check >= deadline) {
+      stats_.record_irq_timeout();
+      throw timeout_error("Timeout polling for IRQ");
+    }
+    if (check >= yield_end) {
+      block_for_irq(std::chrono::duration_cast<std::chrono::microseconds>(
+          deadline - check));
+      return;
+    }
+    if (phase == irq_phase::YIELD) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+uint8_t caen_bridge::check_irq() const {
+  CAEN_BYTE mask{0};
+  CVErrorCodes err{CAENVME_IRQCheck(handle_, &mask)};
+  HANDLE_CAEN_ERROR(err, "Failed to check the IRQ lines");
+  return static_cast<uint8_t>(mask);
+}
+
+void caen_bridge::ping() const {
+  unsigned int val{0};
+  CVErrorCodes err{CAENVME_ReadRegister(handle_, cvStatusReg, &val)};
+  HANDLE_CAEN_ERROR(err, "Failed to read bridge status register");
+}
+
+size_t caen_bridge::read_multi(single_cycle* cycles, status* st,
+                               size_t n) const {
+  return multi_cycle(cycles, st, n, true);
+}
+size_t caen_bridge::write_multi(single_cycle* cycles, status* st,
+                                size_t n) const {
+  return multi_cycle(cycles, st, n, false);
+}
+
+size_t caen_bridge::multi_cycle(single_cycle* cycles, status* st, size_t n,
+                                const bool read) const {
+  // (only grows the buffers, if needed)
+  multi_.addrs.resize(n);
+  multi_.data.resize(n);
+  multi_.ams.resize(n);
+  multi_.widths.resize(n);
+  multi_.errs.assign(n, cvSuccess);
+  auto& addrs = multi_.addrs;
+  auto& data = multi_.data;
+  auto& ams = multi_.ams;
+  auto& widths = multi_.widths;
+  auto& errs = multi_.errs;
+  for (size_t i{0}; i < n; ++i) {
+    addrs[i] = cycles[i].address;
+    data[i] = cycles[i].data;
+    ams[i] = static_cast<CVAddressModifier>(cycles[i].am);
+    widths[i] = static_cast<CVDataWidth>(cycles[i].width);
+  }
+  size_t n_good{0};
+  for (size_t first{0}; first < n; first += MAX_MULTI_CYCLES) {
+    const int n_cycles = static_cast<int>(
+        (n - first) < MAX_MULTI_CYCLES ? (n - first) : MAX_MULTI_CYCLES);
+    CVErrorCodes err{
+        read ? CAENVME_MultiRead(handle_, &addrs[first], &data[first],
+                                 n_cycles, &ams[first], &widths[first],
+                                 &errs[first])
+             : CAENVME_MultiWrite(handle_, &addrs[first], &data[first],
+                                  n_cycles, &ams[first], &widths[first],
+                                  &errs[first])};
+    // bus errors are reported per cycle, anything else is fatal
+    if (err != cvBusError) {
+      HANDLE_CAEN_ERROR(err, read ? "MultiRead call failed"
+                                  : "MultiWrite call failed");
+    }
+  }
+  for (size_t i{0}; i < n; ++i) {
+    st[i] = decode_status(errs[i]);
+    if (st[i] == status::SUCCESS) {
+      ++n_good;
+      if (read) {
+        cycles[i].data = data[i];
+      }
+    }
+  }
+  return n_good;
 }
 
 void caen_bridge::init() {
@@ -33,6 +169,85 @@ void caen_bridge::init() {
   HANDLE_CAEN_ERROR(err, "Failed to initialize bridge");
 }
 
+void caen_bridge::autotune_mblt() {
+  auto address_str = conf_.get_optional<std::string>(MBLT_AUTOTUNE_ADDRESS_KEY);
+  if (!address_str) {
+    return;
+  }
+  const uint32_t address{
+      static_cast<uint32_t>(std::stoll(*address_str, nullptr, 0))};
+  const size_t window{conf_.get<size_t>(MBLT_AUTOTUNE_WINDOW_KEY)};
+  const size_t window_length{window /
+                             transfer_spec<transfer_mode::MBLT>::WIDTH};
+  if (window_length == 0) {
+    throw conf_.value_error(MBLT_AUTOTUNE_WINDOW_KEY, std::to_string(window));
+  }
+  // the reads stay inside the scratch memory window, so a bus error is
+  // a link problem and not the end of the window
+  const size_t max_length{std::min(
+      conf_.get<size_t>(MBLT_AUTOTUNE_MAX_LENGTH_KEY,
+                        static_cast<size_t>(DEFAULT_MBLT_AUTOTUNE_MAX_LENGTH)),
+      window_length)};
+  const size_t n_repeat{conf_.get<size_t>(
+      MBLT_AUTOTUNE_REPEAT_KEY,
+      static_cast<size_t>(DEFAULT_MBLT_AUTOTUNE_REPEAT))};
+  if (max_length == 0) {
+    throw conf_.value_error(MBLT_AUTOTUNE_MAX_LENGTH_KEY,
+                            std::to_string(max_length));
+  }
+  if (n_repeat == 0) {
+    throw conf_.value_error(MBLT_AUTOTUNE_REPEAT_KEY,
+                            std::to_string(n_repeat));
+  }
+  if (mblt_block_length_ > window_length) {
+    LOG_WARNING(name(), "MBLT autotune window smaller than the configured "
+                        "block length, autotuning skipped");
+    return;
+  }
+  LOG_INFO(name(), "Autotuning the MBLT block length (starting from " +
+                       std::to_string(mblt_block_length_) + " words)");
+  // the configured block length is the baseline, it has to work
+  if (!try_mblt_length(address, mblt_block_length_, n_repeat)) {
+    LOG_WARNING(name(), "MBLT reads fail at the configured block length, "
+                        "autotuning aborted");
+    return;
+  }
+  // keep doubling until the reads become unreliable or we reach the
+  // maximum block length
+  size_t best{mblt_block_length_};
+  while (best < max_length) {
+    const size_t length{(2 * best < max_length) ? 2 * best : max_length};
+    if (!try_mblt_length(address, length, n_repeat)) {
+      break;
+    }
+    best = length;
+  }
+  mblt_block_length_ = best;
+  LOG_INFO(name(), "MBLT block length set to " + std::to_string(best) +
+                       " words");
+}
+
+bool caen_bridge::try_mblt_length(const uint32_t address, const size_t length,
+                                  const size_t n_repeat) const {
+  std::vector<transfer_spec<transfer_mode::MBLT>::value_type> buf(length);
+  try {
+    for (size_t i{0}; i < n_repeat; ++i) {
+      const size_t n_read{
+          read_mblt<addressing_mode::A32>(address, buf.data(), length)};
+      if (n_read != length) {
+        LOG_JUNK(name(), "MBLT autotune: short read at " +
+                             std::to_string(length) + " words");
+        return false;
+      }
+    }
+  } catch (vme::error&) {
+    LOG_JUNK(name(), "MBLT autotune: read failed at " +
+                         std::to_string(length) + " words");
+    return false;
+  }
+  return true;
+}
+
 void caen_bridge::end() {
   CVErrorCodes err = CAENVME_End(handle_);
   HANDLE_CAEN_ERROR(err, "Failed to close bridge");
@@ -46,6 +261,23 @@ uint32_t caen_bridge::calc_irq_mask() const {
   return mask;
 }
 
+status caen_bridge::decode_status(const CVErrorCodes err) {
+  switch (err) {
+  case cvSuccess:
+    return status::SUCCESS;
+  case cvBusError:
+    return status::BUS_ERROR;
+  case cvCommError:
+    return status::COMM_ERROR;
+  case cvInvalidParam:
+    return status::INVALID_PARAMETER;
+  case cvTimeoutError:
+    return status::TIMEOUT_ERROR;
+  default:
+    return status::GENERIC_ERROR;
+  }
+}
+
 error caen_bridge::decode_error(const CVErrorCodes err,
                                 const std::string& msg) const {
   if (err == cvBusError) {
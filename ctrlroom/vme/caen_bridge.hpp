@@ -5,8 +5,10 @@
 #include <ctrlroom/vme/master.hpp>
 
 #include <CAENVMElib.h>
+#include <chrono>
 #include <cstddef>
 #include <string>
+#include <vector>
 
 // Throw a vme::error if a problem was encountered.
 // macro instead of inline function to avoid unnecessary
@@ -15,21 +17,87 @@
   if ((err)) {                                                                 \
     throw decode_error((err), (msg));                                          \
   }
+// Same, for the transfer hooks: when the master asks for a status code
+// (cf. master<>::status_sink_), report it there and return <n_done>
+// instead of throwing
+#define REPORT_CAEN_ERROR(err, msg, n_done)                                    \
+  if ((err)) {                                                                 \
+    if (status_sink_) {                                                        \
+      *status_sink_ = decode_status((err));                                    \
+      return (n_done);                                                         \
+    }                                                                          \
+    throw decode_error((err), (msg));                                          \
+  }
 
 namespace ctrlroom {
 namespace vme {
 
+// CAEN VX1718 (USB) and VX2718 (optical link) VME bridges
+// NOTES:
+//      * 2eVME and 2eSST block transfers are not supported:
+//        CAENVMElib has no call that issues the XAM phase.
+//      * The MBLT block length can be tuned on startup for the actual
+//        link by repeatedly reading a scratch memory that supports MBLT
+//        (A32) reads (e.g. a memory module, or a RAM window without
+//        side effects on read). The reads never go past the end of the
+//        configured window. FIFOs are not suitable: they would be
+//        drained, and their depth would be measured instead of the
+//        link.
+//      * IRQ wait modes:
+//          - BLOCK: IRQEnable + IRQWait (the bridge notifies the host,
+//            [ms] timeout granularity)
+//          - POLL: check the IRQ lines with IRQCheck, busy polling
+//            for <irqSpinTime>, then yielding the CPU between checks
+//            for <irqYieldTime>, and finally a blocking wait for the
+//            remainder of the timeout. Lowest trigger-to-readout
+//            latency, at the cost of a busy CPU core and link traffic.
+//        The achieved latency is reported in master<>::stats().irq.
+//
+// CONFIGURATION FILE OPTIONS (on top of the master options)
+// optional
+//      * IRQ wait mode: <id>.irqWaitMode ("block" or "poll", defaults
+//        to "block")
+//      * busy polling time (in [us]): <id>.irqSpinTime (defaults to 50)
+//      * yield polling time (in [us]): <id>.irqYieldTime
+//        (defaults to 1000)
+//      * MBLT autotune scratch memory address (hex string, A32):
+//        <id>.mbltAutotuneAddress (autotuning is disabled when not set)
+//      * Size of the scratch memory window (in bytes, required with
+//        the address): <id>.mbltAutotuneWindow
+//      * Maximum MBLT block length (in 64-bit words, capped at the
+//        window size): <id>.mbltAutotuneMaxLength (defaults to 8192)
+//      * Number of reads at each block length: <id>.mbltAutotuneRepeat
+//        (defaults to 10)
 class caen_bridge : public vme::master<caen_bridge> {
 public:
   using base_type = vme::master<caen_bridge>;
 
+  constexpr static const char* MBLT_AUTOTUNE_ADDRESS_KEY{
+      "mbltAutotuneAddress"};
+  constexpr static const char* MBLT_AUTOTUNE_WINDOW_KEY{"mbltAutotuneWindow"};
+  constexpr static const char* MBLT_AUTOTUNE_MAX_LENGTH_KEY{
+      "mbltAutotuneMaxLength"};
+  constexpr static const char* MBLT_AUTOTUNE_REPEAT_KEY{"mbltAutotuneRepeat"};
+  constexpr static size_t DEFAULT_MBLT_AUTOTUNE_MAX_LENGTH{8192};
+  constexpr static size_t DEFAULT_MBLT_AUTOTUNE_REPEAT{10};
+  constexpr static const char* IRQ_WAIT_MODE_KEY{"irqWaitMode"};
+  constexpr static const char* IRQ_SPIN_TIME_KEY{"irqSpinTime"};
+  constexpr static const char* IRQ_YIELD_TIME_KEY{"irqYieldTime"};
+  constexpr static size_t DEFAULT_IRQ_SPIN_TIME{50};    // in [us]
+  constexpr static size_t DEFAULT_IRQ_YIELD_TIME{1000}; // in [us]
+
+  enum class irq_wait_mode { BLOCK, POLL };
+
   caen_bridge(const std::string& identifier, const ptree& settings);
 
   ~caen_bridge();
 
   // wait for the next IRQ
+  // (probes the link first if a periodic link probe is due)
   void wait_for_irq() const;
   void wait_for_irq(size_t timeout) const;
+  // with a [us] timeout (rounded up to [ms] for blocking waits)
+  void wait_for_irq(const std::chrono::microseconds timeout) const;
 
 protected:
   // Single
@@ -39,6 +107,10 @@ protected:
   template <addressing_mode A, transfer_mode D>
   size_t write_single(const typename address_spec<A>::ptr_type address,
                       typename transfer_spec<D>::ptr_type val) const;
+  // RMW
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const;
   // BLT
   template <addressing_mode A, transfer_mode D>
   size_t read_blt(const typename address_spec<A>::ptr_type address,
@@ -57,20 +129,85 @@ protected:
   size_t write_mblt(const typename address_spec<A>::ptr_type address,
                     transfer_spec<transfer_mode::MBLT>::ptr_type buf,
                     size_t n_requests) const;
+  // CBLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const;
+  // MULTI (batched single cycles)
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  // IRQ
+  template <transfer_mode D>
+  size_t iack(const irq_level level,
+              typename transfer_spec<D>::ptr_type vector) const;
+  uint8_t check_irq() const;
+  // PING: read the bridge status register
+  void ping() const;
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const;
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const;
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const;
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const;
 
 private:
   void setup();
   void init();
   void end();
 
+  // find the largest MBLT block length that can be read reliably
+  // (only when MBLT_AUTOTUNE_ADDRESS_KEY is set)
+  void autotune_mblt();
+  // true if <n_repeat> MBLT reads of <length> words all succeed
+  bool try_mblt_length(const uint32_t address, const size_t length,
+                       const size_t n_repeat) const;
+
   // calculate the IRQ mask from base_type::irq_
   uint32_t calc_irq_mask() const;
 
   vme::error decode_error(const CVErrorCodes err, const std::string& msg) const;
+  // translate CAEN error codes into status codes
+  static vme::status decode_status(const CVErrorCodes err);
+
+  // DRY implementation of read_multi() and write_multi()
+  size_t multi_cycle(single_cycle* cycles, vme::status* st, size_t n,
+                     const bool read) const;
+
+  // IRQ wait strategies (cf. irq_wait_mode)
+  void block_for_irq(const std::chrono::microseconds timeout) const;
+  void poll_for_irq(const std::chrono::microseconds timeout) const;
 
   int32_t handle_;
   const CVBoardTypes model_;
   uint32_t irq_mask_;
+  const irq_wait_mode irq_wait_mode_;
+  const std::chrono::microseconds irq_spin_time_;
+  const std::chrono::microseconds irq_yield_time_;
+
+  // argument arrays for MultiRead/MultiWrite, kept between calls so
+  // repeated batches do not allocate (the calls are serialized by the
+  // cycle scheduler)
+  struct multi_arrays {
+    std::vector<uint32_t> addrs;
+    std::vector<uint32_t> data;
+    std::vector<CVAddressModifier> ams;
+    std::vector<CVDataWidth> widths;
+    std::vector<CVErrorCodes> errs;
+  };
+  mutable multi_arrays multi_;
 
   VME_FRIEND_MASTER(base_type);
 };
@@ -84,6 +221,20 @@ namespace ctrlroom {
 namespace vme {
 
 inline void caen_bridge::wait_for_irq() const { wait_for_irq(timeout_); }
+inline void caen_bridge::wait_for_irq(size_t timeout) const {
+  wait_for_irq(std::chrono::milliseconds(timeout));
+}
+
+template <transfer_mode D>
+size_t caen_bridge::iack(const irq_level level,
+                         typename transfer_spec<D>::ptr_type vector) const {
+  constexpr CVDataWidth width{
+      static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
+  CVErrorCodes err{CAENVME_IACKCycle(
+      handle_, static_cast<CVIRQLevels>(level), vector, width)};
+  HANDLE_CAEN_ERROR(err, "IACKCycle call failed");
+  return {1};
+}
 
 template <addressing_mode A, transfer_mode D>
 size_t
@@ -95,7 +246,7 @@ caen_bridge::read_single(const typename address_spec<A>::ptr_type address,
   constexpr CVDataWidth width{
       static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
   CVErrorCodes err{CAENVME_ReadCycle(handle_, address, val, am, width)};
-  HANDLE_CAEN_ERROR(err, "ReadCycle call failed");
+  REPORT_CAEN_ERROR(err, "ReadCycle call failed", 0);
   return {1};
 }
 template <addressing_mode A, transfer_mode D>
@@ -108,7 +259,20 @@ caen_bridge::write_single(const typename address_spec<A>::ptr_type address,
   constexpr CVDataWidth width{
       static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
   CVErrorCodes err{CAENVME_WriteCycle(handle_, address, val, am, width)};
-  HANDLE_CAEN_ERROR(err, "WriteCycle call failed");
+  REPORT_CAEN_ERROR(err, "WriteCycle call failed", 0);
+  return {1};
+}
+template <addressing_mode A, transfer_mode D>
+size_t
+caen_bridge::rmw_single(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type val) const {
+
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(address_spec<A>::DATA)};
+  constexpr CVDataWidth width{
+      static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
+  CVErrorCodes err{CAENVME_RMWCycle(handle_, address, val, am, width)};
+  REPORT_CAEN_ERROR(err, "RMWCycle call failed", 0);
   return {1};
 }
 
@@ -125,7 +289,8 @@ size_t caen_bridge::read_blt(const typename address_spec<A>::ptr_type address,
   n_requests *= transfer_spec<D>::WIDTH;
   CVErrorCodes err{CAENVME_BLTReadCycle(handle_, address, buf, n_requests, am,
                                         width, &n_read)};
-  HANDLE_CAEN_ERROR(err, "BLTReadCycle failed");
+  REPORT_CAEN_ERROR(err, "BLTReadCycle failed",
+                    static_cast<size_t>(n_read) / transfer_spec<D>::WIDTH);
   // number of read values in D words
   n_read /= transfer_spec<D>::WIDTH;
   return static_cast<size_t>(n_read);
@@ -143,7 +308,8 @@ size_t caen_bridge::write_blt(const typename address_spec<A>::ptr_type address,
   n_requests *= transfer_spec<D>::WIDTH;
   CVErrorCodes err{CAENVME_BLTWriteCycle(handle_, address, buf, n_requests, am,
                                          width, &n_written)};
-  HANDLE_CAEN_ERROR(err, "BLTWriteCycle failed");
+  REPORT_CAEN_ERROR(err, "BLTWriteCycle failed",
+                    static_cast<size_t>(n_written) / transfer_spec<D>::WIDTH);
   // number of written values in D words
   n_written /= transfer_spec<D>::WIDTH;
   return static_cast<size_t>(n_written);
@@ -167,7 +333,9 @@ size_t caen_bridge::read_mblt(const typename address_spec<A>::ptr_type address,
   // DBG}
   // DBG++DBG;
   // DBG
-  HANDLE_CAEN_ERROR(err, "MBLTReadCycle failed");
+  REPORT_CAEN_ERROR(err, "MBLTReadCycle failed",
+                    static_cast<size_t>(n_read) /
+                        transfer_spec<transfer_mode::MBLT>::WIDTH);
   // number of read values in 64-bit words
   n_read /= transfer_spec<transfer_mode::MBLT>::WIDTH;
   return static_cast<size_t>(n_read);
@@ -183,7 +351,111 @@ size_t caen_bridge::write_mblt(const typename address_spec<A>::ptr_type address,
   n_requests *= transfer_spec<transfer_mode::MBLT>::WIDTH;
   CVErrorCodes err{CAENVME_MBLTWriteCycle(handle_, address, buf, n_requests, am,
                                           &n_written)};
-  HANDLE_CAEN_ERROR(err, "MBLTWriteCycle failed");
+  REPORT_CAEN_ERROR(err, "MBLTWriteCycle failed",
+                    static_cast<size_t>(n_written) /
+                        transfer_spec<transfer_mode::MBLT>::WIDTH);
+  // number of written values in 64-bit words
+  n_written /= transfer_spec<transfer_mode::MBLT>::WIDTH;
+  return static_cast<size_t>(n_written);
+}
+template <addressing_mode A, transfer_mode D>
+size_t caen_bridge::read_cblt(const typename address_spec<A>::ptr_type address,
+                              typename transfer_spec<D>::ptr_type buf,
+                              size_t n_requests) const {
+  int n_read{0};
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(deduce_block_modifier<A, D>())};
+  constexpr CVDataWidth width{
+      static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
+  // requests in bytes
+  n_requests *= transfer_spec<D>::WIDTH;
+  CVErrorCodes err{
+      D == transfer_mode::MBLT
+          ? CAENVME_MBLTReadCycle(handle_, address, buf, n_requests, am,
+                                  &n_read)
+          : CAENVME_BLTReadCycle(handle_, address, buf, n_requests, am, width,
+                                 &n_read)};
+  // the last board in the chain ends the transfer with a bus error
+  if (err != cvBusError) {
+    REPORT_CAEN_ERROR(err, "CBLT read cycle failed",
+                      static_cast<size_t>(n_read) / transfer_spec<D>::WIDTH);
+  }
+  // number of read values in D words
+  n_read /= transfer_spec<D>::WIDTH;
+  return static_cast<size_t>(n_read);
+}
+template <addressing_mode A, transfer_mode D>
+size_t
+caen_bridge::read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                           typename transfer_spec<D>::ptr_type buf,
+                           size_t n_requests) const {
+  int n_read{0};
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(address_spec<A>::BLT)};
+  constexpr CVDataWidth width{
+      static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
+  // requests in bytes
+  n_requests *= transfer_spec<D>::WIDTH;
+  CVErrorCodes err{CAENVME_FIFOBLTReadCycle(handle_, address, buf, n_requests,
+                                            am, width, &n_read)};
+  REPORT_CAEN_ERROR(err, "FIFOBLTReadCycle failed",
+                    static_cast<size_t>(n_read) / transfer_spec<D>::WIDTH);
+  // number of read values in D words
+  n_read /= transfer_spec<D>::WIDTH;
+  return static_cast<size_t>(n_read);
+}
+template <addressing_mode A, transfer_mode D>
+size_t
+caen_bridge::write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                            typename transfer_spec<D>::ptr_type buf,
+                            size_t n_requests) const {
+  int n_written{0};
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(address_spec<A>::BLT)};
+  constexpr CVDataWidth width{
+      static_cast<CVDataWidth>(transfer_spec<D>::WIDTH)};
+  // requests in bytes
+  n_requests *= transfer_spec<D>::WIDTH;
+  CVErrorCodes err{CAENVME_FIFOBLTWriteCycle(handle_, address, buf, n_requests,
+                                             am, width, &n_written)};
+  REPORT_CAEN_ERROR(err, "FIFOBLTWriteCycle failed",
+                    static_cast<size_t>(n_written) / transfer_spec<D>::WIDTH);
+  // number of written values in D words
+  n_written /= transfer_spec<D>::WIDTH;
+  return static_cast<size_t>(n_written);
+}
+template <addressing_mode A>
+size_t caen_bridge::read_fifo_mblt(
+    const typename address_spec<A>::ptr_type address,
+    transfer_spec<transfer_mode::MBLT>::ptr_type buf, size_t n_requests) const {
+  int n_read{0};
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(address_spec<A>::MBLT)};
+  // requests in bytes
+  n_requests *= transfer_spec<transfer_mode::MBLT>::WIDTH;
+  CVErrorCodes err{CAENVME_FIFOMBLTReadCycle(handle_, address, buf, n_requests,
+                                             am, &n_read)};
+  REPORT_CAEN_ERROR(err, "FIFOMBLTReadCycle failed",
+                    static_cast<size_t>(n_read) /
+                        transfer_spec<transfer_mode::MBLT>::WIDTH);
+  // number of read values in 64-bit words
+  n_read /= transfer_spec<transfer_mode::MBLT>::WIDTH;
+  return static_cast<size_t>(n_read);
+}
+template <addressing_mode A>
+size_t caen_bridge::write_fifo_mblt(
+    const typename address_spec<A>::ptr_type address,
+    transfer_spec<transfer_mode::MBLT>::ptr_type buf, size_t n_requests) const {
+  int n_written{0};
+  constexpr CVAddressModifier am{
+      static_cast<CVAddressModifier>(address_spec<A>::MBLT)};
+  // requests in bytes
+  n_requests *= transfer_spec<transfer_mode::MBLT>::WIDTH;
+  CVErrorCodes err{CAENVME_FIFOMBLTWriteCycle(handle_, address, buf,
+                                              n_requests, am, &n_written)};
+  REPORT_CAEN_ERROR(err, "FIFOMBLTWriteCycle failed",
+                    static_cast<size_t>(n_written) /
+                        transfer_spec<transfer_mode::MBLT>::WIDTH);
   // number of written values in 64-bit words
   n_written /= transfer_spec<transfer_mode::MBLT>::WIDTH;
   return static_cast<size_t>(n_written);
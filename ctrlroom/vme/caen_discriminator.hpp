@@ -71,6 +71,7 @@ public:
   using instructions = caen_discriminator_impl::instructions<A>;
   using data_type = typename base_type::single_data_type;
   using address_type = typename base_type::address_type;
+  using batch_type = typename base_type::batch_type;
   using base_type::name;
   using base_type::conf;
   using base_type::write;
@@ -105,6 +106,8 @@ board<Master, M, A, D>::board(const std::string& identifier,
                               const ptree& settings,
                               std::shared_ptr<Master>& master)
     : base_type{identifier, settings, master} {
+  // all settings are written in a single batch
+  batch_type batch{this->batch()};
   // set the trigger thresholds with matching inhibit mask
   LOG_JUNK(name(), "Setting the trigger thresholds");
   data_type inhibit_pattern = 0x0; // default: everything inhibited
@@ -124,7 +127,7 @@ board<Master, M, A, D>::board(const std::string& identifier,
       // set the threshold on the board
       const auto th = instructions::THRESHOLD;
       std::cout << ich << " " << th[ich] << " " << thresh << std::endl;
-      write(th[ich], thresh);
+      batch.write(th[ich], thresh);
       // update the bitmask
       inhibit_pattern |= CHANNEL_MASK[ich];
     }
@@ -132,7 +135,7 @@ board<Master, M, A, D>::board(const std::string& identifier,
   // set the inhibit mask
   LOG_JUNK(name(), "Setting the trigger inhibit mask");
   std::cout << "inhibit_pattern: " << inhibit_pattern << std::endl;
-  write(instructions::PATTERN_INHIBITOR, inhibit_pattern);
+  batch.write(instructions::PATTERN_INHIBITOR, inhibit_pattern);
 
   // set the output signal width (trigger window)
   LOG_JUNK(name(), "Setting the trigger window");
@@ -141,8 +144,8 @@ board<Master, M, A, D>::board(const std::string& identifier,
     throw conf().value_error(OUTPUT_WIDTH_KEY, std::to_string(output_width));
   }
   std::cout << "OW: " << output_width << std::endl;
-  write(instructions::OUTPUT_WIDTH_0_7, output_width);
-  write(instructions::OUTPUT_WIDTH_8_15, output_width);
+  batch.write(instructions::OUTPUT_WIDTH_0_7, output_width);
+  batch.write(instructions::OUTPUT_WIDTH_8_15, output_width);
 
   // set the majority threshold (~coincidence, defaults to 1)
   LOG_JUNK(name(), "Setting the majority threshold");
@@ -151,10 +154,13 @@ board<Master, M, A, D>::board(const std::string& identifier,
   if (maj > MAX_INTERNAL_MAJORITY_THRESHOLD || maj < 1) {
     throw conf().value_error(MAJORITY_KEY, std::to_string(maj));
   }
-  write(instructions::MAJORITY_THRESHOLD,
-        static_cast<data_type>(round((maj * 50 - 25) / 4)));
+  batch.write(instructions::MAJORITY_THRESHOLD,
+              static_cast<data_type>(round((maj * 50 - 25) / 4)));
   std::cout << static_cast<data_type>(round((maj * 50 - 25) / 4)) << std::endl;
 
+  batch.submit();
+  batch.check("Problem initializing the board");
+
       // all done!
       LOG_JUNK(name(), "board initialized");
 }
@@ -162,7 +168,7 @@ board<Master, M, A, D>::board(const std::string& identifier,
 template <class Master, submodel M, addressing_mode A, transfer_mode D>
 void board<Master, M, A, D>::send_test_pulse() {
   LOG_JUNK(name(), "Sending a test pulse to the board");
-  write(instructions::TEST_PULSE, 1);
+  this->strobe(instructions::TEST_PULSE, 1);
 }
 
 } // ns caen_discriminator_impl
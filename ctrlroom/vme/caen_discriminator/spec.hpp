@@ -31,14 +31,23 @@ struct properties {
   // maximum width is non-linear (think rising exponential)
   static constexpr uint8_t MIN_OUTPUT_WIDTH{0};
   static constexpr uint8_t MAX_OUTPUT_WIDTH{255};
+  // module identifier words
+  //  - FIXED_CODE register
+  //  - MODEL_TYPE register: manufacturer (upper 6 bits) and module type
+  //    (lower 10 bits, cf. extra_properties)
+  //  - SERIAL register: version (upper 4 bits) and serial number
+  //    (lower 12 bits)
+  static constexpr uint16_t FIXED_CODE{0xFAF5};
+  static constexpr uint16_t MANUFACTURER{0x02};
 };
 
 // extra properties that differ between the different discriminator boards
 template <submodel M> struct extra_properties;
 template <> struct extra_properties<submodel::V895> {
-  // nothing here
+  static constexpr uint16_t MODULE_TYPE{0x054};
 };
 template <> struct extra_properties<submodel::V812> {
+  static constexpr uint16_t MODULE_TYPE{0x051};
   // dead time in ns
   static constexpr double MIN_DEADTIME {150};
   static constexpr double MAX_DEADTIME {2000};
@@ -13,11 +13,13 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <limits>
 #include <string>
 #include <memory>
 #include <cmath>
 #include <fstream>
+#include <vector>
 
 namespace ctrlroom {
 namespace vme {
@@ -46,6 +48,30 @@ template <class Board> struct calibration {
 template <class Board> struct channel_view;
 template <class View> struct channel_view_iterator;
 
+// unfolded, pedestal-subtracted waveforms of all channels, filled by
+// buffer<>::unfold(). Every channel is a contiguous array (structure of
+// arrays), starting on a cache line.
+template <class Board> class waveforms {
+public:
+  using board_type = Board;
+  using value_type = typename board_type::value_type;
+
+  waveforms();
+
+  // the <size()> samples of channel <chan>
+  value_type* channel(const size_t chan);
+  const value_type* channel(const size_t chan) const;
+
+  // samples per channel
+  constexpr size_t size() const;
+
+private:
+  // distance between the channels, padded to a whole cache line
+  constexpr size_t stride() const;
+
+  transfer_vector<value_type> data_;
+};
+
 // buffer to store measured ADC data, and transparently provide
 // intuitive access to the underlying circular buffer
 template <class Board> class buffer {
@@ -55,6 +81,12 @@ public:
   using memory_type = typename board_type::memory_type;
   using value_type = typename board_type::value_type;
   using view_type = channel_view<buffer>;
+  using waveforms_type = waveforms<Board>;
+  // the raw board memory, as a transfer target (cf. master/memory.hpp)
+  using transfer_memory_type =
+      transfer_vector<typename memory_type::value_type>;
+
+  buffer();
 
   // return value at index <idx> for channel <chan> from the buffer,
   // taking care of the circular buffer unfolding.
@@ -74,6 +106,14 @@ public:
   // for more elegant array-like access
   view_type channel(const size_t chan) const;
 
+  // unfold the full buffer in a single pass: de-interleave the channels,
+  // mask and subtract the pedestals, for all channels at once.
+  // wf.channel(chan)[idx] == get(chan, idx)
+  // Use this instead of get() or channel() to analyze the full
+  // waveforms. Also requires a valid calibration.
+  void unfold(waveforms_type& wf) const;
+  waveforms_type unfold() const;
+
 private:
   value_type mask(const value_type val) const;
 
@@ -81,6 +121,11 @@ private:
   // returns the internal buffer address for this index
   size_t fold_index(size_t idx) const;
 
+  // unfold <n> consecutive rows of the circular buffer, starting at row
+  // <row>, into samples <idx>... of <wf>
+  void unfold_rows(const size_t row, const size_t n, const size_t idx,
+                   waveforms_type& wf) const;
+
   // calibrate the buffer, called by the V1729 board class
   // after the buffer is filled with new data
   void calibrate(std::shared_ptr<const calibration_type>& cal,
@@ -89,7 +134,7 @@ private:
   // helper function for calibrate() to get the correct vernier offset
   size_t vernier();
 
-  memory_type buffer_;
+  transfer_memory_type buffer_;
   size_t buffer_end_;
   std::shared_ptr<const calibration_type> calibration_;
 
@@ -121,6 +166,7 @@ private:
 //  optional, defualt to single
 //      * multiplexing mode: <id>.channelMultiplexing (single, duplex,
 // quadruplex)
+template <class Board> class acquisition;
 template <class Master, submodel M, addressing_mode A,
           transfer_mode DSingle = transfer_mode::D32,
           transfer_mode DBLT = transfer_mode::MBLT>
@@ -157,6 +203,8 @@ public:
   using single_data_type = typename base_type::single_data_type;
   using blt_data_type = typename base_type::blt_data_type;
   using address_type = typename base_type::address_type;
+  using batch_type = typename base_type::batch_type;
+  using plan_type = typename base_type::plan_type;
   using base_type::name;
   using base_type::addressing;
   using base_type::single_transfer;
@@ -171,8 +219,31 @@ public:
   // read the measured pulse from memory
   // will automatically restart acquisition
   // if autoRestartAcq is set to true
+  // (RAM_DATA is a FIFO port, and is read out as such)
   size_t read_pulse(buffer_type& buf);
 
+  // snapshot of the trigger counters and settings
+  struct register_dump {
+    uint16_t trig_count;
+    uint16_t trig_rate;
+    uint16_t pretrig;
+    uint16_t posttrig;
+    single_data_type mode_register;
+    single_data_type trigger_type;
+    single_data_type fp_frequency;
+  };
+  // read the register dump in a single planned read (cf. read_plan.hpp),
+  // instead of a single cycle per (half) register
+  // Throws while an overlapped acquisition is running.
+  register_dump read_registers() const;
+
+  // re-apply the configuration without resetting the board, and restart
+  // the acquisition. With the write shadow enabled (<id>.shadowWrites),
+  // only the registers that changed are written.
+  // Throws while an overlapped acquisition is running
+  // (cf. caen_v1729/acquisition.hpp). The calibrations are not reloaded.
+  void configure();
+
   // calibrate the verniers
   static void calibrate_verniers(const std::string& identifier,
                                  const ptree& settings,
@@ -192,11 +263,14 @@ public:
 private:
   // static members so the calibration functions can also use
   // the general initialization routines
+  // The init_* helpers only queue their register writes in <batch>,
+  // init() submits the whole configuration in one go.
   static void init(const base_type& b);
-  static void init_trigger(const base_type& b);
-  static void init_mode_register(const base_type& b);
-  static void init_digitizer(const base_type& b);
-  static void init_window(const base_type& b);
+  static void init_trigger(const base_type& b, batch_type& batch);
+  static void init_mode_register(const base_type& b, batch_type& batch);
+  static void init_digitizer(const base_type& b, batch_type& batch,
+                             const single_data_type old_clock);
+  static void init_window(const base_type& b, batch_type& batch);
   // end the session (called in the destructor)
   // issues a RESET instruction
   static void end(const base_type& b);
@@ -204,11 +278,17 @@ private:
   // load the calibrations
   void load_calibrations(const std::string& calibration_path);
 
+  // throw if an overlapped acquisition owns the board
+  void check_idle(const std::string& what) const;
+
   std::shared_ptr<const calibration_type> calibration_;
+  // set by the overlapped acquisition while its readout thread runs
+  std::atomic<bool> acquiring_;
 
   // to allow more simple syntax in the static member functions
   // using a bare slave<> object
   friend base_type;
+  template <class Board> friend class acquisition;
 };
 }
 // actual V1729a and V1729 aliases
@@ -327,11 +407,11 @@ board<Master, M, A, DSingle, DBLT>::board(const std::string& identifier,
                                           const ptree& settings,
                                           std::shared_ptr<Master>& master,
                                           const std::string& calibration_path)
-    : base_type{identifier, settings, master} {
+    : base_type{identifier, settings, master}, acquiring_{false} {
   init(*this);
   load_calibrations(calibration_path);
   LOG_JUNK(identifier, "Start data acquisition mode.");
-  this->write(instructions::START_ACQUISITION, 1);
+  this->strobe(instructions::START_ACQUISITION, 1);
 }
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
@@ -343,7 +423,7 @@ template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 size_t board<Master, M, A, DSingle, DBLT>::read_pulse(
     board<Master, M, A, DSingle, DBLT>::buffer_type& buf) {
-  size_t nread{this->read(instructions::RAM_DATA, buf.buffer_)};
+  size_t nread{this->read_fifo(instructions::RAM_DATA, buf.buffer_)};
   single_data_type trig_rec;
   // read the trig_rec and automatically restart
   // acquisition
@@ -358,6 +438,54 @@ size_t board<Master, M, A, DSingle, DBLT>::read_pulse(
   return nread;
 }
 
+template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+typename board<Master, M, A, DSingle, DBLT>::register_dump
+board<Master, M, A, DSingle, DBLT>::read_registers() const {
+  check_idle("read the registers");
+  plan_type plan{this->plan()};
+  const auto trig_count =
+      plan.add(instructions::TRIG_COUNT.LSB, instructions::TRIG_COUNT.MSB);
+  const auto trig_rate =
+      plan.add(instructions::TRIG_RATE.LSB, instructions::TRIG_RATE.MSB);
+  const auto pretrig =
+      plan.add(instructions::PRETRIG.LSB, instructions::PRETRIG.MSB);
+  const auto posttrig =
+      plan.add(instructions::POSTTRIG.LSB, instructions::POSTTRIG.MSB);
+  const auto mode_register = plan.add(instructions::MODE_REGISTER);
+  const auto trigger_type = plan.add(instructions::TRIGGER_TYPE);
+  const auto fp_frequency = plan.add(instructions::FP_FREQUENCY);
+  const auto regs = plan.read();
+  regs.check("Problem reading the board registers");
+  return {regs[trig_count],    regs[trig_rate],    regs[pretrig],
+          regs[posttrig],      regs[mode_register], regs[trigger_type],
+          regs[fp_frequency]};
+}
+
+template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void board<Master, M, A, DSingle, DBLT>::configure() {
+  check_idle("re-configure the board");
+  LOG_JUNK(name(), "Re-configuring board");
+  // current pilot frequency, from the shadow if possible
+  single_data_type old_clock{0};
+  auto clock = this->shadow(instructions::FP_FREQUENCY);
+  if (clock) {
+    old_clock = *clock;
+  } else {
+    this->read(instructions::FP_FREQUENCY, old_clock);
+  }
+  batch_type batch{this->batch()};
+  init_trigger(*this, batch);
+  init_mode_register(*this, batch);
+  init_digitizer(*this, batch, old_clock);
+  init_window(*this, batch);
+  LOG_JUNK(name(), std::to_string(batch.size()) + " registers changed");
+  batch.submit();
+  batch.check("Problem re-configuring the board");
+  this->strobe(instructions::START_ACQUISITION, 1);
+}
+
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::calibrate_verniers(
@@ -379,28 +507,26 @@ void board<Master, M, A, DSingle, DBLT>::calibrate_verniers(
   b.write(instructions::CHANNEL_MASK, channel::CALL);
   // read zero columns from memory for fast calibration
   b.write(instructions::NB_OF_COLS_TO_READ, 0);
-  // (heap) array to store the vernier data
-  using vernier_memory_type =
-      std::array<memory_type::value_type, VERNIER_MEMORY_SIZE>;
-  std::unique_ptr<vernier_memory_type> vbuf{new vernier_memory_type};
+  // (transfer memory) array to store the vernier data
+  transfer_vector<memory_type::value_type> vbuf(VERNIER_MEMORY_SIZE);
   // acquisition loop
   LOG_JUNK(identifier, "acquisition start");
-  b.write(instructions::START_ACQUISITION, 1);
+  b.strobe(instructions::START_ACQUISITION, 1);
   // use non-standard timeout because it takes a few seconds
   // the entire 128kB of memory
   master->wait_for_irq(50000);
   LOG_JUNK(identifier, "reading verniers from memory");
-  size_t nread{b.read(instructions::RAM_DATA, *vbuf)};
+  size_t nread{b.read_fifo(instructions::RAM_DATA, vbuf)};
   tassert(nread == VERNIER_MEMORY_SIZE,
           "Problem reading the vernier calibration data");
   // process the data
-  for (size_t i{0}; i < vbuf->size(); ++i) {
+  for (size_t i{0}; i < vbuf.size(); ++i) {
     size_t channel{N_CHANNELS - (i % N_CHANNELS) - 1};
-    if ((*vbuf)[i] < min[channel]) {
-      min[channel] = (*vbuf)[i];
+    if (vbuf[i] < min[channel]) {
+      min[channel] = vbuf[i];
     }
-    if ((*vbuf)[i] > max[channel]) {
-      max[channel] = (*vbuf)[i];
+    if (vbuf[i] > max[channel]) {
+      max[channel] = vbuf[i];
     }
   }
 
@@ -420,9 +546,10 @@ void board<Master, M, A, DSingle, DBLT>::measure_pedestal(
     std::shared_ptr<Master>& master, const std::string& calibration_path,
     size_t n_acquisitions) {
   LOG_INFO(identifier, "Measuring the board pedestal.");
-  // init the arrays
+  // init the arrays (the raw data is read into transfer memory)
   memory_type ped{0};
-  std::array<double, MEMORY_SIZE + MEMORY_HEADER_SIZE> sum{0.};
+  transfer_vector<memory_type::value_type> raw(MEMORY_SIZE);
+  std::array<double, MEMORY_SIZE> sum{0.};
   // temporary board handle
   base_type b{identifier, settings, master};
   init(b);
@@ -434,11 +561,11 @@ void board<Master, M, A, DSingle, DBLT>::measure_pedestal(
   // do <n_acquisitions> acquisitions
   LOG_JUNK(identifier, "Acquisition start, running...");
   for (unsigned i{0}; i < n_acquisitions; ++i) {
-    b.write(instructions::START_ACQUISITION, 1);
+    b.strobe(instructions::START_ACQUISITION, 1);
     master->wait_for_irq();
-    size_t nread{b.read(instructions::RAM_DATA, ped)};
+    size_t nread{b.read_fifo(instructions::RAM_DATA, raw)};
     tassert(nread == MEMORY_SIZE, "Problem measuring the pedestal.");
-    std::transform(sum.begin(), sum.end(), ped.begin(), sum.begin(),
+    std::transform(sum.begin(), sum.end(), raw.begin(), sum.begin(),
                    [=](double a, memory_type::value_type b) {
       return a +
              static_cast<double>(b & extra_properties<M>::MEMORY_MASK) /
@@ -472,21 +599,36 @@ template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::init(
     const board<Master, M, A, DSingle, DBLT>::base_type& b) {
+  // 1. reset, and read the current pilot frequency
   LOG_JUNK(b.name(), "Reset board status");
-  b.write(instructions::RESET, 0x1);
-  init_trigger(b);
-  init_mode_register(b);
-  init_digitizer(b);
-  init_window(b);
+  batch_type reset{b.batch()};
+  single_data_type old_clock{0};
+  reset.strobe(instructions::RESET, 0x1);
+  reset.read(instructions::FP_FREQUENCY, old_clock);
+  reset.submit();
+  reset.check("Problem resetting the board");
+  // the reset invalidates the write shadow, except for the pilot
+  // frequency that we just read
+  b.invalidate_shadow();
+  b.set_shadow(instructions::FP_FREQUENCY, old_clock & 0x3F);
+  // 2. the full configuration
+  batch_type batch{b.batch()};
+  init_trigger(b, batch);
+  init_mode_register(b, batch);
+  init_digitizer(b, batch, old_clock);
+  init_window(b, batch);
+  batch.submit();
+  batch.check("Problem initializing the board");
   LOG_JUNK(b.name(), "board initialized")
 }
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::init_trigger(
-    const board<Master, M, A, DSingle, DBLT>::base_type& b) {
+    const board<Master, M, A, DSingle, DBLT>::base_type& b,
+    board<Master, M, A, DSingle, DBLT>::batch_type& batch) {
   LOG_JUNK(b.name(), "Initializing trigger");
   // enable the trigger rate monitor
-  b.write(instructions::RATE_REG, 0x1);
+  batch.write(instructions::RATE_REG, 0x1);
 
   // set the trigger type
   trigger_type type{b.conf().template get<trigger_type>(
@@ -494,7 +636,7 @@ void board<Master, M, A, DSingle, DBLT>::init_trigger(
   single_data_type bitpattern{b.conf().get_bitpattern(
       TRIGGER_SETTINGS_KEY, TRIGGER_SETTINGS_TRANSLATOR)};
   bitpattern |= type;
-  b.write(instructions::TRIGGER_TYPE, bitpattern);
+  batch.write(instructions::TRIGGER_TYPE, bitpattern);
 
   // set the channel source in case of "internal" and "or" trigger
   if (type == trigger_type::INTERNAL || type == trigger_type::OR) {
@@ -503,7 +645,7 @@ void board<Master, M, A, DSingle, DBLT>::init_trigger(
     if (!channel_pattern) {
       channel_pattern.reset(channel::CALL);
     };
-    b.write(instructions::TRIGGER_CHANNEL_SOURCE, *channel_pattern);
+    batch.write(instructions::TRIGGER_CHANNEL_SOURCE, *channel_pattern);
   }
 
   // set the trigger threshold as long as
@@ -522,14 +664,17 @@ void board<Master, M, A, DSingle, DBLT>::init_trigger(
     single_data_type i_threshold{static_cast<single_data_type>(
         (f_threshold + MAX_ABS_TRIGGER_THRESHOLD) /
         (2. * MAX_ABS_TRIGGER_THRESHOLD) * 0xFFF)};
-    b.write(instructions::TRIGGER_THRESHOLD_DAC, i_threshold);
-    b.write(instructions::LOAD_TRIGGER_THRESHOLD_DAC, 0x1);
+    batch.write(instructions::TRIGGER_THRESHOLD_DAC, i_threshold);
+    // only load the DAC once the threshold was written
+    batch.fence();
+    batch.strobe(instructions::LOAD_TRIGGER_THRESHOLD_DAC, 0x1);
   }
 }
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::init_mode_register(
-    const board<Master, M, A, DSingle, DBLT>::base_type& b) {
+    const board<Master, M, A, DSingle, DBLT>::base_type& b,
+    board<Master, M, A, DSingle, DBLT>::batch_type& batch) {
   LOG_JUNK(b.name(), "Initializing mode register");
   // bit 1: 12/14bit mode
   single_data_type mode_register = extra_properties<M>::BIT_MODE;
@@ -551,12 +696,14 @@ void board<Master, M, A, DSingle, DBLT>::init_mode_register(
   } else {
     mode_register |= 0x1 << 2;
   }
-  b.write(instructions::MODE_REGISTER, mode_register);
+  batch.write(instructions::MODE_REGISTER, mode_register);
 }
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::init_digitizer(
-    const board<Master, M, A, DSingle, DBLT>::base_type& b) {
+    const board<Master, M, A, DSingle, DBLT>::base_type& b,
+    board<Master, M, A, DSingle, DBLT>::batch_type& batch,
+    const single_data_type old_clock) {
   LOG_JUNK(b.name(), "Initializing digitizer");
   // sampling frequency
   single_data_type new_clock{
@@ -565,21 +712,20 @@ void board<Master, M, A, DSingle, DBLT>::init_digitizer(
   // even to the same value, requires new pedestals.
   // The change should therefor effectively be issued during the pedestal
   // measurement.
-  single_data_type old_clock{0};
-  b.read(instructions::FP_FREQUENCY, old_clock);
+  // (<old_clock> is read by init())
   if ((old_clock & 0x3F) != new_clock) {
     LOG_WARNING(b.name(), "CHANGING PILOT FREQUENCY");
-    b.write(instructions::FP_FREQUENCY, new_clock);
+    batch.write(instructions::FP_FREQUENCY, new_clock);
   }
   // number of cols to read (all)
-  b.write(instructions::NB_OF_COLS_TO_READ, N_CELLS);
+  batch.write(instructions::NB_OF_COLS_TO_READ, N_CELLS);
   // channels to read (default to all)
   auto channel_pattern =
       b.conf().get_optional_bitpattern(CHANNEL_MASK_KEY, CHANNEL_TRANSLATOR);
   if (!channel_pattern) {
     channel_pattern.reset(channel::CALL);
   }
-  b.write(instructions::CHANNEL_MASK, *channel_pattern);
+  batch.write(instructions::CHANNEL_MASK, *channel_pattern);
   // number of channels for multiplexing
   // (1 channel per channel)
   auto n_channels = b.conf().get_optional(CHANNEL_MULTIPLEXING_KEY,
@@ -587,13 +733,14 @@ void board<Master, M, A, DSingle, DBLT>::init_digitizer(
   if (!n_channels) {
     n_channels.reset(channel_multiplexing::C_SINGLE);
   }
-  b.write(instructions::NUMBER_OF_CHANNELS, *n_channels);
+  batch.write(instructions::NUMBER_OF_CHANNELS, *n_channels);
 }
 // initialize the pre- and post-trig windows
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT>
 void board<Master, M, A, DSingle, DBLT>::init_window(
-    const board<Master, M, A, DSingle, DBLT>::base_type& b) {
+    const board<Master, M, A, DSingle, DBLT>::base_type& b,
+    board<Master, M, A, DSingle, DBLT>::batch_type& batch) {
   LOG_JUNK(b.name(), "Initializing acquisition window");
   // pretrig
   uint16_t pretrig{b.conf().template get<uint16_t>(PRETRIG_KEY)};
@@ -611,10 +758,10 @@ void board<Master, M, A, DSingle, DBLT>::init_window(
     throw b.conf().value_error(POSTTRIG_KEY, std::to_string(posttrig));
   }
   // write to registers
-  b.write(instructions::PRETRIG.LSB, pretrig & 0xFF);
-  b.write(instructions::PRETRIG.MSB, (pretrig >> 8) & 0xFF);
-  b.write(instructions::POSTTRIG.LSB, posttrig & 0xFF);
-  b.write(instructions::POSTTRIG.MSB, (posttrig >> 8) & 0xFF);
+  batch.write(instructions::PRETRIG.LSB, pretrig & 0xFF);
+  batch.write(instructions::PRETRIG.MSB, (pretrig >> 8) & 0xFF);
+  batch.write(instructions::POSTTRIG.LSB, posttrig & 0xFF);
+  batch.write(instructions::POSTTRIG.MSB, (posttrig >> 8) & 0xFF);
 }
 // end our session (reset the board)
 template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
@@ -622,7 +769,8 @@ template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
 void board<Master, M, A, DSingle, DBLT>::end(
     const board<Master, M, A, DSingle, DBLT>::base_type& b) {
   LOG_JUNK(b.name(), "Resetting board status");
-  b.write(instructions::RESET, 0x1);
+  b.strobe(instructions::RESET, 0x1);
+  b.invalidate_shadow();
 }
 
 // load calibrations
@@ -643,6 +791,17 @@ void board<Master, M, A, DSingle, DBLT>::load_calibrations(
   calibration_.reset(new calibration_type{
       ped, min, max, this->conf_.template get<uint16_t>(POSTTRIG_KEY)});
 }
+
+template <class Master, submodel M, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void board<Master, M, A, DSingle, DBLT>::check_idle(
+    const std::string& what) const {
+  if (acquiring_) {
+    throw exception{name() + ": cannot " + what +
+                        " while an overlapped acquisition is running",
+                    "acquisition_running"};
+  }
+}
 }
 }
 }
@@ -665,6 +824,38 @@ calibration<Board>::calibration(const memory_type& ped, const vernier_type& min,
 }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// implementation: waveforms
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+namespace caen_v1729_impl {
+
+template <class Board>
+waveforms<Board>::waveforms()
+    : data_(board_type::N_CHANNELS * stride()) {}
+
+template <class Board>
+auto waveforms<Board>::channel(const size_t chan) -> value_type* {
+  return data_.data() + chan * stride();
+}
+template <class Board>
+auto waveforms<Board>::channel(const size_t chan) const -> const value_type* {
+  return data_.data() + chan * stride();
+}
+
+template <class Board> constexpr size_t waveforms<Board>::size() const {
+  return (board_type::MEMORY_DATA_SIZE / board_type::N_CHANNELS) -
+         board_type::MEMORY_DATA_SKIP;
+}
+template <class Board> constexpr size_t waveforms<Board>::stride() const {
+  return (size() * sizeof(value_type) + TRANSFER_ALIGNMENT - 1) /
+         TRANSFER_ALIGNMENT * TRANSFER_ALIGNMENT / sizeof(value_type);
+}
+}
+}
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // implementation: buffer
 ////////////////////////////////////////////////////////////////////////////////
@@ -672,6 +863,10 @@ namespace ctrlroom {
 namespace vme {
 namespace caen_v1729_impl {
 
+template <class Board>
+buffer<Board>::buffer()
+    : buffer_(board_type::MEMORY_SIZE), buffer_end_{0} {}
+
 template <class Board>
 auto buffer<Board>::get(const size_t chan, size_t idx) const -> value_type {
   idx = fold_index(idx);
@@ -708,6 +903,24 @@ auto buffer<Board>::channel(const size_t chan) const -> view_type {
   return {chan, *this};
 }
 
+template <class Board> void buffer<Board>::unfold(waveforms_type& wf) const {
+  tassert(calibration_, "null pointer error");
+  constexpr size_t n_rows{board_type::MEMORY_DATA_SIZE /
+                          board_type::N_CHANNELS};
+  // the circular buffer starts at <first>, so the waveforms are the rows
+  // first... up to the end of the memory, followed by the rows 0...
+  const size_t first{(fold_index(0) - board_type::MEMORY_HEADER_SIZE) /
+                     board_type::N_CHANNELS};
+  const size_t n_first{std::min(size(), n_rows - first)};
+  unfold_rows(first, n_first, 0, wf);
+  unfold_rows(0, size() - n_first, n_first, wf);
+}
+template <class Board> auto buffer<Board>::unfold() const -> waveforms_type {
+  waveforms_type wf;
+  unfold(wf);
+  return wf;
+}
+
 template <class Board>
 auto buffer<Board>::mask(
     const buffer<Board>::value_type val) const -> value_type {
@@ -728,6 +941,34 @@ template <class Board> size_t buffer<Board>::fold_index(size_t idx) const {
   return idx;
 }
 
+template <class Board>
+void buffer<Board>::unfold_rows(const size_t row, const size_t n,
+                                const size_t idx, waveforms_type& wf) const {
+  static_assert(board_type::N_CHANNELS == 4,
+                "buffer<>::unfold_rows() assumes 4 channels");
+  using index = channel_index<board_type::addressing>;
+  // every row holds one (interleaved) value per channel, the pedestals
+  // are stored in channel order
+  const size_t offset{board_type::MEMORY_HEADER_SIZE +
+                      row * board_type::N_CHANNELS};
+  const auto* raw = buffer_.data() + offset;
+  const auto* ped = calibration_->pedestal.data() + offset;
+  value_type* ch0{wf.channel(0) + idx};
+  value_type* ch1{wf.channel(1) + idx};
+  value_type* ch2{wf.channel(2) + idx};
+  value_type* ch3{wf.channel(3) + idx};
+  // straight-line loop with a fixed channel order, so the compiler can
+  // vectorize the de-interleaving
+  for (size_t i{0}; i < n; ++i) {
+    const auto* r = raw + i * board_type::N_CHANNELS;
+    const auto* p = ped + i * board_type::N_CHANNELS;
+    ch0[i] = mask(r[index::calc(0)]) - static_cast<value_type>(p[0]);
+    ch1[i] = mask(r[index::calc(1)]) - static_cast<value_type>(p[1]);
+    ch2[i] = mask(r[index::calc(2)]) - static_cast<value_type>(p[2]);
+    ch3[i] = mask(r[index::calc(3)]) - static_cast<value_type>(p[3]);
+  }
+}
+
 template <class Board>
 void buffer<Board>::calibrate(
     std::shared_ptr<const buffer<Board>::calibration_type>& cal,
@@ -0,0 +1,266 @@
+#ifndef CTRLROOM_VME_CAEN_V1729A_ACQUISITION_LOADED
+#define CTRLROOM_VME_CAEN_V1729A_ACQUISITION_LOADED
+
+#include <ctrlroom/vme/caen_v1729.hpp>
+#include <ctrlroom/vme/master.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ctrlroom {
+namespace vme {
+namespace caen_v1729_impl {
+
+// Overlapped, double-buffered acquisition driver for a V1729 board.
+//
+// A dedicated readout thread waits for the IRQ and reads the next pulse
+// into one buffer, while the consumer processes the other one. The board
+// runs in autoRestartAcq mode, so it is re-armed by the readout as soon
+// as TRIG_REC is read, and the processing time of the consumer is hidden
+// behind the acquisition of the next event.
+//
+// Usage:
+//    acquisition<board_type> acq{board, master};
+//    acq.start();
+//    while (const auto* buf = acq.next()) {
+//      // process *buf
+//    }
+//
+// The buffer returned by next() stays valid until the following call to
+// next() (or stop()), at which point it is handed back to the readout
+// thread. When the consumer holds on to a buffer while the other one is
+// filled, the readout thread stalls until a buffer is released.
+//
+// While the acquisition is running, the readout thread is the only user
+// of the board (and its master), the board should not be accessed
+// directly (board::configure() and board::read_registers() throw until
+// the acquisition is stopped).
+template <class Board> class acquisition {
+public:
+  using board_type = Board;
+  using master_type = typename board_type::master_type;
+  using buffer_type = typename board_type::buffer_type;
+
+  static constexpr size_t N_BUFFERS{2};
+
+  acquisition(board_type& board, std::shared_ptr<master_type>& master);
+  ~acquisition();
+
+  // start/stop the readout thread
+  // stop() can take up to the master IRQ timeout to return. It always
+  // joins the readout thread, also when the thread already ended because
+  // of an error. start() can be called again after such an error.
+  void start();
+  void stop();
+  bool running() const { return running_; }
+
+  // get the next filled buffer, releasing the previous one.
+  // Blocks until data is available. Returns a nullptr once the
+  // acquisition is stopped and all pending buffers are consumed.
+  // Problems encountered by the readout thread are rethrown here.
+  const buffer_type* next();
+
+  // number of events read out, and the number of times the readout
+  // thread had to wait for the consumer to release a buffer
+  size_t n_events() const { return n_events_; }
+  size_t n_stalls() const { return n_stalls_; }
+  // page faults taken by the readout thread during the last run
+  // (only complete once the run is stopped)
+  page_faults run_page_faults() const;
+
+private:
+  enum class buffer_state { FREE, READY, IN_USE };
+
+  void readout();
+  // index of a free buffer, waits for one if needed
+  // returns N_BUFFERS if the acquisition was stopped while waiting
+  size_t acquire_free();
+
+  board_type& board_;
+  std::shared_ptr<master_type> master_;
+
+  std::array<buffer_type, N_BUFFERS> buffers_;
+  std::array<buffer_state, N_BUFFERS> state_;
+  std::deque<size_t> ready_;
+  size_t in_use_;
+
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::exception_ptr error_;
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+
+  std::atomic<size_t> n_events_;
+  std::atomic<size_t> n_stalls_;
+  page_faults faults_;
+};
+}
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: acquisition
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+namespace caen_v1729_impl {
+
+template <class Board>
+acquisition<Board>::acquisition(board_type& board,
+                                std::shared_ptr<master_type>& master)
+    : board_(board)
+    , master_{master}
+    , in_use_{N_BUFFERS}
+    , running_{false}
+    , n_events_{0}
+    , n_stalls_{0}
+    , faults_{0, 0} {
+  tassert(master, "Invalid pointer to master module");
+  state_.fill(buffer_state::FREE);
+  // the overlap relies on the board re-arming itself when TRIG_REC is read
+  auto restart = board_.conf().get_optional(board_type::AUTO_RESTART_ACQ_KEY,
+                                            BINARY_TRANSLATOR);
+  if (restart && !*restart) {
+    throw board_.conf().value_error(board_type::AUTO_RESTART_ACQ_KEY, "false");
+  }
+}
+
+template <class Board> acquisition<Board>::~acquisition() { stop(); }
+
+template <class Board> void acquisition<Board>::start() {
+  if (running_) {
+    return;
+  }
+  // a readout thread that ended on its own (readout error) is still
+  // joinable, and has to be joined before it can be replaced
+  stop();
+  LOG_INFO(board_.name(), "Starting overlapped acquisition");
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    state_.fill(buffer_state::FREE);
+    ready_.clear();
+    in_use_ = N_BUFFERS;
+    error_ = nullptr;
+  }
+  board_.acquiring_ = true;
+  running_ = true;
+  thread_ = std::thread{&acquisition::readout, this};
+}
+
+template <class Board> void acquisition<Board>::stop() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    running_ = false;
+  }
+  cond_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+    LOG_INFO(board_.name(),
+             "Overlapped acquisition stopped after " +
+                 std::to_string(n_events_) + " events (" +
+                 std::to_string(n_stalls_) + " readout stalls)");
+    const page_faults faults{run_page_faults()};
+    LOG_INFO(board_.name(), "Readout thread page faults during the run: " +
+                                std::to_string(faults.minor) + " minor, " +
+                                std::to_string(faults.major) + " major");
+  }
+  board_.acquiring_ = false;
+}
+
+template <class Board> page_faults acquisition<Board>::run_page_faults() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return faults_;
+}
+
+template <class Board> auto acquisition<Board>::next() -> const buffer_type* {
+  std::unique_lock<std::mutex> lock{mutex_};
+  // release the previous buffer
+  if (in_use_ < N_BUFFERS) {
+    state_[in_use_] = buffer_state::FREE;
+    in_use_ = N_BUFFERS;
+    cond_.notify_all();
+  }
+  cond_.wait(lock, [this] { return !ready_.empty() || !running_; });
+  if (ready_.empty()) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return nullptr;
+  }
+  in_use_ = ready_.front();
+  ready_.pop_front();
+  state_[in_use_] = buffer_state::IN_USE;
+  return &buffers_[in_use_];
+}
+
+template <class Board> void acquisition<Board>::readout() {
+  const page_faults start_faults{thread_page_faults()};
+  try {
+    while (running_) {
+      const size_t idx{acquire_free()};
+      if (idx == N_BUFFERS) {
+        break;
+      }
+      try {
+        master_->wait_for_irq();
+      } catch (vme::timeout_error&) {
+        // no trigger yet, check if we are still running
+        continue;
+      }
+      board_.read_pulse(buffers_[idx]);
+      ++n_events_;
+      {
+        std::lock_guard<std::mutex> lock{mutex_};
+        state_[idx] = buffer_state::READY;
+        ready_.push_back(idx);
+      }
+      cond_.notify_all();
+    }
+  } catch (...) {
+    LOG_ERROR(board_.name(), "Overlapped acquisition readout failed");
+    std::lock_guard<std::mutex> lock{mutex_};
+    error_ = std::current_exception();
+    running_ = false;
+  }
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    faults_ = thread_page_faults() - start_faults;
+  }
+  cond_.notify_all();
+}
+
+template <class Board> size_t acquisition<Board>::acquire_free() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  auto find_free = [this]() {
+    for (size_t i{0}; i < N_BUFFERS; ++i) {
+      if (state_[i] == buffer_state::FREE) {
+        return i;
+      }
+    }
+    return N_BUFFERS;
+  };
+  size_t idx{find_free()};
+  if (idx == N_BUFFERS) {
+    ++n_stalls_;
+    cond_.wait(lock, [&] {
+      idx = find_free();
+      return idx < N_BUFFERS || !running_;
+    });
+  }
+  return running_ ? idx : N_BUFFERS;
+}
+}
+}
+}
+
+#endif
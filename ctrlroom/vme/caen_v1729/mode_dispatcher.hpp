@@ -0,0 +1,276 @@
+#ifndef CTRLROOM_VME_CAEN_V1729A_MODE_DISPATCHER_LOADED
+#define CTRLROOM_VME_CAEN_V1729A_MODE_DISPATCHER_LOADED
+
+#include <ctrlroom/vme/caen_v1729.hpp>
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/slave.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/configuration.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+namespace caen_v1729_impl {
+
+// benchmark result for a single VME mode
+struct mode_timing {
+  vme_mode mode;
+  bool ok;         // false if the mode does not work on this link
+  double pulse_us; // mean time to read a full pulse (in [us])
+  double mb_per_s; // corresponding throughput (in [MB/s])
+};
+
+// Runtime selection of the VME mode of a V1729(a) board.
+//
+// The supported modes (A24/D16/D16, A32/D32/D32 and A32/D32/MBLT) are
+// template parameters of the board, but which one is fastest depends on
+// the bridge and the link. The dispatcher instantiates the board for all
+// three modes, and creates it in the mode from the settings
+// (<id>.vmeMode), so the mode can be changed without rebuilding.
+//
+// The board is used through a visitor with a templated call operator,
+// called with the concrete board. The readout loop itself then runs on
+// the concrete board type, there is no dispatch per call.
+// Usage:
+//    struct daq {
+//      template <class Board> void operator()(Board& board) const {
+//        typename Board::buffer_type buf;
+//        while (...) {
+//          board.read_pulse(buf);
+//        }
+//      }
+//    };
+//    mode_dispatcher<caen_bridge, submodel::V1729A> adc{"adc", settings,
+//                                                       bridge, "calib"};
+//    adc.apply(daq{});
+//
+// benchmark() times a full pulse readout in all three modes on the
+// actual link (or on a simulated one, it works with any master), and
+// stores the fastest mode in the settings, so it is used by the next
+// dispatcher, and written out with the saved configuration. It should
+// run before the board is created (it reads the RAM_DATA FIFO).
+//
+// CONFIGURATION FILE OPTIONS:
+//      * the options of the V1729 board (cf. caen_v1729.hpp)
+// optional
+//      * VME mode: <id>.vmeMode (A24/D16/D16, A32/D32/D32 or
+//        A32/D32/MBLT, defaults to A32/D32/MBLT)
+//      * number of timed reads per mode: <id>.benchmarkRepeat
+//        (defaults to 20)
+// In A24 mode, the board decodes the lower 24 bits of <id>.address.
+template <class Master, submodel M> class mode_dispatcher {
+public:
+  constexpr static const char* VME_MODE_KEY{"vmeMode"};
+  constexpr static const char* BENCHMARK_REPEAT_KEY{"benchmarkRepeat"};
+
+  constexpr static size_t DEFAULT_BENCHMARK_REPEAT{20};
+
+  using master_type = Master;
+  using a24_d16_type = board<Master, M, addressing_mode::A24,
+                             transfer_mode::D16, transfer_mode::D16>;
+  using a32_d32_type = board<Master, M, addressing_mode::A32,
+                             transfer_mode::D32, transfer_mode::D32>;
+  using a32_mblt_type = board<Master, M, addressing_mode::A32,
+                              transfer_mode::D32, transfer_mode::MBLT>;
+
+  mode_dispatcher(const std::string& identifier, const ptree& settings,
+                  std::shared_ptr<master_type>& master,
+                  const std::string& calibration_path);
+
+  vme_mode mode() const { return mode_; }
+
+  // call <visitor> with the board (in the configured mode)
+  template <class Visitor> void apply(Visitor&& visitor);
+
+  // time the readout of <id>.benchmarkRepeat full pulses in all modes,
+  // store the fastest working mode in <settings> (<id>.vmeMode) and
+  // return the timings. Throws a vme::error if no mode works.
+  static std::vector<mode_timing>
+  benchmark(const std::string& identifier, ptree& settings,
+            std::shared_ptr<master_type>& master);
+
+private:
+  // <settings> with <id>.address reduced to the bits decoded in
+  // addressing mode <A> (the lower 24 bits for A24)
+  template <addressing_mode A>
+  static ptree mode_settings(const std::string& identifier,
+                             const ptree& settings);
+
+  template <addressing_mode A, transfer_mode DSingle, transfer_mode DBLT>
+  static mode_timing time_mode(const vme_mode mode,
+                               const std::string& identifier,
+                               const ptree& settings,
+                               std::shared_ptr<master_type>& master,
+                               const size_t n_repeat);
+
+  const vme_mode mode_;
+  std::unique_ptr<a24_d16_type> a24_d16_;
+  std::unique_ptr<a32_d32_type> a32_d32_;
+  std::unique_ptr<a32_mblt_type> a32_mblt_;
+};
+
+// name of <mode> in the settings
+inline std::string vme_mode_name(const vme_mode mode);
+}
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: mode_dispatcher
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+namespace caen_v1729_impl {
+
+template <class Master, submodel M>
+mode_dispatcher<Master, M>::mode_dispatcher(
+    const std::string& identifier, const ptree& settings,
+    std::shared_ptr<master_type>& master, const std::string& calibration_path)
+    : mode_{configuration{identifier, settings}
+                .get_optional(VME_MODE_KEY, VME_MODE_TRANSLATOR)
+                .get_value_or(vme_mode::A32_D32_MBLT)} {
+  LOG_INFO(identifier, "Using VME mode " + vme_mode_name(mode_));
+  switch (mode_) {
+  case vme_mode::A24_D16_D16:
+    a24_d16_.reset(new a24_d16_type{
+        identifier, mode_settings<addressing_mode::A24>(identifier, settings),
+        master, calibration_path});
+    break;
+  case vme_mode::A32_D32_D32:
+    a32_d32_.reset(
+        new a32_d32_type{identifier, settings, master, calibration_path});
+    break;
+  case vme_mode::A32_D32_MBLT:
+    a32_mblt_.reset(
+        new a32_mblt_type{identifier, settings, master, calibration_path});
+    break;
+  }
+}
+
+template <class Master, submodel M>
+template <class Visitor>
+void mode_dispatcher<Master, M>::apply(Visitor&& visitor) {
+  switch (mode_) {
+  case vme_mode::A24_D16_D16:
+    visitor(*a24_d16_);
+    break;
+  case vme_mode::A32_D32_D32:
+    visitor(*a32_d32_);
+    break;
+  case vme_mode::A32_D32_MBLT:
+    visitor(*a32_mblt_);
+    break;
+  }
+}
+
+template <class Master, submodel M>
+std::vector<mode_timing>
+mode_dispatcher<Master, M>::benchmark(const std::string& identifier,
+                                      ptree& settings,
+                                      std::shared_ptr<master_type>& master) {
+  const size_t n_repeat{
+      configuration{identifier, settings}
+          .get_optional<size_t>(BENCHMARK_REPEAT_KEY)
+          .get_value_or(static_cast<size_t>(DEFAULT_BENCHMARK_REPEAT))};
+  tassert(n_repeat > 0, "Invalid number of benchmark repetitions");
+  LOG_INFO(identifier, "Benchmarking the VME modes (" +
+                           std::to_string(n_repeat) + " pulses per mode)");
+  std::vector<mode_timing> timings;
+  timings.push_back(
+      time_mode<addressing_mode::A24, transfer_mode::D16, transfer_mode::D16>(
+          vme_mode::A24_D16_D16, identifier, settings, master, n_repeat));
+  timings.push_back(
+      time_mode<addressing_mode::A32, transfer_mode::D32, transfer_mode::D32>(
+          vme_mode::A32_D32_D32, identifier, settings, master, n_repeat));
+  timings.push_back(
+      time_mode<addressing_mode::A32, transfer_mode::D32, transfer_mode::MBLT>(
+          vme_mode::A32_D32_MBLT, identifier, settings, master, n_repeat));
+  const mode_timing* best{nullptr};
+  for (const auto& t : timings) {
+    if (t.ok && (!best || t.pulse_us < best->pulse_us)) {
+      best = &t;
+    }
+  }
+  if (!best) {
+    throw master->error("No working VME mode found for " + identifier);
+  }
+  settings.put(identifier + "." + VME_MODE_KEY, vme_mode_name(best->mode));
+  LOG_INFO(identifier, "Recommended VME mode: " + vme_mode_name(best->mode) +
+                           " (stored in " + identifier + "." +
+                           VME_MODE_KEY + ")");
+  return timings;
+}
+
+template <class Master, submodel M>
+template <addressing_mode A>
+ptree mode_dispatcher<Master, M>::mode_settings(const std::string& identifier,
+                                               const ptree& settings) {
+  ptree masked{settings};
+  if (A == addressing_mode::A24) {
+    const std::string key{identifier + "." + a24_d16_type::ADDRESS_KEY};
+    std::ostringstream address;
+    address << "0x" << std::hex
+            << (std::stoll(settings.get<std::string>(key), nullptr, 0) &
+                0xFFFFFF);
+    masked.put(key, address.str());
+  }
+  return masked;
+}
+
+template <class Master, submodel M>
+template <addressing_mode A, transfer_mode DSingle, transfer_mode DBLT>
+mode_timing mode_dispatcher<Master, M>::time_mode(
+    const vme_mode mode, const std::string& identifier, const ptree& settings,
+    std::shared_ptr<master_type>& master, const size_t n_repeat) {
+  using slave_type = slave<Master, A, DSingle, DBLT>;
+  using value_type = typename slave_type::blt_data_type;
+  slave_type b{identifier, mode_settings<A>(identifier, settings), master};
+  // a full memory readout (header and data)
+  transfer_vector<value_type> buf(properties::MEMORY_SIZE * sizeof(uint16_t) /
+                                  sizeof(value_type));
+  mode_timing t{mode, false, 0, 0};
+  try {
+    // the first read is not timed (cold caches, page faults, ...)
+    b.read_fifo(instructions<A>::RAM_DATA, buf);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i{0}; i < n_repeat; ++i) {
+      b.read_fifo(instructions<A>::RAM_DATA, buf);
+    }
+    const auto stop = std::chrono::steady_clock::now();
+    t.ok = true;
+    t.pulse_us = std::chrono::duration<double, std::micro>(stop - start)
+                     .count() /
+                 n_repeat;
+    t.mb_per_s = buf.size() * sizeof(value_type) / t.pulse_us;
+    LOG_INFO(identifier, vme_mode_name(mode) + ": " +
+                             std::to_string(t.pulse_us) + " us per pulse (" +
+                             std::to_string(t.mb_per_s) + " MB/s)");
+  } catch (vme::error& e) {
+    LOG_WARNING(identifier, vme_mode_name(mode) +
+                                " does not work on this link: " + e.what());
+  }
+  return t;
+}
+
+inline std::string vme_mode_name(const vme_mode mode) {
+  for (const auto& tr : VME_MODE_TRANSLATOR) {
+    if (tr.second == mode) {
+      return tr.first;
+    }
+  }
+  return "unknown";
+}
+}
+}
+}
+
+#endif
@@ -31,6 +31,11 @@ const translation_map<channel_multiplexing> CHANNEL_MULTIPLEXING_TRANSLATOR{
     {"quadruplex", channel_multiplexing::C_QUADRUPLEX}};
 
 const translation_map<uint8_t> BINARY_TRANSLATOR{{"false", 0}, {"true", 1}};
+
+const translation_map<vme_mode> VME_MODE_TRANSLATOR{
+    {"A24/D16/D16", vme_mode::A24_D16_D16},
+    {"A32/D32/D32", vme_mode::A32_D32_D32},
+    {"A32/D32/MBLT", vme_mode::A32_D32_MBLT}};
 }
 }
 }
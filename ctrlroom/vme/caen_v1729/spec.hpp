@@ -95,6 +95,11 @@ struct validate_mode {
                 "only A24/D16/D16, A32/D32/D32 and A32/D32/MBLT supported");
 };
 
+// the supported modes as a runtime value (cf. mode_dispatcher in
+// caen_v1729/mode_dispatcher.hpp)
+enum class vme_mode { A24_D16_D16, A32_D32_D32, A32_D32_MBLT };
+extern const translation_map<vme_mode> VME_MODE_TRANSLATOR;
+
 // instructions the V1729 knows over VME (see manual for explanation)
 template <addressing_mode A> struct instructions {
   using address_type = typename address_spec<A>::ptr_type;
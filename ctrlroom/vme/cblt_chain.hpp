@@ -0,0 +1,167 @@
+#ifndef CTRLROOM_VME_CBLT_CHAIN_LOADED
+#define CTRLROOM_VME_CBLT_CHAIN_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Chained block transfer (CBLT) readout of a chain of boards in a crate.
+//
+// All boards in the chain share a common CBLT address (A32), and are
+// configured as first/intermediate/last board of the chain (board
+// specific, the boards themselves have to take care of this). A single
+// chained transfer drains the data of all boards, and the last board
+// ends it with a bus error.
+//
+// The data is split per board by a splitter function for each board,
+// registered in chain order. A splitter gets the remaining data, and
+// returns the number of words that belong to its board (0 if the board
+// had no data, e.g. when it does not send an empty event).
+//
+// Usage:
+//    cblt_chain<master_type> chain{master, 0xAA000000, 64 * 1024};
+//    chain.add("adc0", adc_event_size);
+//    chain.add("adc1", adc_event_size);
+//    size_t n{chain.read()};
+//    for (size_t i{0}; i < chain.size(); ++i) {
+//      const auto& seg = chain.segment(i);
+//      // process seg.size words at seg.data
+//    }
+//
+// Data is read with A32 and D (D32 BLT or MBLT), and split in words of
+// type Word (the native word size of the boards).
+template <class Master, transfer_mode D = transfer_mode::MBLT,
+          class Word = uint32_t>
+class cblt_chain {
+public:
+  using master_type = Master;
+  using word_type = Word;
+  using address_type = address_spec<addressing_mode::A32>::ptr_type;
+  // returns the number of words at <data> (<n> available) that belong
+  // to this board
+  using splitter_type =
+      std::function<size_t(const word_type* data, size_t n)>;
+
+  static_assert(is_cblt<addressing_mode::A32, D>::value,
+                "CBLT is only defined for D32 BLT and MBLT");
+
+  // the data for a single board in the chain
+  struct segment_type {
+    const word_type* data;
+    size_t size; // in words
+  };
+
+  // <max_words>: maximum size of a chained readout (in words)
+  cblt_chain(std::shared_ptr<master_type> master, const address_type address,
+             const size_t max_words);
+
+  // add the next board in the chain
+  void add(const std::string& board_name, splitter_type splitter);
+  size_t size() const { return boards_.size(); }
+
+  // read out the entire chain, and split the data per board.
+  // Returns the total number of words read.
+  // Throws an error if the data cannot be attributed to the boards.
+  size_t read();
+
+  // data for board <i> from the last read()
+  const segment_type& segment(const size_t i) const { return segments_[i]; }
+  const std::string& board_name(const size_t i) const {
+    return boards_[i].name;
+  }
+
+private:
+  void split(const size_t n_words);
+
+  struct board_type {
+    std::string name;
+    splitter_type splitter;
+  };
+
+  std::shared_ptr<master_type> master_;
+  const address_type address_;
+  std::vector<word_type> buffer_;
+  std::vector<board_type> boards_;
+  std::vector<segment_type> segments_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: cblt_chain
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Master, transfer_mode D, class Word>
+cblt_chain<Master, D, Word>::cblt_chain(std::shared_ptr<master_type> master,
+                                        const address_type address,
+                                        const size_t max_words)
+    : master_{std::move(master)}
+    , address_{address}
+    // round up to full D words
+    , buffer_((max_words * sizeof(word_type) + transfer_spec<D>::WIDTH - 1) /
+                  transfer_spec<D>::WIDTH * transfer_spec<D>::WIDTH /
+                  sizeof(word_type)) {
+  tassert(master_, "Invalid pointer to master module");
+  tassert(max_words > 0, "Invalid CBLT buffer size");
+}
+
+template <class Master, transfer_mode D, class Word>
+void cblt_chain<Master, D, Word>::add(const std::string& board_name,
+                                      splitter_type splitter) {
+  tassert(splitter, "Invalid CBLT splitter for " + board_name);
+  boards_.push_back({board_name, std::move(splitter)});
+  segments_.push_back({nullptr, 0});
+}
+
+template <class Master, transfer_mode D, class Word>
+size_t cblt_chain<Master, D, Word>::read() {
+  const size_t n_words{master_->template read_chained<addressing_mode::A32, D>(
+      address_, buffer_.data(), buffer_.size())};
+  if (n_words == buffer_.size()) {
+    LOG_WARNING(master_->name(),
+                "CBLT buffer full, chain data might be truncated");
+  }
+  split(n_words);
+  return n_words;
+}
+
+template <class Master, transfer_mode D, class Word>
+void cblt_chain<Master, D, Word>::split(const size_t n_words) {
+  size_t offset{0};
+  for (size_t i{0}; i < boards_.size(); ++i) {
+    const size_t n_left{n_words - offset};
+    const size_t n{boards_[i].splitter(buffer_.data() + offset, n_left)};
+    if (n > n_left) {
+      throw master_->error("CBLT data for " + boards_[i].name +
+                           " exceeds the chain data");
+    }
+    segments_[i] = {buffer_.data() + offset, n};
+    offset += n;
+  }
+  // leftover data is only allowed as padding to a full D word
+  // (e.g. a single 32-bit word for MBLT)
+  if (n_words > offset &&
+      n_words - offset >= transfer_spec<D>::WIDTH / sizeof(word_type)) {
+    throw master_->error("CBLT data for " + std::to_string(n_words - offset) +
+                         " words could not be attributed to a board");
+  }
+}
+}
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "crate_scanner.hpp"
+
+#include <sstream>
+
+namespace ctrlroom {
+namespace vme {
+const translation_map<board_kind> BOARD_KIND_TRANSLATOR{
+    {"VME64x", board_kind::VME64X},
+    {"V895", board_kind::V895},
+    {"V812", board_kind::V812},
+    {"V1729", board_kind::V1729},
+    {"unknown", board_kind::UNKNOWN}};
+
+std::string describe(const found_board& b) {
+  std::ostringstream os;
+  for (const auto& tr : BOARD_KIND_TRANSLATOR) {
+    if (tr.second == b.kind) {
+      os << tr.first;
+    }
+  }
+  os << std::hex << std::showbase;
+  switch (b.kind) {
+  case board_kind::VME64X:
+    os << " in slot " << std::dec << b.slot << std::hex << " (CR/CSR "
+       << b.address << ", manufacturer " << b.manufacturer << ", board "
+       << b.board_id << ", revision " << b.revision << ")";
+    break;
+  case board_kind::V895:
+  case board_kind::V812:
+    os << " at " << b.address << " (version " << std::dec << b.revision
+       << ", serial " << b.serial << ")";
+    break;
+  case board_kind::V1729:
+    os << " at " << b.address << " (FPGA version " << b.revision << ")";
+    break;
+  case board_kind::UNKNOWN:
+    os << " board at " << b.address;
+    break;
+  }
+  os << (b.addressing == addressing_mode::A24 ? " [A24]" : " [A32]");
+  return os.str();
+}
+}
+}
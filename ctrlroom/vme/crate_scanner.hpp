@@ -0,0 +1,416 @@
+#ifndef CTRLROOM_VME_CRATE_SCANNER_LOADED
+#define CTRLROOM_VME_CRATE_SCANNER_LOADED
+
+#include <ctrlroom/vme/caen_discriminator/spec.hpp>
+#include <ctrlroom/vme/caen_v1729/spec.hpp>
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/configuration.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// what was found at a probed address
+enum class board_kind {
+  VME64X,  // CR/CSR space of a geographic slot
+  V895,    // CAEN V895 discriminator
+  V812,    // CAEN V812 discriminator
+  V1729,   // CAEN V1729(a) (answers on its FPGA_VERSION register)
+  UNKNOWN  // something answered, but was not identified
+};
+// board kind translator is defined in crate_scanner.cpp
+extern const translation_map<board_kind> BOARD_KIND_TRANSLATOR;
+
+// a board found by the crate_scanner
+//  * VME64X: slot, CR/CSR base address (A24, AM 0x2F), manufacturer
+//    (IEEE OUI), board ID and revision from the configuration ROM
+//  * V895/V812: base address, manufacturer, module type, version and
+//    serial number from the module identifier words
+//  * V1729: base address, FPGA version in <revision>
+//  * UNKNOWN: base address
+struct found_board {
+  board_kind kind;
+  addressing_mode addressing;
+  uint32_t address;
+  unsigned slot; // only for VME64X
+  uint32_t manufacturer;
+  uint32_t board_id;
+  uint32_t revision;
+  uint32_t serial;
+};
+// one line description of <b> (for logging)
+std::string describe(const found_board& b);
+
+// Discovery of the boards in a crate, without knowing their addresses.
+//
+// Probes
+//  * the CR/CSR space (AM 0x2F) of all 21 geographic slots, for the
+//    "CR" signature of VME64x boards
+//  * every <step> in the configured address ranges (A24 or A32), for
+//    the identifier words of the CAEN discriminators and the FPGA
+//    version register of the V1729
+// All probes are single cycles in a single batch (a single MultiRead
+// call on the CAEN bridges), and the boards that answer are identified
+// with a second batch. Bus errors on empty slots and addresses are
+// reported per cycle, nothing throws on an empty crate. (Communication
+// problems affecting the whole batch are still thrown by the master.)
+//
+// The V1729 has no identifier register: a base address is reported as
+// a V1729 if it is not a discriminator but answers on FPGA_VERSION.
+//
+// Usage:
+//    crate_scanner<caen_bridge> scanner{bridge};
+//    scanner.load(bridge->conf());
+//    for (const auto& b : scanner.scan()) {
+//      ...
+//    }
+//
+// CONFIGURATION FILE OPTIONS (for load(), relative to the configuration
+// <conf> it is called with):
+// optional
+//      * probe the geographic slots: <id>.scan.slots (defaults to true)
+//      * address ranges: <id>.scan.list ([name0, name1, ...])
+//      * for each range <name>:
+//        * addressing mode: <id>.scan.<name>.addressing (A24 or A32)
+//        * first address: <id>.scan.<name>.start (e.g. "0xAA000000")
+//        * last address: <id>.scan.<name>.stop (inclusive)
+//        * step: <id>.scan.<name>.step (defaults to 0x10000)
+template <class Master> class crate_scanner {
+public:
+  constexpr static const char* SCAN_KEY{"scan"};
+  constexpr static const char* SLOTS_KEY{"slots"};
+  constexpr static const char* LIST_KEY{"list"};
+  constexpr static const char* ADDRESSING_KEY{"addressing"};
+  constexpr static const char* START_KEY{"start"};
+  constexpr static const char* STOP_KEY{"stop"};
+  constexpr static const char* STEP_KEY{"step"};
+
+  constexpr static unsigned N_SLOTS{21};
+  constexpr static uint32_t DEFAULT_STEP{0x10000};
+
+  using master_type = Master;
+
+  explicit crate_scanner(std::shared_ptr<master_type> master);
+
+  // enable/disable the CR/CSR probes of the geographic slots
+  void scan_slots(const bool enable) { slots_ = enable; }
+  // probe every <step> from <start> to <stop> (inclusive), A24 or A32
+  void add_range(const addressing_mode A, const uint32_t start,
+                 const uint32_t stop, const uint32_t step = DEFAULT_STEP);
+  // set up the probes configured in <conf> (cf. CONFIGURATION FILE
+  // OPTIONS)
+  void load(const configuration& conf);
+
+  // number of probe cycles of a scan (first batch)
+  size_t n_probes() const;
+
+  // probe the crate, and return the boards found
+  // (slots first, then the ranges in the order they were added)
+  std::vector<found_board> scan();
+  // duration of the last scan (in [ms])
+  double duration_ms() const { return duration_ms_; }
+
+private:
+  struct range_type {
+    addressing_mode addressing;
+    uint32_t start;
+    uint32_t stop;
+    uint32_t step;
+  };
+  // a probed address, with the results of both batches
+  struct probe_type {
+    found_board board;
+    std::vector<uint32_t> values;
+  };
+  using batch_type = typename master_type::batch_type;
+
+  void probe_slots(std::vector<probe_type>& probes, batch_type& batch) const;
+  void probe_ranges(std::vector<probe_type>& probes, batch_type& batch) const;
+  void identify_slot(probe_type& p, batch_type& batch) const;
+  void identify_base(probe_type& p, batch_type& batch) const;
+
+  std::shared_ptr<master_type> master_;
+  bool slots_;
+  std::vector<range_type> ranges_;
+  double duration_ms_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: crate_scanner
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+namespace crate_scanner_impl {
+// CR/CSR space (VME64x): the slot number is in the upper 5 bits of the
+// 24-bit CR/CSR address, the configuration ROM uses every 4th byte
+constexpr uint32_t SLOT_SHIFT{19};
+constexpr uint32_t CR_SIGNATURE_C{0x1F};
+constexpr uint32_t CR_SIGNATURE_R{0x23};
+constexpr uint32_t CR_MANUFACTURER{0x27}; // 3 bytes
+constexpr uint32_t CR_BOARD_ID{0x33};     // 4 bytes
+constexpr uint32_t CR_REVISION{0x43};     // 4 bytes
+constexpr uint32_t CR_STRIDE{4};
+// combine the <n> CR bytes in <values>, starting at <first>
+inline uint32_t cr_value(const std::vector<uint32_t>& values,
+                         const size_t first, const size_t n) {
+  uint32_t val{0};
+  for (size_t i{first}; i < first + n; ++i) {
+    val = (val << 8) | (values[i] & 0xFF);
+  }
+  return val;
+}
+}
+
+template <class Master>
+crate_scanner<Master>::crate_scanner(std::shared_ptr<master_type> master)
+    : master_{std::move(master)}, slots_{true}, duration_ms_{0} {
+  tassert(master_, "Invalid pointer to master module");
+}
+
+template <class Master>
+void crate_scanner<Master>::add_range(const addressing_mode A,
+                                      const uint32_t start,
+                                      const uint32_t stop,
+                                      const uint32_t step) {
+  if (A != addressing_mode::A24 && A != addressing_mode::A32) {
+    throw master_->invalid_parameter(
+        "Crate scans only support A24 and A32 address ranges");
+  }
+  if (step == 0 || stop < start ||
+      (A == addressing_mode::A24 && stop > 0xFFFFFF)) {
+    throw master_->invalid_parameter("Invalid crate scan range");
+  }
+  ranges_.push_back({A, start, stop, step});
+}
+
+template <class Master>
+void crate_scanner<Master>::load(const configuration& conf) {
+  const std::string root{std::string(SCAN_KEY) + "."};
+  slots_ = conf.get_optional<bool>(root + SLOTS_KEY).get_value_or(slots_);
+  const auto names = conf.get_optional_vector<std::string>(root + LIST_KEY);
+  if (!names) {
+    return;
+  }
+  for (const auto& name : *names) {
+    const std::string key{root + name + "."};
+    const addressing_mode A{
+        conf.get(key + ADDRESSING_KEY, ADDRESSING_MODE_TRANSLATOR)};
+    const uint32_t start{static_cast<uint32_t>(
+        std::stoll(conf.get<std::string>(key + START_KEY), nullptr, 0))};
+    const uint32_t stop{static_cast<uint32_t>(
+        std::stoll(conf.get<std::string>(key + STOP_KEY), nullptr, 0))};
+    const auto step_str = conf.get_optional<std::string>(key + STEP_KEY);
+    const uint32_t step{
+        step_str ? static_cast<uint32_t>(std::stoll(*step_str, nullptr, 0))
+                 : static_cast<uint32_t>(DEFAULT_STEP)};
+    if (A != addressing_mode::A24 && A != addressing_mode::A32) {
+      throw conf.value_error(key + ADDRESSING_KEY,
+                             conf.get<std::string>(key + ADDRESSING_KEY));
+    }
+    if (step == 0) {
+      throw conf.value_error(key + STEP_KEY, *step_str);
+    }
+    add_range(A, start, stop, step);
+  }
+}
+
+template <class Master> size_t crate_scanner<Master>::n_probes() const {
+  // 2 signature bytes per slot, 2 registers per base address
+  size_t n{slots_ ? 2 * N_SLOTS : 0};
+  for (const auto& r : ranges_) {
+    n += 2 * ((static_cast<uint64_t>(r.stop) - r.start) / r.step + 1);
+  }
+  return n;
+}
+
+template <class Master> std::vector<found_board> crate_scanner<Master>::scan() {
+  const auto start = std::chrono::steady_clock::now();
+  // first batch: is anything there?
+  // (the batch keeps references to the probe values, these stay valid
+  // when <probes> grows)
+  std::vector<probe_type> probes;
+  batch_type batch{master_->batch()};
+  probe_slots(probes, batch);
+  probe_ranges(probes, batch);
+  batch.submit();
+  // second batch: identify whatever answered
+  std::vector<probe_type> found;
+  for (size_t i{0}, cycle{0}; i < probes.size(); ++i) {
+    auto& p = probes[i];
+    const bool slot{p.board.kind == board_kind::VME64X};
+    const bool answered{
+        slot ? (batch.cycle_status(cycle) == vme::status::SUCCESS &&
+                batch.cycle_status(cycle + 1) == vme::status::SUCCESS &&
+                (p.values[0] & 0xFF) == 'C' && (p.values[1] & 0xFF) == 'R')
+             : (batch.cycle_status(cycle) == vme::status::SUCCESS ||
+                batch.cycle_status(cycle + 1) == vme::status::SUCCESS)};
+    if (answered) {
+      // a base address answering on FPGA_VERSION is a V1729, unless it
+      // turns out to be a discriminator
+      if (!slot && batch.cycle_status(cycle + 1) == vme::status::SUCCESS) {
+        p.board.kind = board_kind::V1729;
+      }
+      found.push_back(std::move(p));
+    }
+    cycle += 2;
+  }
+  std::vector<found_board> boards;
+  if (!found.empty()) {
+    batch.clear();
+    for (auto& p : found) {
+      if (p.board.kind == board_kind::VME64X) {
+        identify_slot(p, batch);
+      } else {
+        identify_base(p, batch);
+      }
+    }
+    batch.submit();
+    for (auto& p : found) {
+      auto& b = p.board;
+      if (b.kind == board_kind::VME64X) {
+        using namespace crate_scanner_impl;
+        b.manufacturer = cr_value(p.values, 2, 3);
+        b.board_id = cr_value(p.values, 5, 4);
+        b.revision = cr_value(p.values, 9, 4);
+      } else {
+        using discriminator = caen_discriminator_impl::properties;
+        using v895 =
+            caen_discriminator_impl::extra_properties<
+                caen_discriminator_impl::submodel::V895>;
+        using v812 =
+            caen_discriminator_impl::extra_properties<
+                caen_discriminator_impl::submodel::V812>;
+        // values: FIXED_CODE, FPGA_VERSION, MODEL_TYPE, SERIAL
+        const uint32_t fpga_version{p.values[1]};
+        const uint32_t model_type{p.values[2]};
+        const uint32_t serial{p.values[3]};
+        const bool fpga_answered{b.kind == board_kind::V1729};
+        if (p.values[0] == discriminator::FIXED_CODE) {
+          b.manufacturer = model_type >> 10;
+          b.board_id = model_type & 0x3FF;
+          b.revision = serial >> 12;
+          b.serial = serial & 0xFFF;
+          b.kind = board_kind::UNKNOWN;
+          if (b.manufacturer == discriminator::MANUFACTURER) {
+            if (b.board_id == v895::MODULE_TYPE) {
+              b.kind = board_kind::V895;
+            } else if (b.board_id == v812::MODULE_TYPE) {
+              b.kind = board_kind::V812;
+            }
+          }
+        } else if (fpga_answered) {
+          b.kind = board_kind::V1729;
+          b.revision = fpga_version;
+        }
+      }
+      boards.push_back(b);
+    }
+  }
+  duration_ms_ = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  for (const auto& b : boards) {
+    LOG_INFO(master_->name(), "Found " + describe(b));
+  }
+  LOG_INFO(master_->name(),
+           "Crate scan: " + std::to_string(boards.size()) + " boards in " +
+               std::to_string(n_probes()) + " probes (" +
+               std::to_string(duration_ms_) + " ms)");
+  return boards;
+}
+
+template <class Master>
+void crate_scanner<Master>::probe_slots(std::vector<probe_type>& probes,
+                                        batch_type& batch) const {
+  if (!slots_) {
+    return;
+  }
+  using namespace crate_scanner_impl;
+  const uint32_t am{address_spec<addressing_mode::A24>::CS_CSR};
+  for (unsigned slot{1}; slot <= N_SLOTS; ++slot) {
+    const uint32_t base{slot << SLOT_SHIFT};
+    // values: 2 signature, 3 manufacturer, 4 board ID and 4 revision
+    // bytes
+    probes.push_back({{board_kind::VME64X, addressing_mode::A24, base, slot,
+                       0, 0, 0, 0},
+                      std::vector<uint32_t>(13, 0)});
+    auto& p = probes.back();
+    batch.read(base + CR_SIGNATURE_C, am, 1, p.values[0]);
+    batch.read(base + CR_SIGNATURE_R, am, 1, p.values[1]);
+  }
+}
+
+template <class Master>
+void crate_scanner<Master>::probe_ranges(std::vector<probe_type>& probes,
+                                         batch_type& batch) const {
+  using discriminator = caen_discriminator_impl::instructions<
+      addressing_mode::A32>;
+  using v1729 = caen_v1729_impl::instructions<addressing_mode::A32>;
+  for (const auto& r : ranges_) {
+    const bool a24{r.addressing == addressing_mode::A24};
+    const uint32_t am{a24 ? address_spec<addressing_mode::A24>::DATA
+                          : address_spec<addressing_mode::A32>::DATA};
+    for (uint64_t base{r.start}; base <= r.stop; base += r.step) {
+      // values: FIXED_CODE, FPGA_VERSION, MODEL_TYPE, SERIAL
+      probes.push_back({{board_kind::UNKNOWN, r.addressing,
+                         static_cast<uint32_t>(base), 0, 0, 0, 0, 0},
+                        std::vector<uint32_t>(4, 0)});
+      auto& p = probes.back();
+      // the discriminators are D16 only, the V1729 is D16 in A24 and
+      // D32 in A32 mode
+      batch.read(p.board.address + discriminator::FIXED_CODE, am, 2,
+                 p.values[0]);
+      batch.read(p.board.address + v1729::FPGA_VERSION, am, a24 ? 2 : 4,
+                 p.values[1]);
+    }
+  }
+}
+
+template <class Master>
+void crate_scanner<Master>::identify_slot(probe_type& p,
+                                          batch_type& batch) const {
+  using namespace crate_scanner_impl;
+  const uint32_t am{address_spec<addressing_mode::A24>::CS_CSR};
+  for (size_t i{0}; i < 3; ++i) {
+    batch.read(p.board.address + CR_MANUFACTURER + i * CR_STRIDE, am, 1,
+               p.values[2 + i]);
+  }
+  for (size_t i{0}; i < 4; ++i) {
+    batch.read(p.board.address + CR_BOARD_ID + i * CR_STRIDE, am, 1,
+               p.values[5 + i]);
+    batch.read(p.board.address + CR_REVISION + i * CR_STRIDE, am, 1,
+               p.values[9 + i]);
+  }
+}
+
+template <class Master>
+void crate_scanner<Master>::identify_base(probe_type& p,
+                                          batch_type& batch) const {
+  using discriminator = caen_discriminator_impl::instructions<
+      addressing_mode::A32>;
+  if (p.values[0] != caen_discriminator_impl::properties::FIXED_CODE) {
+    return;
+  }
+  const uint32_t am{p.board.addressing == addressing_mode::A24
+                        ? address_spec<addressing_mode::A24>::DATA
+                        : address_spec<addressing_mode::A32>::DATA};
+  batch.read(p.board.address + discriminator::MODEL_TYPE, am, 2,
+             p.values[2]);
+  batch.read(p.board.address + discriminator::SERIAL, am, 2, p.values[3]);
+}
+}
+}
+
+#endif
@@ -0,0 +1,226 @@
+#ifndef CTRLROOM_VME_IRQ_DISPATCHER_LOADED
+#define CTRLROOM_VME_IRQ_DISPATCHER_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// IACK-vector based IRQ dispatcher for multiple slaves sharing the IRQ
+// lines of a single master.
+//
+// Handlers are registered per (IRQ level, status/ID vector). After an IRQ,
+// the dispatcher checks which lines are asserted, and runs an IACK cycle
+// on each of them (highest level first) to find out which slave fired.
+// Only the handler for that slave is called. As long as the line stays
+// asserted (other slaves waiting to be acknowledged), the IACK is
+// repeated.
+//
+// Slaves that cannot supply a vector can be registered for an entire
+// level, their handler is called whenever the line is asserted
+// (without IACK cycle).
+//
+// Usage:
+//    irq_dispatcher<master_type> irq{master};
+//    irq.add(irq_level::IRQ3, 0x10, [&](irq_level, uint32_t) {
+//      board1.read_pulse(buf1);
+//    });
+//    irq.add(irq_level::IRQ3, 0x11, [&](irq_level, uint32_t) {
+//      board2.read_pulse(buf2);
+//    });
+//    while (running) {
+//      irq.dispatch();
+//    }
+//
+// The status/ID is read with data width D (D08_EO, D16 or D32).
+template <class Master, transfer_mode D = transfer_mode::D08_EO>
+class irq_dispatcher {
+public:
+  using master_type = Master;
+  // status/ID as read by the IACK cycle
+  using vector_type = typename transfer_spec<D>::value_type;
+  // handler, called with the level and the status/ID vector
+  // (vector is 0 for level handlers)
+  using handler_type = std::function<void(irq_level, uint32_t)>;
+
+  constexpr static size_t N_LEVELS{7};
+
+  irq_dispatcher(std::shared_ptr<master_type> master);
+
+  // register a handler for <vector> on <level>
+  // (vectors are unsigned, e.g. 0x00-0xFF for D08_EO)
+  void add(const irq_level level, const uint32_t vector,
+           handler_type handler);
+  // register a handler for all IRQs on <level> (no IACK cycle)
+  void add(const irq_level level, handler_type handler);
+  // remove all handlers
+  void clear();
+
+  // wait for the next IRQ and dispatch it (default timeout of the master,
+  // or <timeout> in [ms]). A vme::timeout_error is thrown if no IRQ
+  // arrived. Returns the number of handlers that were called.
+  size_t dispatch() const;
+  size_t dispatch(const size_t timeout) const;
+  // dispatch the currently pending IRQs without waiting
+  size_t poll() const;
+
+  // number of acknowledged IRQs with a vector that has no handler
+  size_t n_unknown() const { return n_unknown_; }
+
+private:
+  static size_t level_index(const irq_level level) {
+    size_t idx{0};
+    for (auto mask = static_cast<uint8_t>(level); mask > 1; mask >>= 1) {
+      ++idx;
+    }
+    return idx;
+  }
+  static irq_level index_level(const size_t idx) {
+    return static_cast<irq_level>(1 << idx);
+  }
+  // the status/ID as unsigned value of the proper width
+  static uint32_t unsigned_vector(const vector_type vector) {
+    return static_cast<typename std::make_unsigned<vector_type>::type>(
+        vector);
+  }
+
+  // dispatch all IRQs on <level> that are still asserted
+  size_t dispatch_level(const size_t idx) const;
+
+  std::shared_ptr<master_type> master_;
+  // vector handlers and level handlers for each IRQ level
+  std::array<std::map<uint32_t, handler_type>, N_LEVELS> vector_handlers_;
+  std::array<std::vector<handler_type>, N_LEVELS> level_handlers_;
+  // only look at the registered levels
+  uint8_t mask_;
+  mutable size_t n_unknown_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: irq_dispatcher
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Master, transfer_mode D>
+irq_dispatcher<Master, D>::irq_dispatcher(std::shared_ptr<master_type> master)
+    : master_{std::move(master)}, mask_{0}, n_unknown_{0} {
+  tassert(master_, "Invalid pointer to master module");
+}
+
+template <class Master, transfer_mode D>
+void irq_dispatcher<Master, D>::add(const irq_level level,
+                                    const uint32_t vector,
+                                    handler_type handler) {
+  tassert(handler, "Invalid IRQ handler");
+  if (vector != unsigned_vector(static_cast<vector_type>(vector))) {
+    throw master_->invalid_parameter("IRQ vector " + std::to_string(vector) +
+                                     " too wide for IACK data width");
+  }
+  const size_t idx{level_index(level)};
+  if (vector_handlers_[idx].count(vector)) {
+    throw master_->invalid_parameter(
+        "IRQ vector " + std::to_string(vector) + " on IRQ" +
+        std::to_string(idx + 1) + " already has a handler");
+  }
+  vector_handlers_[idx][vector] = std::move(handler);
+  mask_ |= static_cast<uint8_t>(level);
+}
+template <class Master, transfer_mode D>
+void irq_dispatcher<Master, D>::add(const irq_level level,
+                                    handler_type handler) {
+  tassert(handler, "Invalid IRQ handler");
+  level_handlers_[level_index(level)].push_back(std::move(handler));
+  mask_ |= static_cast<uint8_t>(level);
+}
+template <class Master, transfer_mode D>
+void irq_dispatcher<Master, D>::clear() {
+  for (auto& h : vector_handlers_) {
+    h.clear();
+  }
+  for (auto& h : level_handlers_) {
+    h.clear();
+  }
+  mask_ = 0;
+}
+
+template <class Master, transfer_mode D>
+size_t irq_dispatcher<Master, D>::dispatch() const {
+  master_->wait_for_irq();
+  return poll();
+}
+template <class Master, transfer_mode D>
+size_t irq_dispatcher<Master, D>::dispatch(const size_t timeout) const {
+  master_->wait_for_irq(timeout);
+  return poll();
+}
+
+template <class Master, transfer_mode D>
+size_t irq_dispatcher<Master, D>::poll() const {
+  const uint8_t pending{
+      static_cast<uint8_t>(master_->pending_irqs() & mask_)};
+  size_t n_handled{0};
+  // highest priority first
+  for (size_t idx{N_LEVELS}; idx-- > 0;) {
+    if (pending & static_cast<uint8_t>(index_level(idx))) {
+      n_handled += dispatch_level(idx);
+    }
+  }
+  return n_handled;
+}
+
+template <class Master, transfer_mode D>
+size_t irq_dispatcher<Master, D>::dispatch_level(const size_t idx) const {
+  const irq_level level{index_level(idx)};
+  size_t n_handled{0};
+  for (const auto& handler : level_handlers_[idx]) {
+    handler(level, 0);
+    ++n_handled;
+  }
+  const auto& handlers = vector_handlers_[idx];
+  if (handlers.empty()) {
+    return n_handled;
+  }
+  // every registered interrupter on this level gets acknowledged at most
+  // once, as long as the line is still asserted
+  for (size_t i{0}; i < handlers.size(); ++i) {
+    if (i > 0 &&
+        !(master_->pending_irqs() & static_cast<uint8_t>(level))) {
+      break;
+    }
+    const uint32_t vector{
+        unsigned_vector(master_->template acknowledge_irq<D>(level))};
+    auto it = handlers.find(vector);
+    if (it == handlers.end()) {
+      ++n_unknown_;
+      LOG_WARNING(master_->name(),
+                  "Unknown IRQ vector " + std::to_string(vector) + " on IRQ" +
+                      std::to_string(idx + 1));
+      continue;
+    }
+    it->second(level, vector);
+    ++n_handled;
+  }
+  return n_handled;
+}
+}
+}
+
+#endif
@@ -9,6 +9,21 @@ const translation_map<irq_level> IRQ_TRANSLATOR{{"IRQ1", irq_level::IRQ1},
                                                 {"IRQ5", irq_level::IRQ5},
                                                 {"IRQ6", irq_level::IRQ6},
                                                 {"IRQ7", irq_level::IRQ7}};
+const translation_map<addressing_mode> ADDRESSING_MODE_TRANSLATOR{
+    {"A16", addressing_mode::A16},
+    {"A24", addressing_mode::A24},
+    {"A32", addressing_mode::A32},
+    {"A40", addressing_mode::A40},
+    {"A64", addressing_mode::A64}};
+const translation_map<transfer_mode> TRANSFER_MODE_TRANSLATOR{
+    {"D08_O", transfer_mode::D08_O},
+    {"D08_EO", transfer_mode::D08_EO},
+    {"D16", transfer_mode::D16},
+    {"D32", transfer_mode::D32},
+    {"MD32", transfer_mode::MD32},
+    {"MBLT", transfer_mode::MBLT},
+    {"U3_2eVME", transfer_mode::U3_2eVME},
+    {"U6_2eVME", transfer_mode::U6_2eVME}};
 }
 };
 
@@ -41,3 +56,17 @@ timeout_error::timeout_error(const std::string& board_name,
                              const std::string& msg)
     : vme::error{board_name, link_index, board_index, msg,
                  "vme::timeout_error"} {}
+
+status ctrlroom::vme::error_status(const error& e) {
+  if (dynamic_cast<const bus_error*>(&e)) {
+    return status::BUS_ERROR;
+  } else if (dynamic_cast<const comm_error*>(&e)) {
+    return status::COMM_ERROR;
+  } else if (dynamic_cast<const invalid_parameter*>(&e)) {
+    return status::INVALID_PARAMETER;
+  } else if (dynamic_cast<const timeout_error*>(&e)) {
+    return status::TIMEOUT_ERROR;
+  }
+  // default:
+  return status::GENERIC_ERROR;
+}
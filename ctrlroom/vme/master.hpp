@@ -4,16 +4,23 @@
 #include <ctrlroom/board.hpp>
 #include <ctrlroom/vme/vme64.hpp>
 #include <ctrlroom/vme/master/block_transfer.hpp>
+#include <ctrlroom/vme/master/batch.hpp>
+#include <ctrlroom/vme/master/memory.hpp>
+#include <ctrlroom/vme/master/scheduler.hpp>
+#include <ctrlroom/vme/master/stats.hpp>
+#include <ctrlroom/vme/master/status.hpp>
 #include <ctrlroom/util/logger.hpp>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 // TODO:
-//  * implement IRQs
-//  * implement RMW cycle
 //  * implement ADO cycle
 //  * implement lock and/or ADOH cycle
-//  * design/implement FIFO block transfer support
 
 // call VME_FRIEND_MASTER(master_type) from within classes that implement tha
 // master interface to properly give the generic master
@@ -39,23 +46,46 @@ class timeout_error;
 // CRTP to work, as the explicit read/write/... calls themselves are not part
 // of the external interface (the generic read/write functions defined below
 // are).
+// All VME cycles (and link probes) are run through a cycle_scheduler,
+// so a single master can be shared by multiple threads. The priority
+// of the calls is set per thread with a priority_guard
+// (cf. master/scheduler.hpp). IRQ waits are not scheduled, as they do
+// not occupy the bus.
 // CONFIGURATION FILE OPTIONS:
 //      * Link index: <identifier>.linkIndex (cf. LINK_INDEX_KEY)
 //      * board index: <identifier>.boardIndex (cf. BOARD_INDEX_KEY)
 //      * IRQ: <identifier>.IRQ ([IRQ1, IRQ2], ...)
 // optional
 //      * TIMEOUT (in [ms]): <id>.timeout (defaults to 1000)
+//      * MBLT block length (in 64-bit words): <id>.mbltBlockLength
+//        (defaults to transfer_spec<MBLT>::BLOCK_LENGTH)
+//      * Link probe interval (in [ms]): <id>.linkProbeInterval
+//        (defaults to 0, i.e. no periodic link probes)
+//      * Transfer memory policy (cf. master/memory.hpp, process wide,
+//        set by the first master with any of these options, all other
+//        masters should have the same (or no) memory settings):
+//        * huge pages: <id>.hugePages (defaults to false)
+//        * lock in memory: <id>.lockMemory (defaults to false)
+//        * prefault: <id>.prefaultMemory (defaults to true)
 template <class MasterImpl> class master : public board {
 public:
   constexpr static const char* LINK_INDEX_KEY{"linkIndex"};
   constexpr static const char* BOARD_INDEX_KEY{"boardIndex"};
   constexpr static const char* IRQ_KEY{"IRQ"};
   constexpr static const char* TIMEOUT_KEY{"timeout"};
+  constexpr static const char* MBLT_BLOCK_LENGTH_KEY{"mbltBlockLength"};
+  constexpr static const char* LINK_PROBE_INTERVAL_KEY{"linkProbeInterval"};
+  constexpr static const char* HUGE_PAGES_KEY{"hugePages"};
+  constexpr static const char* LOCK_MEMORY_KEY{"lockMemory"};
+  constexpr static const char* PREFAULT_MEMORY_KEY{"prefaultMemory"};
 
   constexpr static size_t DEFAULT_TIMEOUT{1000}; // in [ms]
+  // maximum number of RMW cycles for a single modify()
+  constexpr static size_t MAX_RMW_CYCLES{8};
 
   using base_type = board;
   using master_type = MasterImpl;
+  using batch_type = cycle_batch<master>;
 
   master(const std::string& identifier, const ptree& settings);
   ~master();
@@ -67,6 +97,18 @@ public:
   // timeout is the configured value (<id>.timeout), unless explicitly
   // specified. This is only for expert usage.
   void wait_for_irq(size_t timeout) const;
+  // bit mask of the IRQ lines that are currently asserted
+  // (cf. irq_level, includes lines that are not in <id>.IRQ)
+  uint8_t pending_irqs() const;
+  // run an interrupt acknowledge (IACK) cycle for <level>,
+  // and return the status/ID (vector) supplied by the interrupter.
+  // Data width D08_EO, D16 or D32, depending on the interrupters.
+  // Cf. irq_dispatcher.hpp to dispatch IRQs to the right slave.
+  template <transfer_mode D = transfer_mode::D08_EO>
+  typename transfer_spec<D>::value_type
+  acknowledge_irq(const irq_level level) const;
+  // the configured IRQ levels (<id>.IRQ)
+  const std::vector<irq_level>& irq_levels() const { return irq_; }
 
   // READ a single value from <address> to <val> for transfer mode
   // D08_*, D16 or D32
@@ -81,9 +123,20 @@ public:
   // Returns the number of transaction Nt, where 0 <= Nt <= N.
   // Nt should be equal to N except when too many transactions
   // were requested. This case should be handled by the caller.
+  // Short block transfers are resumed where they stopped, until
+  // either N is reached or the slave stops returning data.
   template <addressing_mode A, transfer_mode D, class IntType, size_t N>
   size_t read(const typename address_spec<A>::ptr_type address,
               std::array<IntType, N>& vals) const;
+  // READ a block of <n> values from <address> to the contiguous range
+  // starting at <vals>, or to a pre-sized std::vector.
+  // Same return value as for the std::array version (in units of IntType).
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t read(const typename address_spec<A>::ptr_type address, IntType* vals,
+              size_t n) const;
+  template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+  size_t read(const typename address_spec<A>::ptr_type address,
+              std::vector<IntType, Alloc>& vals) const;
   // WRITE a single value from <val> to <address> for transfer mode
   // D08_*, D16 or D32
   // returns the number of transactions (i.e., 1 if all went well)
@@ -100,12 +153,169 @@ public:
   template <addressing_mode A, transfer_mode D, class IntType, size_t N>
   size_t write(const typename address_spec<A>::ptr_type address,
                std::array<IntType, N>& vals) const;
+  // WRITE a block of <n> values from the contiguous range starting at
+  // <vals>, or from a std::vector, to <address>
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t write(const typename address_spec<A>::ptr_type address,
+               IntType* vals, size_t n) const;
+  template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+  size_t write(const typename address_spec<A>::ptr_type address,
+               std::vector<IntType, Alloc>& vals) const;
+  // FIFO READ/WRITE: same as the block transfers above, but all
+  // transactions go to the same (non-incrementing) <address>, e.g. the
+  // output buffer port of a digitizer. Only for BLT and MBLT.
+  // As the address boundaries do not matter here, the data is moved
+  // in blocks of up to transfer_spec<D>::FIFO_BLOCK_LENGTH.
+  template <addressing_mode A, transfer_mode D, class IntType, size_t N>
+  size_t read_fifo(const typename address_spec<A>::ptr_type address,
+                   std::array<IntType, N>& vals) const;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t read_fifo(const typename address_spec<A>::ptr_type address,
+                   IntType* vals, size_t n) const;
+  template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+  size_t read_fifo(const typename address_spec<A>::ptr_type address,
+                   std::vector<IntType, Alloc>& vals) const;
+  template <addressing_mode A, transfer_mode D, class IntType, size_t N>
+  size_t write_fifo(const typename address_spec<A>::ptr_type address,
+                    std::array<IntType, N>& vals) const;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t write_fifo(const typename address_spec<A>::ptr_type address,
+                    IntType* vals, size_t n) const;
+  template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+  size_t write_fifo(const typename address_spec<A>::ptr_type address,
+                    std::vector<IntType, Alloc>& vals) const;
+
+  // READ-MODIFY-WRITE (RMW): write <val> to <address>, and return the
+  // previous value in <val>, in a single bus-locked RMW cycle
+  // (for transfer mode D08_*, D16 or D32).
+  // Returns the number of transactions (i.e., 1 if all went well)
+  template <addressing_mode A, transfer_mode D,
+            class = typename std::enable_if<!is_multiplexed<D>::value>::type>
+  size_t read_modify_write(const typename address_spec<A>::ptr_type address,
+                           typename transfer_spec<D>::value_type& val) const;
+  // MODIFY: replace the bits in <mask> at <address> with those in <bits>
+  // (i.e. set bits with <mask> == <bits>, clear them with <bits> == 0),
+  // starting from the known register value <expected> (e.g. from a
+  // write shadow). Returns the previous value.
+  // The new value is written with a single RMW cycle, which also returns
+  // the actual previous value. Should that differ from <expected>
+  // (another thread or bus master changed it in the mean time), the
+  // modification is redone on the actual value.
+  // Note that the RMW cycle always writes the value computed from
+  // <expected>: when the register did change, that value briefly goes
+  // out on the bus before the retry corrects it. Concurrent modify()
+  // calls on the same master are serialized, but plain writes are not,
+  // so do not use modify() on registers where a spurious write has side
+  // effects (command registers, ...).
+  template <addressing_mode A, transfer_mode D>
+  typename transfer_spec<D>::value_type
+  modify(const typename address_spec<A>::ptr_type address,
+         const typename transfer_spec<D>::value_type mask,
+         const typename transfer_spec<D>::value_type bits,
+         const typename transfer_spec<D>::value_type expected) const;
+
+  // MULTICAST WRITE (MCST): write <val> to <address> in the A32 MCST
+  // address space, accepted by all boards that share the MCST address.
+  // Returns the number of transactions (i.e., 1 if all went well).
+  // Cf. mcst_group.hpp
+  template <transfer_mode D,
+            class = typename std::enable_if<is_mcst<D>::value>::type>
+  size_t write_multicast(
+      const typename address_spec<addressing_mode::A32>::ptr_type address,
+      typename transfer_spec<D>::value_type val) const {
+    return write<addressing_mode::A32, D>(address, val);
+  }
+  // CHAINED READ (CBLT): read up to <n> values from all boards in the
+  // CBLT chain at <address> (A32 D32 BLT or MBLT), in a single chained
+  // transfer. The transfer is ended by a bus error from the last board in
+  // the chain, which is the normal termination (and not thrown).
+  // Returns the number of values read (in units of IntType).
+  // Cf. cblt_chain.hpp to split the data per board.
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t read_chained(const typename address_spec<A>::ptr_type address,
+                      IntType* vals, size_t n) const;
+  template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+  size_t read_chained(const typename address_spec<A>::ptr_type address,
+                      std::vector<IntType, Alloc>& vals) const;
+
+  // EXCEPTION-FREE variants of read(), write(), read_fifo(), write_fifo()
+  // and read_chained(), for hot paths where an error is an expected
+  // outcome (e.g. a bus error ending a FIFO readout, or probing for
+  // boards). Errors are returned as a vme::status instead of being thrown,
+  // the block versions store the number of values transferred until then
+  // in <n_done> (in units of IntType).
+  // Master implementations that support it report the error without ever
+  // building a vme::error (cf. status_sink_), for the others the
+  // vme::error is caught.
+  template <addressing_mode A, transfer_mode D,
+            class = typename std::enable_if<!is_multiplexed<D>::value>::type>
+  vme::status try_read(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::value_type& val) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D,
+            class = typename std::enable_if<!is_multiplexed<D>::value>::type>
+  vme::status try_write(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::value_type& val) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  vme::status try_read(const typename address_spec<A>::ptr_type address,
+                       IntType* vals, size_t n, size_t& n_done) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  vme::status try_write(const typename address_spec<A>::ptr_type address,
+                        IntType* vals, size_t n, size_t& n_done) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  vme::status try_read_fifo(const typename address_spec<A>::ptr_type address,
+                            IntType* vals, size_t n, size_t& n_done) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  vme::status try_write_fifo(const typename address_spec<A>::ptr_type address,
+                             IntType* vals, size_t n, size_t& n_done) const
+      noexcept;
+  template <addressing_mode A, transfer_mode D, class IntType>
+  vme::status
+  try_read_chained(const typename address_spec<A>::ptr_type address,
+                   IntType* vals, size_t n, size_t& n_done) const noexcept;
+
+  // maximum number of 64-bit words moved by a single MBLT call
+  // (for both normal and FIFO transfers)
+  size_t mblt_block_length() const { return mblt_block_length_; }
+
+  // get an (empty) batch of single cycles for this master,
+  // cf. master/batch.hpp
+  batch_type batch() const { return batch_type{*this}; }
+
+  // Instrumentation: snapshot of the per-path transfer counters and
+  // latency histograms, of the link probe results and of the IRQ waits
+  // (cf. master/stats.hpp)
+  master_stats stats() const { return stats_.snapshot(); }
+  // queueing statistics of the cycle scheduler for priority class <p>
+  priority_stats queue_stats(const priority p) const {
+    return scheduler_.stats(p);
+  }
+  void reset_stats() {
+    stats_.reset();
+    scheduler_.reset();
+  }
+
+  // time a single round trip over the link to the master module
+  // (without a VME cycle), to tell a slow link from a slow board.
+  // Returns the round-trip time in [ns], throws a vme::error on failure.
+  uint64_t probe_link() const;
+  // only probe the link if the configured probe interval has passed
+  // since the last probe (no-op if periodic probing is disabled).
+  // Failures are logged and counted, but not thrown.
+  void probe_link_if_due() const;
 
   vme::error error(const std::string& msg) const;
   vme::bus_error bus_error(const std::string& msg) const;
   vme::comm_error comm_error(const std::string& msg) const;
   vme::invalid_parameter invalid_parameter(const std::string& msg) const;
   vme::timeout_error timeout_error(const std::string& msg) const;
+  // throw the vme::error matching <st> (a failed status)
+  [[noreturn]] void throw_error(const vme::status st,
+                                const std::string& msg) const;
 
 protected:
   // READ/WRITE placeholder functions, to be replaced in MasterImpl if
@@ -118,6 +328,10 @@ protected:
   template <addressing_mode A, transfer_mode D>
   size_t write_single(const typename address_spec<A>::ptr_type address,
                       typename transfer_spec<D>::ptr_type val) const;
+  // RMW: write <val>, and store the previous value in <val>
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const;
   // BLT
   template <addressing_mode A, transfer_mode D>
   size_t read_blt(const typename address_spec<A>::ptr_type address,
@@ -163,11 +377,72 @@ protected:
   size_t write_2evme6(const typename address_spec<A>::ptr_type address,
                       transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
                       size_t n_requests) const;
+  // CBLT (chained BLT or MBLT)
+  // same as read_blt/read_mblt, but a bus error ends the transfer
+  // without throwing (returns the number of values read until then)
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const;
+  // MULTI (batched single cycles)
+  // returns the number of successful cycles, and the status for every
+  // cycle in <st>. Should only throw for problems affecting the entire
+  // batch.
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  // IRQ
+  // IACK cycle on <level>, storing the status/ID in <vector>
+  template <transfer_mode D>
+  size_t iack(const irq_level level,
+              typename transfer_spec<D>::ptr_type vector) const;
+  // bit mask of the active IRQ lines
+  uint8_t check_irq() const;
+  // PING (link round-trip probe)
+  // a cheap round trip to the master module itself (e.g. a register read),
+  // throws a vme::error on failure
+  void ping() const;
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const;
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const;
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const;
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const;
 
   const short link_index_;
   const short board_index_;
   const std::vector<irq_level> irq_;
   const unsigned timeout_; // timeout level in [ms]
+  // can be tuned by the master implementation for the actual link
+  size_t mblt_block_length_; // in 64-bit words
+
+  mutable transfer_stats stats_;
+  const unsigned link_probe_interval_; // in [ms]
+  mutable std::atomic<int64_t> next_probe_; // in [ms] since clock epoch
+
+  // serializes all calls to the master implementation
+  mutable cycle_scheduler scheduler_;
+
+  // serializes modify() calls
+  mutable std::mutex rmw_mutex_;
+
+  // Set during a (scheduled) call to the master implementation when the
+  // caller wants errors as status codes (try_read(), ...). The
+  // implementation can then store the status in *status_sink_ and return
+  // the number of completed transactions instead of throwing a
+  // vme::error (throwing remains valid). nullptr otherwise.
+  mutable vme::status* status_sink_;
 
 private:
   master_type& impl() { return static_cast<master_type&>(*this); }
@@ -180,14 +455,54 @@ private:
   friend struct master_impl::dispatch_read;
   template <addressing_mode A, transfer_mode D>
   friend struct master_impl::dispatch_write;
+  template <addressing_mode A, transfer_mode D>
+  friend struct master_impl::dispatch_fifo_read;
+  template <addressing_mode A, transfer_mode D>
+  friend struct master_impl::dispatch_fifo_write;
+
+  // batched single cycles (from master/batch.hpp)
+  friend batch_type;
+  size_t read_multi_cycles(single_cycle* cycles, vme::status* st,
+                           size_t n) const {
+    return multi_cycles(cycles, st, n, true);
+  }
+  size_t write_multi_cycles(single_cycle* cycles, vme::status* st,
+                            size_t n) const {
+    return multi_cycles(cycles, st, n, false);
+  }
+  // DRY (instrumented) implementation of the above
+  size_t multi_cycles(single_cycle* cycles, vme::status* st, size_t n,
+                      const bool read) const;
+
+  // run a <call> to the master implementation through the scheduler,
+  // recording it under <path> in the transfer statistics (including
+  // errors by type). <n_requests> and the number of transactions
+  // returned by <call> are in units of <width> bytes.
+  // With a <sink>, errors are stored in <sink> instead of being thrown
+  // (returning the transactions completed before the error, when the
+  // implementation reports them).
+  template <class Call>
+  size_t instrumented(const transfer_path path, const size_t width,
+                      const size_t n_requests, Call call,
+                      vme::status* sink = nullptr) const;
 
-  // DRY block transfer implementation, used by both
-  // ::read() and ::write()
+  // DRY block transfer implementation, used by ::read(), ::write(),
+  // ::read_fifo() and ::write_fifo()
   // (distinguished through different block transfer dispatchers).
-  template <addressing_mode A, transfer_mode D, class IntType, size_t N,
+  // Works on <n> values of IntType in the contiguous range starting
+  // at <vals>.
+  // With a <sink>, the transfer stops at the first error, which is
+  // stored in <sink> instead of being thrown.
+  template <addressing_mode A, transfer_mode D, class IntType,
             template <addressing_mode, transfer_mode> class Dispatcher>
   size_t block_transfer(const typename address_spec<A>::ptr_type address,
-                        std::array<IntType, N>& vals) const;
+                        IntType* vals, size_t n,
+                        vme::status* sink = nullptr) const;
+  // DRY implementation of read_chained() and try_read_chained()
+  template <addressing_mode A, transfer_mode D, class IntType>
+  size_t chained_transfer(const typename address_spec<A>::ptr_type address,
+                          IntType* vals, size_t n,
+                          vme::status* sink = nullptr) const;
 
   // DRY helper function for the various ::error methods
   template <class Error> Error error_helper(const std::string& msg) const {
@@ -228,6 +543,9 @@ public:
   timeout_error(const std::string& board_name, const short link_index,
                 const short board_index, const std::string& msg);
 };
+
+// status code matching the type of <e>
+vme::status error_status(const error& e);
 }
 }
 ////////////////////////////////////////////////////////////////////////////////
@@ -236,8 +554,11 @@ public:
 namespace ctrlroom {
 namespace vme {
 
-// IRQ translator is defined in master.cpp
+// IRQ, addressing mode and transfer mode translators are defined in
+// master.cpp
 extern const translation_map<irq_level> IRQ_TRANSLATOR;
+extern const translation_map<addressing_mode> ADDRESSING_MODE_TRANSLATOR;
+extern const translation_map<transfer_mode> TRANSFER_MODE_TRANSLATOR;
 
 // constructor
 template <class MasterImpl>
@@ -246,11 +567,44 @@ master<MasterImpl>::master(const std::string& identifier, const ptree& settings)
     , link_index_{conf_.get<short>(LINK_INDEX_KEY)}
     , board_index_{conf_.get<short>(BOARD_INDEX_KEY)}
     , irq_{conf_.get_vector<irq_level>(IRQ_KEY, IRQ_TRANSLATOR)}
-    , timeout_{conf_.get<unsigned>(TIMEOUT_KEY, DEFAULT_TIMEOUT)} {
+    , timeout_{conf_.get<unsigned>(TIMEOUT_KEY, DEFAULT_TIMEOUT)}
+    , mblt_block_length_{conf_.get<size_t>(
+          MBLT_BLOCK_LENGTH_KEY,
+          static_cast<size_t>(
+              transfer_spec<transfer_mode::MBLT>::BLOCK_LENGTH))}
+    , link_probe_interval_{conf_.get<unsigned>(LINK_PROBE_INTERVAL_KEY, 0)}
+    , next_probe_{0}
+    , status_sink_{nullptr} {
   LOG_INFO(name(), "Initializing master module");
   if (timeout_ == 0) {
     throw conf_.value_error(TIMEOUT_KEY, std::to_string(timeout_));
   }
+  if (mblt_block_length_ == 0) {
+    throw conf_.value_error(MBLT_BLOCK_LENGTH_KEY,
+                            std::to_string(mblt_block_length_));
+  }
+  if (conf_.get_optional<bool>(HUGE_PAGES_KEY) ||
+      conf_.get_optional<bool>(LOCK_MEMORY_KEY) ||
+      conf_.get_optional<bool>(PREFAULT_MEMORY_KEY)) {
+    const memory_policy policy{conf_.get<bool>(HUGE_PAGES_KEY, false),
+                               conf_.get<bool>(LOCK_MEMORY_KEY, false),
+                               conf_.get<bool>(PREFAULT_MEMORY_KEY, true)};
+    if (!configure_transfer_memory_policy(policy)) {
+      LOG_ERROR(name(), "Transfer memory settings differ from the (process "
+                        "wide) policy already in use");
+      const memory_policy current{transfer_memory_policy()};
+      if (policy.hugepages != current.hugepages) {
+        throw conf_.value_error(HUGE_PAGES_KEY,
+                                policy.hugepages ? "true" : "false");
+      }
+      if (policy.lock != current.lock) {
+        throw conf_.value_error(LOCK_MEMORY_KEY,
+                                policy.lock ? "true" : "false");
+      }
+      throw conf_.value_error(PREFAULT_MEMORY_KEY,
+                              policy.prefault ? "true" : "false");
+    }
+  }
 }
 
 template <class MasterImpl> master<MasterImpl>::~master() {
@@ -263,15 +617,33 @@ template <addressing_mode A, transfer_mode D, class>
 size_t
 master<MasterImpl>::read(const typename address_spec<A>::ptr_type address,
                          typename transfer_spec<D>::value_type& val) const {
-  return impl().template read_single<A, D>(address, &val);
+  return instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+                      [&]() -> size_t {
+                        return impl().template read_single<A, D>(address,
+                                                                 &val);
+                      });
 }
 template <class MasterImpl>
 template <addressing_mode A, transfer_mode D, class IntType, size_t N>
 size_t
 master<MasterImpl>::read(const typename address_spec<A>::ptr_type address,
                          std::array<IntType, N>& vals) const {
-  return block_transfer<A, D, IntType, N, master_impl::dispatch_read>(address,
-                                                                      vals);
+  return read<A, D>(address, vals.data(), N);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t
+master<MasterImpl>::read(const typename address_spec<A>::ptr_type address,
+                         IntType* vals, size_t n) const {
+  return block_transfer<A, D, IntType, master_impl::dispatch_read>(address,
+                                                                   vals, n);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+size_t
+master<MasterImpl>::read(const typename address_spec<A>::ptr_type address,
+                         std::vector<IntType, Alloc>& vals) const {
+  return read<A, D>(address, vals.data(), vals.size());
 }
 
 // write (main calls)
@@ -280,58 +652,464 @@ template <addressing_mode A, transfer_mode D, class>
 size_t
 master<MasterImpl>::write(const typename address_spec<A>::ptr_type address,
                           typename transfer_spec<D>::value_type& val) const {
-  return impl().template write_single<A, D>(address, &val);
+  return instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+                      [&]() -> size_t {
+                        return impl().template write_single<A, D>(address,
+                                                                  &val);
+                      });
 }
 template <class MasterImpl>
 template <addressing_mode A, transfer_mode D, class IntType, size_t N>
 size_t
 master<MasterImpl>::write(const typename address_spec<A>::ptr_type address,
                           std::array<IntType, N>& vals) const {
-  return block_transfer<A, D, IntType, N, master_impl::dispatch_write>(address,
-                                                                       vals);
+  return write<A, D>(address, vals.data(), N);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t
+master<MasterImpl>::write(const typename address_spec<A>::ptr_type address,
+                          IntType* vals, size_t n) const {
+  return block_transfer<A, D, IntType, master_impl::dispatch_write>(address,
+                                                                    vals, n);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+size_t
+master<MasterImpl>::write(const typename address_spec<A>::ptr_type address,
+                          std::vector<IntType, Alloc>& vals) const {
+  return write<A, D>(address, vals.data(), vals.size());
+}
+
+// read-modify-write
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class>
+size_t master<MasterImpl>::read_modify_write(
+    const typename address_spec<A>::ptr_type address,
+    typename transfer_spec<D>::value_type& val) const {
+  return instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+                      [&]() -> size_t {
+                        return impl().template rmw_single<A, D>(address,
+                                                                &val);
+                      });
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D>
+typename transfer_spec<D>::value_type master<MasterImpl>::modify(
+    const typename address_spec<A>::ptr_type address,
+    const typename transfer_spec<D>::value_type mask,
+    const typename transfer_spec<D>::value_type bits,
+    const typename transfer_spec<D>::value_type expected) const {
+  using value_type = typename transfer_spec<D>::value_type;
+  std::lock_guard<std::mutex> lock{rmw_mutex_};
+  value_type old{expected};
+  for (size_t i{0}; i < MAX_RMW_CYCLES; ++i) {
+    value_type val{static_cast<value_type>((old & ~mask) | (bits & mask))};
+    read_modify_write<A, D>(address, val);
+    // <val> now holds the actual previous value
+    if (val == old) {
+      return old;
+    }
+    old = val;
+  }
+  throw error("Register at " + std::to_string(address) +
+              " kept changing during RMW");
+}
+
+// FIFO read/write
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, size_t N>
+size_t
+master<MasterImpl>::read_fifo(const typename address_spec<A>::ptr_type address,
+                              std::array<IntType, N>& vals) const {
+  return read_fifo<A, D>(address, vals.data(), N);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t
+master<MasterImpl>::read_fifo(const typename address_spec<A>::ptr_type address,
+                              IntType* vals, size_t n) const {
+  return block_transfer<A, D, IntType, master_impl::dispatch_fifo_read>(
+      address, vals, n);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+size_t
+master<MasterImpl>::read_fifo(const typename address_spec<A>::ptr_type address,
+                              std::vector<IntType, Alloc>& vals) const {
+  return read_fifo<A, D>(address, vals.data(), vals.size());
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, size_t N>
+size_t master<MasterImpl>::write_fifo(
+    const typename address_spec<A>::ptr_type address,
+    std::array<IntType, N>& vals) const {
+  return write_fifo<A, D>(address, vals.data(), N);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t master<MasterImpl>::write_fifo(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n) const {
+  return block_transfer<A, D, IntType, master_impl::dispatch_fifo_write>(
+      address, vals, n);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+size_t master<MasterImpl>::write_fifo(
+    const typename address_spec<A>::ptr_type address,
+    std::vector<IntType, Alloc>& vals) const {
+  return write_fifo<A, D>(address, vals.data(), vals.size());
+}
+
+// chained read
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t master<MasterImpl>::read_chained(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n) const {
+  return chained_transfer<A, D>(address, vals, n);
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType, class Alloc>
+size_t master<MasterImpl>::read_chained(
+    const typename address_spec<A>::ptr_type address,
+    std::vector<IntType, Alloc>& vals) const {
+  return read_chained<A, D>(address, vals.data(), vals.size());
+}
+
+// exception-free calls
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class>
+vme::status
+master<MasterImpl>::try_read(const typename address_spec<A>::ptr_type address,
+                             typename transfer_spec<D>::value_type& val) const
+    noexcept {
+  vme::status st{status::SUCCESS};
+  try {
+    instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+                 [&]() -> size_t {
+                   return impl().template read_single<A, D>(address, &val);
+                 },
+                 &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class>
+vme::status
+master<MasterImpl>::try_write(const typename address_spec<A>::ptr_type address,
+                              typename transfer_spec<D>::value_type& val) const
+    noexcept {
+  vme::status st{status::SUCCESS};
+  try {
+    instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+                 [&]() -> size_t {
+                   return impl().template write_single<A, D>(address, &val);
+                 },
+                 &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+vme::status
+master<MasterImpl>::try_read(const typename address_spec<A>::ptr_type address,
+                             IntType* vals, size_t n, size_t& n_done) const
+    noexcept {
+  vme::status st{status::SUCCESS};
+  n_done = 0;
+  try {
+    n_done = block_transfer<A, D, IntType, master_impl::dispatch_read>(
+        address, vals, n, &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+vme::status
+master<MasterImpl>::try_write(const typename address_spec<A>::ptr_type address,
+                              IntType* vals, size_t n, size_t& n_done) const
+    noexcept {
+  vme::status st{status::SUCCESS};
+  n_done = 0;
+  try {
+    n_done = block_transfer<A, D, IntType, master_impl::dispatch_write>(
+        address, vals, n, &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+vme::status master<MasterImpl>::try_read_fifo(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n, size_t& n_done) const noexcept {
+  vme::status st{status::SUCCESS};
+  n_done = 0;
+  try {
+    n_done = block_transfer<A, D, IntType, master_impl::dispatch_fifo_read>(
+        address, vals, n, &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+vme::status master<MasterImpl>::try_write_fifo(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n, size_t& n_done) const noexcept {
+  vme::status st{status::SUCCESS};
+  n_done = 0;
+  try {
+    n_done = block_transfer<A, D, IntType, master_impl::dispatch_fifo_write>(
+        address, vals, n, &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+vme::status master<MasterImpl>::try_read_chained(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n, size_t& n_done) const noexcept {
+  vme::status st{status::SUCCESS};
+  n_done = 0;
+  try {
+    n_done = chained_transfer<A, D>(address, vals, n, &st);
+  } catch (...) {
+    return status::GENERIC_ERROR;
+  }
+  return st;
+}
+
+// chained_transfer
+template <class MasterImpl>
+template <addressing_mode A, transfer_mode D, class IntType>
+size_t master<MasterImpl>::chained_transfer(
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n, vme::status* sink) const {
+  static_assert(is_cblt<A, D>::value,
+                "CBLT is only defined for A32 D32 BLT and MBLT");
+  // like FIFO transfers, all blocks are read from the chain address
+  const size_t block_length{D == transfer_mode::MBLT
+                                ? mblt_block_length_
+                                : transfer_spec<D>::FIFO_BLOCK_LENGTH};
+  size_t n_to_copy{n * sizeof(IntType) / transfer_spec<D>::WIDTH};
+  size_t n_done{0};
+  while (n_to_copy > 0) {
+    size_t n_block{n_to_copy < block_length ? n_to_copy : block_length};
+    typename transfer_spec<D>::ptr_type vptr{
+        reinterpret_cast<typename transfer_spec<D>::ptr_type>(vals) + n_done};
+    size_t n_copied{instrumented(
+        block_path(D), transfer_spec<D>::WIDTH, n_block,
+        [&]() -> size_t {
+          return impl().template read_cblt<A, D>(address, vptr, n_block);
+        },
+        sink)};
+    n_done += n_copied;
+    n_to_copy -= n_copied;
+    // a short block means the end of the chain was reached
+    if (n_copied < n_block) {
+      break;
+    }
+  }
+  return n_done * transfer_spec<D>::WIDTH / sizeof(IntType);
 }
 
 // block_transfer
 template <class MasterImpl>
-template <addressing_mode A, transfer_mode D, class IntType, size_t N,
+template <addressing_mode A, transfer_mode D, class IntType,
           template <addressing_mode, transfer_mode> class Dispatcher>
 size_t master<MasterImpl>::block_transfer(
-    const typename address_spec<A>::ptr_type address,
-    std::array<IntType, N>& vals) const {
+    const typename address_spec<A>::ptr_type address, IntType* vals,
+    size_t n, vme::status* sink) const {
+
+  using address_type = typename address_spec<A>::ptr_type;
+
+  // FIFO transfers stay at <address>, normal block transfers continue
+  // where the previous block ended
+  constexpr bool fifo{master_impl::is_fifo<Dispatcher>::value};
+  // the MBLT block length is a run-time setting for this master
+  const size_t block_length{
+      D == transfer_mode::MBLT
+          ? mblt_block_length_
+          : (fifo ? transfer_spec<D>::FIFO_BLOCK_LENGTH
+                  : transfer_spec<D>::BLOCK_LENGTH)};
 
   // number of elements to copy, in VME data width
-  size_t n_to_copy{N * sizeof(IntType) / transfer_spec<D>::WIDTH};
+  size_t n_to_copy{n * sizeof(IntType) / transfer_spec<D>::WIDTH};
 
-  // number of entries in the array
-  size_t n_filled{0};
+  // number of completed transactions, in VME data width
+  size_t n_done{0};
 
   // loop over the necessary amount of block transfers,
-  // taking into account the maximum allowed length block transfer lengths
-  for (size_t n_blocks{1 + (n_to_copy - 1) / transfer_spec<D>::BLOCK_LENGTH};
-       n_blocks > 0; --n_blocks) {
+  // taking into account the maximum allowed length block transfer lengths.
+  // A short transfer is picked up where it stopped by the next
+  // iteration, only a transfer that makes no progress at all ends the loop
+  while (n_to_copy > 0) {
 
     // number of transactions for this block
-    size_t n{n_blocks == 1 ? n_to_copy : transfer_spec<D>::BLOCK_LENGTH};
+    size_t n_block{n_to_copy < block_length ? n_to_copy : block_length};
     typename transfer_spec<D>::ptr_type vptr{
-        reinterpret_cast<typename transfer_spec<D>::ptr_type>(&vals[n_filled])};
+        reinterpret_cast<typename transfer_spec<D>::ptr_type>(vals) + n_done};
+    const address_type block_address{
+        fifo ? address : static_cast<address_type>(
+                             address + n_done * transfer_spec<D>::WIDTH)};
 
     // number of completed transactions in this call.
-    size_t n_copied{Dispatcher<A, D>::call(*this, address, vptr, n)};
+    size_t n_copied{instrumented(
+        block_path(D), transfer_spec<D>::WIDTH, n_block,
+        [&]() -> size_t {
+          return Dispatcher<A, D>::call(*this, block_address, vptr, n_block);
+        },
+        sink)};
 
-    n_filled += n_copied * transfer_spec<D>::WIDTH / sizeof(IntType);
+    n_done += n_copied;
     n_to_copy -= n_copied;
 
     // handle the case where the block transfer ended prematurely
-    if (!n_copied)
+    if (!n_copied || (sink && *sink != status::SUCCESS))
       break;
   }
-  return n_filled;
+  return n_done * transfer_spec<D>::WIDTH / sizeof(IntType);
 }
 // IRQ wait (default version)
 template <class MasterImpl> void master<MasterImpl>::wait_for_irq() const {
   wait_for_irq(timeout_);
 }
 
+// IRQ status and acknowledge
+template <class MasterImpl> uint8_t master<MasterImpl>::pending_irqs() const {
+  return static_cast<uint8_t>(
+      scheduler_.run([&]() -> size_t { return impl().check_irq(); }));
+}
+template <class MasterImpl>
+template <transfer_mode D>
+typename transfer_spec<D>::value_type
+master<MasterImpl>::acknowledge_irq(const irq_level level) const {
+  static_assert(!is_multiplexed<D>::value &&
+                    transfer_spec<D>::WIDTH <= sizeof(uint32_t),
+                "IACK cycles are D08, D16 or D32");
+  typename transfer_spec<D>::value_type vector{0};
+  instrumented(transfer_path::SINGLE, transfer_spec<D>::WIDTH, 1,
+               [&]() -> size_t {
+                 return impl().template iack<D>(level, &vector);
+               });
+  return vector;
+}
+
+// instrumentation
+template <class MasterImpl> uint64_t master<MasterImpl>::probe_link() const {
+  return scheduler_.run([&]() -> size_t {
+    const auto start = transfer_stats::now();
+    try {
+      impl().ping();
+    } catch (vme::error&) {
+      stats_.record_probe(false, start);
+      throw;
+    }
+    return stats_.record_probe(true, start);
+  });
+}
+template <class MasterImpl>
+void master<MasterImpl>::probe_link_if_due() const {
+  if (!link_probe_interval_) {
+    return;
+  }
+  const int64_t now_ms{std::chrono::duration_cast<std::chrono::milliseconds>(
+                           transfer_stats::now().time_since_epoch())
+                           .count()};
+  int64_t due{next_probe_.load(std::memory_order_relaxed)};
+  // only one caller gets to do the probe
+  if (now_ms < due ||
+      !next_probe_.compare_exchange_strong(due,
+                                           now_ms + link_probe_interval_)) {
+    return;
+  }
+  try {
+    const uint64_t ns{probe_link()};
+    LOG_JUNK(name(), "Link round trip: " + std::to_string(ns) + " ns");
+  } catch (vme::error&) {
+    LOG_WARNING(name(), "Link probe failed");
+  }
+}
+template <class MasterImpl>
+size_t master<MasterImpl>::multi_cycles(single_cycle* cycles, vme::status* st,
+                                        size_t n, const bool read) const {
+  return scheduler_.run([&]() -> size_t {
+    const auto start = transfer_stats::now();
+    stats_.record_call_start(start);
+    size_t n_good{0};
+    try {
+      n_good = read ? impl().read_multi(cycles, st, n)
+                    : impl().write_multi(cycles, st, n);
+    } catch (vme::error&) {
+      stats_.record_error(transfer_path::MULTI, status::GENERIC_ERROR, start);
+      throw;
+    }
+    size_t bytes{0};
+    for (size_t i{0}; i < n; ++i) {
+      if (st[i] == status::SUCCESS) {
+        bytes += cycles[i].width;
+      } else {
+        stats_.count_error(transfer_path::MULTI, st[i]);
+      }
+    }
+    stats_.record(transfer_path::MULTI, bytes, n_good < n, start);
+    return n_good;
+  });
+}
+template <class MasterImpl>
+template <class Call>
+size_t master<MasterImpl>::instrumented(const transfer_path path,
+                                        const size_t width,
+                                        const size_t n_requests, Call call,
+                                        vme::status* sink) const {
+  // timed from the start of the call, the queueing time is recorded
+  // by the scheduler
+  return scheduler_.run([&]() -> size_t {
+    const auto start = transfer_stats::now();
+    stats_.record_call_start(start);
+    vme::status st{status::SUCCESS};
+    status_sink_ = sink ? &st : nullptr;
+    size_t n_done{0};
+    try {
+      n_done = call();
+    } catch (vme::error& e) {
+      status_sink_ = nullptr;
+      st = error_status(e);
+      stats_.record_error(path, st, start);
+      if (!sink) {
+        throw;
+      }
+      *sink = st;
+      return 0;
+    } catch (...) {
+      status_sink_ = nullptr;
+      throw;
+    }
+    status_sink_ = nullptr;
+    if (st != status::SUCCESS) {
+      // reported by the implementation through the status sink
+      stats_.record_error(path, st, start);
+      *sink = st;
+      return n_done;
+    }
+    stats_.record(path, n_done * width, n_done < n_requests, start);
+    return n_done;
+  });
+}
+
 // exceptions
 template <class MasterImpl>
 vme::error master<MasterImpl>::error(const std::string& msg) const {
@@ -355,6 +1133,22 @@ vme::timeout_error
 master<MasterImpl>::timeout_error(const std::string& msg) const {
   return error_helper<vme::timeout_error>(msg);
 }
+template <class MasterImpl>
+void master<MasterImpl>::throw_error(const vme::status st,
+                                     const std::string& msg) const {
+  switch (st) {
+  case vme::status::BUS_ERROR:
+    throw bus_error(msg);
+  case vme::status::COMM_ERROR:
+    throw comm_error(msg);
+  case vme::status::INVALID_PARAMETER:
+    throw invalid_parameter(msg);
+  case vme::status::TIMEOUT_ERROR:
+    throw timeout_error(msg);
+  default:
+    throw error(msg);
+  }
+}
 }
 }
 
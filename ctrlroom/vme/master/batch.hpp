@@ -0,0 +1,261 @@
+#ifndef CTRLROOM_VME_MASTER_BATCH_LOADED
+#define CTRLROOM_VME_MASTER_BATCH_LOADED
+
+#include <ctrlroom/vme/vme64.hpp>
+#include <ctrlroom/vme/master/status.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// raw single VME cycle as handed to the master implementation
+// by a batch (read_multi/write_multi)
+//  * address: full VME address (up to A32)
+//  * data: value to write, or value read after submission
+//  * am: address modifier
+//  * width: data width in bytes
+struct single_cycle {
+  uint32_t address;
+  uint32_t data;
+  uint32_t am;
+  uint32_t width;
+};
+
+// Batch of single-cycle reads and writes, to be submitted to the master
+// in as few calls as possible. Every cycle can have its own address
+// modifier and data width.
+//
+// Cycles are executed in the order they were queued. Consecutive reads
+// (or writes) are handed to the master implementation as a single
+// read_multi (write_multi) call, so a batch of writes followed by a
+// batch of reads only takes 2 calls.
+//
+// Submission stops after the first call with a failed cycle: the
+// cycles queued after that call are not executed (and reported as
+// GENERIC_ERROR). Within a single call the master still executes the
+// cycles following a failed one, so cycles that only make sense if
+// the previous ones succeeded (e.g. a strobe loading the values just
+// written) should be separated from them with fence().
+//
+// Read results are stored in the referenced values when the batch is
+// submitted; these references have to stay valid until then.
+// Failed cycles do not throw, their status is reported per cycle
+// through cycle_status(), or thrown for the first failed cycle by
+// check(). (Communication problems affecting the whole batch are still
+// thrown by the master).
+//
+// Get a batch from the master through master<>::batch(), or from a slave
+// through slave<>::batch() (relative addressing).
+template <class Master> class cycle_batch {
+public:
+  using master_type = Master;
+
+  explicit cycle_batch(const master_type& m) : master_(m) {}
+
+  // queue a single read/write for addressing mode A and transfer mode D
+  // (only up to A32, D32)
+  template <addressing_mode A, transfer_mode D>
+  void read(const typename address_spec<A>::ptr_type address,
+            typename transfer_spec<D>::value_type& val);
+  template <addressing_mode A, transfer_mode D>
+  void write(const typename address_spec<A>::ptr_type address,
+             const typename transfer_spec<D>::value_type val);
+  // raw versions, with explicit address modifier <am> and
+  // data width <width> (in bytes)
+  void read(const uint32_t address, const uint32_t am, const size_t width,
+            uint32_t& val);
+  void write(const uint32_t address, const uint32_t am, const size_t width,
+             const uint32_t val);
+
+  // end the current read_multi/write_multi call: the cycles queued
+  // after the fence are only executed if all cycles before it succeeded
+  void fence();
+
+  // execute all queued cycles, up to the first call with a failed cycle
+  // returns the number of successful cycles
+  size_t submit();
+
+  // status of cycle <i> (in the order the cycles were queued)
+  // only meaningfull after submit()
+  vme::status cycle_status(const size_t i) const { return status_[i]; }
+  // true if all cycles were executed successfully
+  bool good() const;
+  // index of the first failed cycle (size() if none)
+  size_t first_failed() const;
+  // throw the vme::error matching the status of the first failed cycle
+  // (if any), naming <what>, its address and its status
+  void check(const std::string& what) const;
+  // cycle <i> as queued (the read value after submit())
+  const single_cycle& cycle(const size_t i) const { return cycles_[i]; }
+
+  size_t size() const { return cycles_.size(); }
+  bool empty() const { return cycles_.empty(); }
+  // remove all queued cycles
+  void clear();
+
+private:
+  // read target, with a type-aware store function to store the
+  // read value in the correct integer type
+  struct target {
+    bool read;
+    void* dest;
+    void (*store)(void* dest, const uint32_t data);
+  };
+  template <class T> static void store(void* dest, const uint32_t data) {
+    *static_cast<T*>(dest) = static_cast<T>(data);
+  }
+
+  void queue(const uint32_t address, const uint32_t am, const size_t width,
+             const uint32_t data, const target& t);
+
+  const master_type& master_;
+  std::vector<single_cycle> cycles_;
+  std::vector<target> targets_;
+  std::vector<vme::status> status_;
+  // indices of the cycles that start a new call
+  std::vector<size_t> fences_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: cycle_batch
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Master>
+template <addressing_mode A, transfer_mode D>
+void cycle_batch<Master>::read(const typename address_spec<A>::ptr_type address,
+                               typename transfer_spec<D>::value_type& val) {
+  static_assert(sizeof(typename address_spec<A>::ptr_type) <= sizeof(uint32_t),
+                "Batched cycles only support up to A32 addressing");
+  static_assert(!is_multiplexed<D>::value,
+                "Batched cycles only support single transfer modes");
+  using value_type = typename transfer_spec<D>::value_type;
+  queue(address, address_spec<A>::DATA, transfer_spec<D>::WIDTH, 0,
+        {true, &val, &store<value_type>});
+}
+template <class Master>
+template <addressing_mode A, transfer_mode D>
+void cycle_batch<Master>::write(
+    const typename address_spec<A>::ptr_type address,
+    const typename transfer_spec<D>::value_type val) {
+  static_assert(sizeof(typename address_spec<A>::ptr_type) <= sizeof(uint32_t),
+                "Batched cycles only support up to A32 addressing");
+  static_assert(!is_multiplexed<D>::value,
+                "Batched cycles only support single transfer modes");
+  using value_type = typename transfer_spec<D>::value_type;
+  // mask out sign extension for narrow widths
+  using unsigned_type = typename std::make_unsigned<value_type>::type;
+  queue(address, address_spec<A>::DATA, transfer_spec<D>::WIDTH,
+        static_cast<unsigned_type>(val), {false, nullptr, nullptr});
+}
+template <class Master>
+void cycle_batch<Master>::read(const uint32_t address, const uint32_t am,
+                               const size_t width, uint32_t& val) {
+  queue(address, am, width, 0, {true, &val, &store<uint32_t>});
+}
+template <class Master>
+void cycle_batch<Master>::write(const uint32_t address, const uint32_t am,
+                                const size_t width, const uint32_t val) {
+  queue(address, am, width, val, {false, nullptr, nullptr});
+}
+
+template <class Master> size_t cycle_batch<Master>::submit() {
+  size_t n_good{0};
+  // submit consecutive runs of reads/writes
+  size_t first{0};
+  while (first < cycles_.size()) {
+    const bool read{targets_[first].read};
+    size_t last{first + 1};
+    while (last < cycles_.size() && targets_[last].read == read &&
+           std::find(fences_.begin(), fences_.end(), last) == fences_.end()) {
+      ++last;
+    }
+    const size_t n{last - first};
+    const size_t n_run{
+        read ? master_.read_multi_cycles(&cycles_[first], &status_[first], n)
+             : master_.write_multi_cycles(&cycles_[first], &status_[first],
+                                          n)};
+    n_good += n_run;
+    if (n_run != n) {
+      // the remaining cycles stay GENERIC_ERROR
+      break;
+    }
+    first = last;
+  }
+  // store the read values
+  for (size_t i{0}; i < cycles_.size(); ++i) {
+    if (targets_[i].read && status_[i] == vme::status::SUCCESS) {
+      targets_[i].store(targets_[i].dest, cycles_[i].data);
+    }
+  }
+  return n_good;
+}
+
+template <class Master> void cycle_batch<Master>::fence() {
+  if (!cycles_.empty() &&
+      (fences_.empty() || fences_.back() != cycles_.size())) {
+    fences_.push_back(cycles_.size());
+  }
+}
+
+template <class Master> bool cycle_batch<Master>::good() const {
+  for (const auto st : status_) {
+    if (st != vme::status::SUCCESS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class Master> size_t cycle_batch<Master>::first_failed() const {
+  size_t i{0};
+  while (i < status_.size() && status_[i] == vme::status::SUCCESS) {
+    ++i;
+  }
+  return i;
+}
+
+template <class Master>
+void cycle_batch<Master>::check(const std::string& what) const {
+  const size_t i{first_failed()};
+  if (i == status_.size()) {
+    return;
+  }
+  std::ostringstream msg;
+  msg << what << ": " << (targets_[i].read ? "read" : "write") << " at 0x"
+      << std::hex << cycles_[i].address << std::dec << " (cycle " << i + 1
+      << " of " << cycles_.size() << ") failed with "
+      << status_name(status_[i]);
+  master_.throw_error(status_[i], msg.str());
+}
+
+template <class Master> void cycle_batch<Master>::clear() {
+  cycles_.clear();
+  targets_.clear();
+  status_.clear();
+  fences_.clear();
+}
+
+template <class Master>
+void cycle_batch<Master>::queue(const uint32_t address, const uint32_t am,
+                                const size_t width, const uint32_t data,
+                                const target& t) {
+  cycles_.push_back({address, data, am, static_cast<uint32_t>(width)});
+  targets_.push_back(t);
+  // cycles that were never submitted are considered failed
+  status_.push_back(vme::status::GENERIC_ERROR);
+}
+}
+}
+
+#endif
@@ -3,11 +3,17 @@
 
 #include <ctrlroom/vme/vme64.hpp>
 
+#include <type_traits>
+
 #define VME_FRIEND_MASTER(master_type)                                         \
   template <addressing_mode A, transfer_mode D>                                \
   friend struct ctrlroom::vme::master_impl::dispatch_read;                     \
   template <addressing_mode A, transfer_mode D>                                \
   friend struct ctrlroom::vme::master_impl::dispatch_write;                    \
+  template <addressing_mode A, transfer_mode D>                                \
+  friend struct ctrlroom::vme::master_impl::dispatch_fifo_read;                \
+  template <addressing_mode A, transfer_mode D>                                \
+  friend struct ctrlroom::vme::master_impl::dispatch_fifo_write;               \
   friend master_type;
 
 namespace ctrlroom {
@@ -16,10 +22,21 @@ namespace master_impl {
 // compile time "dispatch" of the correct block transfer function
 // (BLT, MBLT, MD32, 2eVME) using partial specialization on the
 // transfer_mode. Implements a static ::call method
-// method that calls the relevant _blt, _md32, _mblt, _2evme3 or _23vme6
+// method that calls the relevant _blt, _md32, _mblt, _2evme3 or _2evme6
 // method of the VME master module (through friendship)
 template <addressing_mode A, transfer_mode D> struct dispatch_read;
 template <addressing_mode A, transfer_mode D> struct dispatch_write;
+// same for FIFO (non-incrementing address) block transfers, calling the
+// _fifo_blt or _fifo_mblt method. Only available for BLT and MBLT.
+template <addressing_mode A, transfer_mode D> struct dispatch_fifo_read;
+template <addressing_mode A, transfer_mode D> struct dispatch_fifo_write;
+
+// compile time check if a dispatcher does FIFO transfers, in which case
+// consecutive blocks are all transferred from/to the same address
+template <template <addressing_mode, transfer_mode> class Dispatcher>
+struct is_fifo : std::false_type {};
+template <> struct is_fifo<dispatch_fifo_read> : std::true_type {};
+template <> struct is_fifo<dispatch_fifo_write> : std::true_type {};
 }
 }
 }
@@ -127,4 +144,56 @@ template <addressing_mode A> struct dispatch_write<A, transfer_mode::U6_2eVME> {
 }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Implementation: dispatch_fifo_read
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+namespace master_impl {
+// general one: for blt
+template <addressing_mode A, transfer_mode D> struct dispatch_fifo_read {
+  static_assert(!is_multiplexed<D>::value,
+                "FIFO block transfers only supported for BLT and MBLT");
+  template <class Master>
+  static unsigned
+  call(const Master& m, const typename address_spec<A>::ptr_type address,
+       typename transfer_spec<D>::ptr_type vptr, const unsigned n_requests) {
+    return m.impl().template read_fifo_blt<A, D>(address, vptr, n_requests);
+  }
+};
+template <addressing_mode A, transfer_mode D> struct dispatch_fifo_write {
+  static_assert(!is_multiplexed<D>::value,
+                "FIFO block transfers only supported for BLT and MBLT");
+  template <class Master>
+  static unsigned
+  call(const Master& m, const typename address_spec<A>::ptr_type address,
+       typename transfer_spec<D>::ptr_type vptr, const unsigned n_requests) {
+    return m.impl().template write_fifo_blt<A, D>(address, vptr, n_requests);
+  }
+};
+// specialization for mblt
+template <addressing_mode A>
+struct dispatch_fifo_read<A, transfer_mode::MBLT> {
+  template <class Master>
+  static unsigned call(const Master& m,
+                       const typename address_spec<A>::ptr_type address,
+                       transfer_spec<transfer_mode::MBLT>::ptr_type vptr,
+                       const unsigned n_requests) {
+    return m.impl().template read_fifo_mblt<A>(address, vptr, n_requests);
+  }
+};
+template <addressing_mode A>
+struct dispatch_fifo_write<A, transfer_mode::MBLT> {
+  template <class Master>
+  static unsigned call(const Master& m,
+                       const typename address_spec<A>::ptr_type address,
+                       transfer_spec<transfer_mode::MBLT>::ptr_type vptr,
+                       const unsigned n_requests) {
+    return m.impl().template write_fifo_mblt<A>(address, vptr, n_requests);
+  }
+};
+}
+}
+}
+
 #endif
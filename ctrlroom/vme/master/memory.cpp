@@ -0,0 +1,213 @@
+#include "memory.hpp"
+
+#include <ctrlroom/util/logger.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace ctrlroom::vme;
+
+namespace {
+constexpr size_t HUGE_PAGE_SIZE{2 * 1024 * 1024};
+
+// bookkeeping in front of every buffer (padded to TRANSFER_ALIGNMENT)
+struct header {
+  size_t size;   // usable size (in bytes)
+  size_t mapped; // size of the mapping, 0 for heap memory
+  size_t locked; // size of the locked (whole) pages, 0 if not locked
+};
+static_assert(sizeof(header) <= TRANSFER_ALIGNMENT,
+              "Transfer memory header does not fit in the alignment");
+
+std::mutex memory_mutex;
+memory_policy policy{false, false, true};
+bool policy_set{false};
+// pooled buffers by size
+std::map<size_t, std::vector<header*>> pool;
+size_t pooled_bytes{0};
+bool lock_warning{true};
+
+size_t round_up(const size_t n, const size_t unit) {
+  return (n + unit - 1) / unit * unit;
+}
+size_t page_size() {
+  static const size_t size{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+  return size;
+}
+
+header* map_buffer(const size_t size, const memory_policy p) {
+  const size_t total{size + TRANSFER_ALIGNMENT};
+  void* mem{nullptr};
+  size_t mapped{0};
+  if (p.hugepages && total >= HUGE_PAGE_SIZE) {
+    mapped = round_up(total, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+    mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#else
+    mem = MAP_FAILED;
+#endif
+    if (mem == MAP_FAILED) {
+      // no reserved huge pages, ask for transparent huge pages instead
+      mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (mem == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+#ifdef MADV_HUGEPAGE
+      madvise(mem, mapped, MADV_HUGEPAGE);
+#endif
+    }
+  } else {
+    // page aligned from a page on. Locked buffers always get whole pages
+    // of their own: mlock/munlock work on pages, and unlocking a buffer
+    // would otherwise also unlock the neighbouring allocations.
+    size_t alignment{TRANSFER_ALIGNMENT};
+    size_t length{total};
+    if (p.lock) {
+      alignment = page_size();
+      length = round_up(total, page_size());
+    } else if (total >= page_size()) {
+      alignment = page_size();
+    }
+    if (posix_memalign(&mem, alignment, length)) {
+      throw std::bad_alloc();
+    }
+  }
+  header* h{static_cast<header*>(mem)};
+  h->size = size;
+  h->mapped = mapped;
+  h->locked = 0;
+  if (p.lock) {
+    const size_t length{mapped ? mapped : round_up(total, page_size())};
+    if (mlock(mem, length) == 0) {
+      h->locked = length;
+    } else if (lock_warning) {
+      LOG_WARNING("transfer_memory",
+                  "Failed to lock transfer buffers in memory "
+                  "(check RLIMIT_MEMLOCK), continuing without");
+      lock_warning = false;
+    }
+  }
+  if (p.prefault) {
+    std::memset(static_cast<char*>(mem) + TRANSFER_ALIGNMENT, 0, size);
+  }
+  return h;
+}
+
+void unmap_buffer(header* h) {
+  if (h->locked) {
+    munlock(h, h->locked);
+  }
+  if (h->mapped) {
+    munmap(h, h->mapped);
+  } else {
+    free(h);
+  }
+}
+
+page_faults get_page_faults(const int who) {
+  rusage usage;
+  if (getrusage(who, &usage)) {
+    return {0, 0};
+  }
+  return {static_cast<uint64_t>(usage.ru_minflt),
+          static_cast<uint64_t>(usage.ru_majflt)};
+}
+}
+
+namespace ctrlroom {
+namespace vme {
+
+memory_policy transfer_memory_policy() {
+  std::lock_guard<std::mutex> lock{memory_mutex};
+  return policy;
+}
+void set_transfer_memory_policy(const memory_policy& p) {
+  std::lock_guard<std::mutex> lock{memory_mutex};
+  policy = p;
+  policy_set = true;
+}
+bool configure_transfer_memory_policy(const memory_policy& p) {
+  std::lock_guard<std::mutex> lock{memory_mutex};
+  if (!policy_set) {
+    policy = p;
+    policy_set = true;
+    return true;
+  }
+  return policy.hugepages == p.hugepages && policy.lock == p.lock &&
+         policy.prefault == p.prefault;
+}
+
+void* allocate_transfer_memory(const size_t bytes) {
+  const size_t size{round_up(bytes ? bytes : 1, TRANSFER_ALIGNMENT)};
+  memory_policy p;
+  {
+    std::lock_guard<std::mutex> lock{memory_mutex};
+    auto it = pool.find(size);
+    if (it != pool.end() && !it->second.empty()) {
+      header* h{it->second.back()};
+      it->second.pop_back();
+      pooled_bytes -= size;
+      return reinterpret_cast<char*>(h) + TRANSFER_ALIGNMENT;
+    }
+    p = policy;
+  }
+  return reinterpret_cast<char*>(map_buffer(size, p)) + TRANSFER_ALIGNMENT;
+}
+
+void free_transfer_memory(void* mem) noexcept {
+  if (!mem) {
+    return;
+  }
+  header* h{
+      reinterpret_cast<header*>(static_cast<char*>(mem) - TRANSFER_ALIGNMENT)};
+  {
+    std::lock_guard<std::mutex> lock{memory_mutex};
+    if (pooled_bytes + h->size <= MAX_POOLED_BYTES) {
+      try {
+        pool[h->size].push_back(h);
+        pooled_bytes += h->size;
+        return;
+      } catch (std::bad_alloc&) {
+        // no room to pool it, release it instead
+      }
+    }
+  }
+  unmap_buffer(h);
+}
+
+void trim_transfer_memory() {
+  std::lock_guard<std::mutex> lock{memory_mutex};
+  for (auto& sized : pool) {
+    for (header* h : sized.second) {
+      unmap_buffer(h);
+    }
+  }
+  pool.clear();
+  pooled_bytes = 0;
+}
+
+size_t pooled_transfer_memory() {
+  std::lock_guard<std::mutex> lock{memory_mutex};
+  return pooled_bytes;
+}
+
+// per-thread usage is Linux only
+page_faults thread_page_faults() {
+#ifdef __linux__
+  return get_page_faults(RUSAGE_THREAD);
+#else
+  return {0, 0};
+#endif
+}
+page_faults process_page_faults() { return get_page_faults(RUSAGE_SELF); }
+}
+}
@@ -0,0 +1,105 @@
+#ifndef CTRLROOM_VME_MASTER_MEMORY_LOADED
+#define CTRLROOM_VME_MASTER_MEMORY_LOADED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Memory for the targets of block transfers (BLT/MBLT/2eVME).
+//
+// A buffer that is touched for the first time by a transfer page-faults
+// in the middle of the readout. Transfer memory is
+//  * aligned to TRANSFER_ALIGNMENT (a cache line, also enough for the
+//    64-bit MBLT/2eVME words)
+//  * prefaulted when it is allocated: every page is touched by the
+//    allocating thread, which also places it on the NUMA node of that
+//    thread (first-touch policy). Allocate the buffers from the readout
+//    thread to keep them local to it.
+//  * (optionally) backed by huge pages, for buffers of at least a huge
+//    page (reserved huge pages if available, transparent huge pages
+//    otherwise)
+//  * (optionally) locked in memory (mlock, limited by RLIMIT_MEMLOCK),
+//    locked buffers are rounded up to whole pages of their own
+// Freed buffers are kept in a pool (up to MAX_POOLED_BYTES), and handed
+// out again for allocations of the same size, so buffers that are
+// created and destroyed for every run or calibration stay resident.
+//
+// The policy is process wide, and only set once: either explicitly by
+// the application (set_transfer_memory_policy), or by the first master
+// module with memory settings (cf. master.hpp). Masters configured with a
+// different policy are rejected, instead of silently overriding it.
+//
+// Usage:
+//    transfer_vector<uint64_t> buf(n_words);
+//    bridge.read_fifo<A32, MBLT>(address, buf);
+
+constexpr size_t TRANSFER_ALIGNMENT{64};
+constexpr size_t MAX_POOLED_BYTES{64 * 1024 * 1024};
+
+struct memory_policy {
+  bool hugepages; // huge pages for large buffers
+  bool lock;      // mlock the buffers
+  bool prefault;  // touch all pages on allocation
+};
+// the current policy (defaults to prefault only)
+memory_policy transfer_memory_policy();
+// set the policy (applies to buffers allocated from here on)
+void set_transfer_memory_policy(const memory_policy& policy);
+// set the policy unless it was already set, returns false if it was set
+// to a different policy
+bool configure_transfer_memory_policy(const memory_policy& policy);
+
+// allocate/free <bytes> of transfer memory (throws std::bad_alloc)
+void* allocate_transfer_memory(const size_t bytes);
+void free_transfer_memory(void* mem) noexcept;
+// release the pooled buffers back to the system
+void trim_transfer_memory();
+// number of bytes currently held in the pool
+size_t pooled_transfer_memory();
+
+// std::allocator for transfer memory
+template <class T> class transfer_allocator {
+public:
+  using value_type = T;
+
+  transfer_allocator() noexcept {}
+  template <class U>
+  transfer_allocator(const transfer_allocator<U>&) noexcept {}
+
+  T* allocate(const size_t n) {
+    return static_cast<T*>(allocate_transfer_memory(n * sizeof(T)));
+  }
+  void deallocate(T* p, const size_t) noexcept { free_transfer_memory(p); }
+};
+template <class T, class U>
+bool operator==(const transfer_allocator<T>&, const transfer_allocator<U>&) {
+  return true;
+}
+template <class T, class U>
+bool operator!=(const transfer_allocator<T>&, const transfer_allocator<U>&) {
+  return false;
+}
+
+template <class T>
+using transfer_vector = std::vector<T, transfer_allocator<T>>;
+
+// page faults (getrusage), to check that a run does not fault on the
+// readout path
+struct page_faults {
+  uint64_t minor; // no I/O needed (first touch, ...)
+  uint64_t major; // needed I/O (swapped out, ...)
+};
+inline page_faults operator-(const page_faults& a, const page_faults& b) {
+  return {a.minor - b.minor, a.major - b.major};
+}
+// for the calling thread (Linux only, zero elsewhere), and for the whole
+// process
+page_faults thread_page_faults();
+page_faults process_page_faults();
+}
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef CTRLROOM_VME_MASTER_SCHEDULER_LOADED
+#define CTRLROOM_VME_MASTER_SCHEDULER_LOADED
+
+#include <ctrlroom/vme/master/stats.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace ctrlroom {
+namespace vme {
+
+// priority classes for the calls to a master module, highest first
+enum class priority {
+  READOUT,      // event readout
+  NORMAL,       // default
+  SLOW_CONTROL, // monitoring, rate polling, ...
+  N_PRIORITIES
+};
+constexpr size_t N_PRIORITIES{static_cast<size_t>(priority::N_PRIORITIES)};
+
+// pause instruction for busy-wait loops
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// priority of the calls made by the current thread
+// (NORMAL unless changed by a priority_guard)
+inline priority& thread_priority() {
+  static thread_local priority p{priority::NORMAL};
+  return p;
+}
+
+// Set the priority of all calls made by the current thread, for the
+// lifetime of the guard.
+// Usage:
+//    void poll_rates() {
+//      priority_guard slow{priority::SLOW_CONTROL};
+//      scaler.read(...);
+//    }
+class priority_guard {
+public:
+  explicit priority_guard(const priority p) : previous_{thread_priority()} {
+    thread_priority() = p;
+  }
+  ~priority_guard() { thread_priority() = previous_; }
+  priority_guard(const priority_guard&) = delete;
+  priority_guard& operator=(const priority_guard&) = delete;
+
+private:
+  const priority previous_;
+};
+
+// snapshot of the queueing statistics for a single priority class
+struct priority_stats {
+  uint64_t requests; // number of calls
+  uint64_t combined; // calls executed by another thread
+  // time from submission until the call is started
+  latency_histogram::snapshot_type latency;
+};
+
+// Scheduler for the calls to a master module shared by multiple threads.
+//
+// All calls are executed one at a time, highest priority class first
+// (FIFO within a class). A call that is already running is never
+// interrupted, so a readout transfer can still wait for (at most) a
+// single slow-control call.
+//
+// Flat combining: calls are pushed onto a lock-free (Treiber) stack for
+// their priority class. The thread that gets the combiner flag executes
+// the pending calls of all threads, while the other threads wait for
+// their call to complete (or for the flag, should the combiner finish
+// before it got to their call). Once its own call is done, the combiner
+// does not run calls of a lower priority class than its own: it hands
+// the flag to the thread that submitted the next call instead, so a
+// readout thread never works off the slow-control backlog of the other
+// threads. An uncontended call costs a few atomic operations, and no
+// system calls. A waiting thread busy-waits for N_SPINS iterations, and
+// then blocks on a condition variable until its call is done or the
+// combiner flag is released (or handed to it).
+//
+// Exceptions thrown by a call are rethrown in the thread that
+// submitted it.
+class cycle_scheduler {
+public:
+  // number of busy-wait iterations before a waiting thread blocks
+  constexpr static size_t N_SPINS{128};
+
+  cycle_scheduler();
+
+  // run <call> (returning size_t) at the priority of the current thread,
+  // and return its result
+  template <class Call> size_t run(Call call);
+
+  priority_stats stats(const priority p) const;
+  void reset();
+
+private:
+  using clock_type = std::chrono::steady_clock;
+
+  struct request {
+    size_t (*fn)(void* ctx);
+    void* ctx;
+    size_t cls;
+    clock_type::time_point queued;
+    request* next;
+    size_t result;
+    std::exception_ptr error;
+    std::atomic<bool> done;
+    // the combiner flag was handed to the submitting thread
+    std::atomic<bool> handoff;
+  };
+
+  struct counters {
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> combined;
+    latency_histogram latency;
+  };
+
+  // scheduler the current thread is executing calls for (if any),
+  // calls submitted from within a call are run directly
+  static const cycle_scheduler*& combining() {
+    static thread_local const cycle_scheduler* s{nullptr};
+    return s;
+  }
+
+  void push(request* r);
+  // block until <r> is done, or the combiner flag is free or handed over
+  void sleep(const request& r);
+  // wake up the blocked threads (if any)
+  void wake();
+  // execute the pending calls (with the combiner flag taken), until they
+  // are all done or until <own> is done and only calls of a lower
+  // priority class are left. Releases or hands over the flag.
+  void combine(const request& own);
+  // next call in priority order, or nullptr
+  request* take_next();
+  void execute(request* r);
+
+  // submitted calls (LIFO) for every priority class
+  std::array<std::atomic<request*>, N_PRIORITIES> submitted_;
+  // calls taken by the combiner (FIFO), only used by the combiner
+  std::array<request*, N_PRIORITIES> pending_;
+  std::atomic<bool> busy_;
+  std::array<counters, N_PRIORITIES> counters_;
+  // blocked waiters
+  std::atomic<size_t> n_sleeping_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wakeup_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: cycle_scheduler
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+inline cycle_scheduler::cycle_scheduler() : busy_{false}, n_sleeping_{0} {
+  for (auto& s : submitted_) {
+    s.store(nullptr, std::memory_order_relaxed);
+  }
+  pending_.fill(nullptr);
+  reset();
+}
+
+template <class Call> size_t cycle_scheduler::run(Call call) {
+  if (combining() == this) {
+    return call();
+  }
+  request r;
+  r.fn = [](void* ctx) -> size_t { return (*static_cast<Call*>(ctx))(); };
+  r.ctx = &call;
+  r.cls = static_cast<size_t>(thread_priority());
+  r.queued = clock_type::now();
+  r.next = nullptr;
+  r.result = 0;
+  r.done.store(false, std::memory_order_relaxed);
+  r.handoff.store(false, std::memory_order_relaxed);
+  push(&r);
+  bool combined{true};
+  size_t n_spins{0};
+  while (!r.done.load(std::memory_order_acquire)) {
+    if (r.handoff.load() ||
+        (!busy_.load(std::memory_order_relaxed) &&
+         !busy_.exchange(true, std::memory_order_acquire))) {
+      if (!r.done.load(std::memory_order_acquire)) {
+        combined = false;
+      }
+      combine(r);
+      n_spins = 0;
+      continue;
+    }
+    if (++n_spins > N_SPINS) {
+      sleep(r);
+      n_spins = 0;
+    } else {
+      cpu_relax();
+    }
+  }
+  if (combined) {
+    counters_[r.cls].combined.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (r.error) {
+    std::rethrow_exception(r.error);
+  }
+  return r.result;
+}
+
+inline void cycle_scheduler::push(request* r) {
+  std::atomic<request*>& head = submitted_[r->cls];
+  request* next{head.load(std::memory_order_relaxed)};
+  do {
+    r->next = next;
+  } while (!head.compare_exchange_weak(next, r, std::memory_order_release,
+                                       std::memory_order_relaxed));
+}
+
+// The sequentially consistent accesses to <done>, <busy_> and
+// <n_sleeping_> ensure that either the waiter sees the change before it
+// blocks, or the combiner sees the waiter and notifies it.
+inline void cycle_scheduler::sleep(const request& r) {
+  std::unique_lock<std::mutex> lock{sleep_mutex_};
+  n_sleeping_.fetch_add(1);
+  wakeup_.wait(lock, [&] {
+    return r.done.load() || r.handoff.load() || !busy_.load();
+  });
+  n_sleeping_.fetch_sub(1);
+}
+
+inline void cycle_scheduler::wake() {
+  if (n_sleeping_.load()) {
+    // taking the lock orders the notification after the waiter's check
+    { std::lock_guard<std::mutex> lock{sleep_mutex_}; }
+    wakeup_.notify_all();
+  }
+}
+
+inline void cycle_scheduler::combine(const request& own) {
+  const cycle_scheduler* previous{combining()};
+  combining() = this;
+  request* r{nullptr};
+  while ((r = take_next())) {
+    if (own.done.load(std::memory_order_relaxed) && r->cls > own.cls) {
+      break;
+    }
+    execute(r);
+  }
+  combining() = previous;
+  if (r) {
+    // put <r> back in front of its class, and hand the flag (and the
+    // pending calls) to the thread that submitted it
+    r->next = pending_[r->cls];
+    pending_[r->cls] = r;
+    r->handoff.store(true);
+  } else {
+    busy_.store(false);
+  }
+  wake();
+}
+
+inline cycle_scheduler::request* cycle_scheduler::take_next() {
+  // highest priority first, the submitted stacks are only checked once
+  // the pending calls of their class are done
+  for (size_t cls{0}; cls < N_PRIORITIES; ++cls) {
+    if (!pending_[cls]) {
+      request* r{submitted_[cls].exchange(nullptr, std::memory_order_acquire)};
+      // reverse to submission order
+      request* fifo{nullptr};
+      while (r) {
+        request* next{r->next};
+        r->next = fifo;
+        fifo = r;
+        r = next;
+      }
+      pending_[cls] = fifo;
+    }
+    if (pending_[cls]) {
+      request* r{pending_[cls]};
+      pending_[cls] = r->next;
+      return r;
+    }
+  }
+  return nullptr;
+}
+
+inline void cycle_scheduler::execute(request* r) {
+  counters& c = counters_[r->cls];
+  c.requests.fetch_add(1, std::memory_order_relaxed);
+  c.latency.fill(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() -
+                                                           r->queued)
+          .count()));
+  try {
+    r->result = r->fn(r->ctx);
+  } catch (...) {
+    r->error = std::current_exception();
+  }
+  // <r> belongs to the submitting thread from here on
+  r->done.store(true);
+  wake();
+}
+
+inline priority_stats cycle_scheduler::stats(const priority p) const {
+  const counters& c = counters_[static_cast<size_t>(p)];
+  priority_stats s;
+  s.requests = c.requests.load(std::memory_order_relaxed);
+  s.combined = c.combined.load(std::memory_order_relaxed);
+  s.latency = c.latency.snapshot();
+  return s;
+}
+inline void cycle_scheduler::reset() {
+  for (auto& c : counters_) {
+    c.requests.store(0, std::memory_order_relaxed);
+    c.combined.store(0, std::memory_order_relaxed);
+    c.latency.reset();
+  }
+}
+}
+}
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef CTRLROOM_VME_MASTER_STATS_LOADED
+#define CTRLROOM_VME_MASTER_STATS_LOADED
+
+#include <ctrlroom/vme/vme64.hpp>
+#include <ctrlroom/vme/master/status.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace ctrlroom {
+namespace vme {
+
+// transfer paths through the master, one set of counters is kept for
+// every path. FIFO block transfers are counted with their normal
+// counterpart (BLT or MBLT), 2eVME transfers with BLT.
+enum class transfer_path {
+  SINGLE, // single cycles
+  BLT,    // D08/D16/D32 block transfers
+  MBLT,   // multiplexed 64-bit block transfers
+  MD32,   // multiplexed 32-bit block transfers
+  MULTI,  // batched single cycles
+  N_PATHS
+};
+constexpr size_t N_TRANSFER_PATHS{
+    static_cast<size_t>(transfer_path::N_PATHS)};
+
+// block transfer path for transfer mode D
+constexpr transfer_path block_path(const transfer_mode D) {
+  return (D == transfer_mode::MBLT)
+             ? transfer_path::MBLT
+             : (D == transfer_mode::MD32) ? transfer_path::MD32
+                                          : transfer_path::BLT;
+}
+
+// phases of an IRQ wait: busy polling, polling while yielding the CPU,
+// and a blocking wait (the only phase for blocking waits)
+enum class irq_phase { SPIN, YIELD, BLOCK, N_PHASES };
+constexpr size_t N_IRQ_PHASES{static_cast<size_t>(irq_phase::N_PHASES)};
+
+// the error types that are counted (SUCCESS is unused)
+constexpr size_t N_STATUS_CODES{
+    static_cast<size_t>(status::GENERIC_ERROR) + 1};
+
+// Log2-scaled latency histogram in [ns].
+// Bin i counts latencies in [2^i, 2^(i+1)) ns, with everything below 2ns
+// in bin 0 and everything above ~4s in the last bin.
+// Updates are single relaxed atomic increments, so the histogram can be
+// left on in production and filled from multiple threads.
+class latency_histogram {
+public:
+  constexpr static size_t N_BINS{32};
+  using snapshot_type = std::array<uint64_t, N_BINS>;
+
+  latency_histogram() { reset(); }
+
+  void fill(const uint64_t ns) {
+    bins_[bin(ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+  snapshot_type snapshot() const {
+    snapshot_type s;
+    for (size_t i{0}; i < N_BINS; ++i) {
+      s[i] = bins_[i].load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+  void reset() {
+    for (auto& b : bins_) {
+      b.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // lower edge of bin <i> in [ns]
+  static uint64_t lower_edge(const size_t i) { return uint64_t{1} << i; }
+  static size_t bin(uint64_t ns) {
+    size_t i{0};
+    while (ns > 1 && i < N_BINS - 1) {
+      ns >>= 1;
+      ++i;
+    }
+    return i;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, N_BINS> bins_;
+};
+
+// snapshot of the counters for a single transfer path
+struct path_stats {
+  uint64_t calls;           // number of calls to the master implementation
+  uint64_t bytes;           // number of bytes transferred
+  uint64_t short_transfers; // calls that moved less than requested
+  // errors by type (indexed by vme::status)
+  std::array<uint64_t, N_STATUS_CODES> errors;
+  latency_histogram::snapshot_type latency; // per call
+
+  uint64_t n_errors() const {
+    uint64_t n{0};
+    for (const auto e : errors) {
+      n += e;
+    }
+    return n;
+  }
+};
+
+// snapshot of the link round-trip probe
+struct link_stats {
+  uint64_t probes;      // number of probes
+  uint64_t last_ns;     // latency of the last probe
+  uint64_t failures;    // number of failed probes
+  latency_histogram::snapshot_type latency;
+};
+
+// snapshot of the IRQ wait statistics. The trigger-to-readout latency
+// is (at most) detection + readout.
+struct irq_stats {
+  uint64_t waits;    // number of waits
+  uint64_t timeouts; // waits that timed out
+  // IRQs detected in every phase (indexed by irq_phase)
+  std::array<uint64_t, N_IRQ_PHASES> hits;
+  // upper bound on the time between the IRQ and its detection: since the
+  // previous check of the IRQ lines when polling, or the duration of
+  // the blocking wait (indexed by irq_phase)
+  std::array<latency_histogram::snapshot_type, N_IRQ_PHASES> detection;
+  // from the detection until the start of the next VME call
+  latency_histogram::snapshot_type readout;
+};
+
+// snapshot of all master statistics
+struct master_stats {
+  std::array<path_stats, N_TRANSFER_PATHS> paths;
+  link_stats link;
+  irq_stats irq;
+
+  const path_stats& operator[](const transfer_path p) const {
+    return paths[static_cast<size_t>(p)];
+  }
+};
+
+// Thread-safe instrumentation counters for a master module
+// (cf. master<>::stats()).
+class transfer_stats {
+public:
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+
+  transfer_stats() { reset(); }
+
+  static time_point now() { return clock_type::now(); }
+
+  // record a call on path <p> that started at <start>
+  void record(const transfer_path p, const size_t bytes,
+              const bool short_transfer, const time_point start) {
+    counters& c = paths_[static_cast<size_t>(p)];
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (short_transfer) {
+      c.short_transfers.fetch_add(1, std::memory_order_relaxed);
+    }
+    c.latency.fill(elapsed(start));
+  }
+  // record an error of type <st> on path <p> (the failed call itself is
+  // also counted)
+  void record_error(const transfer_path p, const status st,
+                    const time_point start) {
+    counters& c = paths_[static_cast<size_t>(p)];
+    c.calls.fetch_add(1, std::memory_order_relaxed);
+    count_error(p, st);
+    c.latency.fill(elapsed(start));
+  }
+  // count an error without recording a call (e.g. for individual cycles
+  // in a batch)
+  void count_error(const transfer_path p, const status st) {
+    paths_[static_cast<size_t>(p)]
+        .errors[static_cast<size_t>(st)]
+        .fetch_add(1, std::memory_order_relaxed);
+  }
+  // record a link round-trip probe, returns the round-trip time in [ns]
+  uint64_t record_probe(const bool success, const time_point start) {
+    const uint64_t ns{elapsed(start)};
+    probes_.fetch_add(1, std::memory_order_relaxed);
+    if (!success) {
+      probe_failures_.fetch_add(1, std::memory_order_relaxed);
+      return ns;
+    }
+    last_probe_ns_.store(ns, std::memory_order_relaxed);
+    probe_latency_.fill(ns);
+    return ns;
+  }
+  // record an IRQ detected in <phase>, with <since> the last time the
+  // IRQ was known to be absent
+  void record_irq(const irq_phase phase, const time_point since) {
+    const time_point t{now()};
+    const size_t i{static_cast<size_t>(phase)};
+    irq_waits_.fetch_add(1, std::memory_order_relaxed);
+    irq_hits_[i].fetch_add(1, std::memory_order_relaxed);
+    irq_detection_[i].fill(elapsed(since, t));
+    irq_detected_.store(t.time_since_epoch().count(),
+                        std::memory_order_relaxed);
+  }
+  void record_irq_timeout() {
+    irq_waits_.fetch_add(1, std::memory_order_relaxed);
+    irq_timeouts_.fetch_add(1, std::memory_order_relaxed);
+  }
+  // record the start of a VME call at <start>, to time the readout
+  // response after an IRQ (only a relaxed load unless an IRQ was just
+  // detected)
+  void record_call_start(const time_point start) {
+    if (!irq_detected_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    const int64_t detected{irq_detected_.exchange(0)};
+    if (detected) {
+      irq_readout_.fill(
+          elapsed(time_point{clock_type::duration{detected}}, start));
+    }
+  }
+
+  master_stats snapshot() const;
+  void reset();
+
+private:
+  static uint64_t elapsed(const time_point start) {
+    return elapsed(start, now());
+  }
+  static uint64_t elapsed(const time_point start, const time_point stop) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+            .count());
+  }
+
+  struct counters {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> short_transfers;
+    std::array<std::atomic<uint64_t>, N_STATUS_CODES> errors;
+    latency_histogram latency;
+  };
+
+  std::array<counters, N_TRANSFER_PATHS> paths_;
+  std::atomic<uint64_t> probes_;
+  std::atomic<uint64_t> last_probe_ns_;
+  std::atomic<uint64_t> probe_failures_;
+  latency_histogram probe_latency_;
+  std::atomic<uint64_t> irq_waits_;
+  std::atomic<uint64_t> irq_timeouts_;
+  std::array<std::atomic<uint64_t>, N_IRQ_PHASES> irq_hits_;
+  std::array<latency_histogram, N_IRQ_PHASES> irq_detection_;
+  latency_histogram irq_readout_;
+  // time of the last IRQ detection (clock ticks since epoch), 0 once the
+  // readout started
+  std::atomic<int64_t> irq_detected_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: transfer_stats
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+inline master_stats transfer_stats::snapshot() const {
+  master_stats s;
+  for (size_t i{0}; i < N_TRANSFER_PATHS; ++i) {
+    const counters& c = paths_[i];
+    path_stats& p = s.paths[i];
+    p.calls = c.calls.load(std::memory_order_relaxed);
+    p.bytes = c.bytes.load(std::memory_order_relaxed);
+    p.short_transfers = c.short_transfers.load(std::memory_order_relaxed);
+    for (size_t j{0}; j < N_STATUS_CODES; ++j) {
+      p.errors[j] = c.errors[j].load(std::memory_order_relaxed);
+    }
+    p.latency = c.latency.snapshot();
+  }
+  s.link.probes = probes_.load(std::memory_order_relaxed);
+  s.link.last_ns = last_probe_ns_.load(std::memory_order_relaxed);
+  s.link.failures = probe_failures_.load(std::memory_order_relaxed);
+  s.link.latency = probe_latency_.snapshot();
+  s.irq.waits = irq_waits_.load(std::memory_order_relaxed);
+  s.irq.timeouts = irq_timeouts_.load(std::memory_order_relaxed);
+  for (size_t i{0}; i < N_IRQ_PHASES; ++i) {
+    s.irq.hits[i] = irq_hits_[i].load(std::memory_order_relaxed);
+    s.irq.detection[i] = irq_detection_[i].snapshot();
+  }
+  s.irq.readout = irq_readout_.snapshot();
+  return s;
+}
+inline void transfer_stats::reset() {
+  for (auto& c : paths_) {
+    c.calls.store(0, std::memory_order_relaxed);
+    c.bytes.store(0, std::memory_order_relaxed);
+    c.short_transfers.store(0, std::memory_order_relaxed);
+    for (auto& e : c.errors) {
+      e.store(0, std::memory_order_relaxed);
+    }
+    c.latency.reset();
+  }
+  probes_.store(0, std::memory_order_relaxed);
+  last_probe_ns_.store(0, std::memory_order_relaxed);
+  probe_failures_.store(0, std::memory_order_relaxed);
+  probe_latency_.reset();
+  irq_waits_.store(0, std::memory_order_relaxed);
+  irq_timeouts_.store(0, std::memory_order_relaxed);
+  for (size_t i{0}; i < N_IRQ_PHASES; ++i) {
+    irq_hits_[i].store(0, std::memory_order_relaxed);
+    irq_detection_[i].reset();
+  }
+  irq_readout_.reset();
+  irq_detected_.store(0, std::memory_order_relaxed);
+}
+}
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef CTRLROOM_VME_MASTER_STATUS_LOADED
+#define CTRLROOM_VME_MASTER_STATUS_LOADED
+
+#include <cstdint>
+
+namespace ctrlroom {
+namespace vme {
+
+// status code for a single VME cycle, used by the interfaces that report
+// problems per cycle instead of throwing a vme::error
+// (the error types match the vme::error hierarchy in master.hpp)
+enum class status : int8_t {
+  SUCCESS = 0,
+  BUS_ERROR,
+  COMM_ERROR,
+  INVALID_PARAMETER,
+  TIMEOUT_ERROR,
+  GENERIC_ERROR
+};
+
+// printable name of <st>, for error messages
+inline const char* status_name(const status st) {
+  switch (st) {
+  case status::SUCCESS:
+    return "success";
+  case status::BUS_ERROR:
+    return "bus error";
+  case status::COMM_ERROR:
+    return "communication error";
+  case status::INVALID_PARAMETER:
+    return "invalid parameter";
+  case status::TIMEOUT_ERROR:
+    return "timeout";
+  default:
+    return "generic error";
+  }
+}
+}
+}
+
+#endif
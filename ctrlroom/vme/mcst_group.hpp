@@ -0,0 +1,150 @@
+#ifndef CTRLROOM_VME_MCST_GROUP_LOADED
+#define CTRLROOM_VME_MCST_GROUP_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Multicast (MCST) group of slaves of the same type, to write common
+// settings (start/stop, thresholds, ...) to all member boards at once.
+//
+// When all members share the same MCST address (<id>.mcstAddress), a
+// write to the group is a single A32 write cycle to the MCST address
+// space. Otherwise (e.g. for boards that do not support MCST), the group
+// falls back to a batch with a write to each member, which is still a
+// single call to the master.
+//
+// Usage:
+//    mcst_group<board_type> group{"discriminators"};
+//    group.add(disc0);
+//    group.add(disc1);
+//    group.write(instructions::PATTERN_INHIBITOR, 0xFFFF);
+//
+// The write shadows of the members (cf. slave.hpp) are updated for
+// every group write: set on success, forgotten on failure. Group writes
+// are never skipped by the shadow.
+//
+// The group holds references to its members, they have to outlive it.
+template <class Slave> class mcst_group {
+public:
+  using slave_type = Slave;
+  using master_type = typename slave_type::master_type;
+  using address_type = typename slave_type::address_type;
+  using single_data_type = typename slave_type::single_data_type;
+
+  explicit mcst_group(const std::string& name) : name_{name} {}
+
+  // add a member board (all members should share the same master)
+  void add(const slave_type& s);
+  size_t size() const { return members_.size(); }
+
+  // true if writes to the group are single multicast cycles
+  bool multicast() const;
+
+  // write <val> to register <a> of all member boards
+  // returns the number of boards that were successfully written to
+  size_t write(address_type a, single_data_type val) const;
+
+private:
+  // update the write shadow of all members after a group write
+  void update_shadows(address_type a, single_data_type val,
+                      const bool good) const;
+
+  const std::string name_;
+  std::vector<const slave_type*> members_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: mcst_group
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Slave> void mcst_group<Slave>::add(const slave_type& s) {
+  if (!members_.empty()) {
+    tassert(s.master() == members_.front()->master(),
+            "All members of MCST group " + name_ +
+                " should share the same master");
+  }
+  members_.push_back(&s);
+  LOG_INFO(name_, "Added " + s.name() + " to the MCST group");
+}
+
+template <class Slave> bool mcst_group<Slave>::multicast() const {
+  if (members_.empty() || !members_.front()->has_mcst()) {
+    return false;
+  }
+  for (const auto* m : members_) {
+    if (!m->has_mcst() ||
+        m->mcst_address() != members_.front()->mcst_address()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class Slave>
+size_t mcst_group<Slave>::write(address_type a, single_data_type val) const {
+  if (members_.empty()) {
+    return 0;
+  }
+  if (multicast()) {
+    size_t n{0};
+    try {
+      n = members_.front()->write_multicast(a, val);
+    } catch (vme::error&) {
+      // unknown state after a failed write
+      update_shadows(a, val, false);
+      throw;
+    }
+    update_shadows(a, val, n);
+    return n ? members_.size() : 0;
+  }
+  auto batch = members_.front()->master()->batch();
+  for (const auto* m : members_) {
+    batch.template write<slave_type::addressing, slave_type::single_transfer>(
+        m->base_address() + a, val);
+  }
+  size_t n_good{0};
+  try {
+    n_good = batch.submit();
+  } catch (vme::error&) {
+    update_shadows(a, val, false);
+    throw;
+  }
+  for (size_t i{0}; i < members_.size(); ++i) {
+    if (batch.cycle_status(i) == vme::status::SUCCESS) {
+      members_[i]->set_shadow(a, val);
+    } else {
+      members_[i]->invalidate_shadow(a);
+    }
+  }
+  return n_good;
+}
+
+template <class Slave>
+void mcst_group<Slave>::update_shadows(address_type a, single_data_type val,
+                                       const bool good) const {
+  for (const auto* m : members_) {
+    if (good) {
+      m->set_shadow(a, val);
+    } else {
+      m->invalidate_shadow(a);
+    }
+  }
+}
+}
+}
+
+#endif
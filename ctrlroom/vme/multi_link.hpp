@@ -0,0 +1,337 @@
+#ifndef CTRLROOM_VME_MULTI_LINK_LOADED
+#define CTRLROOM_VME_MULTI_LINK_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/configuration.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ctrlroom {
+namespace vme {
+
+// Parallel readout engine for multiple VME links (e.g. several optical
+// links on an A3818, or several crates).
+//
+// The engine owns one master module per link, each one driven by its own
+// readout thread. Every thread repeatedly calls the readout function for
+// its link, which should wait for the next trigger (IRQ) and read the
+// boards on that link into an event. The events from all links are
+// merged into a single output queue, tagged with their link index and a
+// per-link sequence number.
+//
+// Usage:
+//    multi_link<caen_bridge, my_event> engine{"readout"};
+//    auto m0 = engine.add_link("vme0", settings, read_crate0);
+//    auto m1 = engine.add_link("vme1", settings, read_crate1);
+//    // ... set up the boards on m0 and m1
+//    engine.start();
+//    while (auto ev = engine.next()) {
+//      // process ev->data (from link ev->link)
+//      engine.recycle(std::move(ev));
+//    }
+//
+// Event objects are re-used through recycle() to avoid allocations in the
+// readout loop. When the output queue is full, the readout threads wait
+// for the consumer (back-pressure). The readout threads run their VME
+// calls at priority::READOUT (cf. master/scheduler.hpp), so the link
+// masters can be shared with slow-control threads.
+//
+// CONFIGURATION FILE OPTIONS (in the settings of every link master)
+// optional
+//      * CPU core to pin the readout thread to: <id>.readoutCPU
+//        (default: not pinned)
+template <class Master, class Event> class multi_link {
+public:
+  using master_type = Master;
+  using event_type = Event;
+  // readout function for a single link. Should throw a vme::timeout_error
+  // when no trigger arrived (cf. master<>::wait_for_irq()), in which case
+  // the readout is simply retried.
+  using readout_type = std::function<void(master_type&, event_type&)>;
+
+  constexpr static const char* READOUT_CPU_KEY{"readoutCPU"};
+  constexpr static size_t DEFAULT_QUEUE_SIZE{64};
+
+  // merged output event
+  struct tagged_event {
+    size_t link;     // index of the link (order of add_link())
+    uint64_t seq;    // per-link sequence number
+    event_type data;
+  };
+  using event_ptr = std::unique_ptr<tagged_event>;
+
+  multi_link(const std::string& name, size_t queue_size = DEFAULT_QUEUE_SIZE);
+  ~multi_link();
+
+  // create the master for a new link from <settings>, and register its
+  // readout function. Only possible while the engine is stopped.
+  std::shared_ptr<master_type> add_link(const std::string& identifier,
+                                        const ptree& settings,
+                                        readout_type readout);
+
+  size_t n_links() const { return links_.size(); }
+  std::shared_ptr<master_type> link(const size_t i) const {
+    return links_[i]->master;
+  }
+
+  // start/stop the readout threads
+  // stop() can take up to the IRQ timeout of the masters to return. It
+  // always joins all readout threads, also the ones that already ended
+  // because of an error. start() can be called again after such an error.
+  void start();
+  void stop();
+  bool running() const { return running_; }
+
+  // next merged event (blocking), a nullptr is returned once the engine
+  // is stopped and the queue is empty. Events that were read out before
+  // the engine was stopped are still returned. Problems encountered by
+  // any of the readout threads are rethrown here.
+  event_ptr next();
+  // hand an event back for re-use
+  void recycle(event_ptr ev);
+
+  // number of events read out from link <i>, and the number of times
+  // its thread had to wait for a full output queue
+  uint64_t n_events(const size_t i) const { return links_[i]->n_events; }
+  uint64_t n_stalls(const size_t i) const { return links_[i]->n_stalls; }
+
+private:
+  struct link_type {
+    std::shared_ptr<master_type> master;
+    readout_type readout;
+    int cpu; // -1: not pinned
+    std::thread thread;
+    std::atomic<uint64_t> n_events;
+    std::atomic<uint64_t> n_stalls;
+  };
+
+  void readout(link_type& l, const size_t index);
+  void pin(link_type& l) const;
+  event_ptr get_free();
+  // push a filled event, waits while the queue is full.
+  // The event is always queued, returns false if the engine was stopped
+  // (while waiting)
+  bool push(link_type& l, event_ptr ev);
+
+  const std::string name_;
+  const size_t queue_size_;
+  std::vector<std::unique_ptr<link_type>> links_;
+
+  std::deque<event_ptr> queue_;
+  std::vector<event_ptr> free_;
+  std::atomic<bool> running_;
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable data_cond_;  // signaled when events are queued
+  std::condition_variable space_cond_; // signaled when events are taken
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: multi_link
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Master, class Event>
+multi_link<Master, Event>::multi_link(const std::string& name,
+                                      size_t queue_size)
+    : name_{name}, queue_size_{queue_size}, running_{false} {
+  tassert(queue_size_ > 0, "Invalid multi-link queue size");
+}
+template <class Master, class Event> multi_link<Master, Event>::~multi_link() {
+  stop();
+}
+
+template <class Master, class Event>
+std::shared_ptr<Master>
+multi_link<Master, Event>::add_link(const std::string& identifier,
+                                    const ptree& settings,
+                                    readout_type readout) {
+  tassert(!running_, "Cannot add a link to a running multi-link readout");
+  tassert(readout, "Invalid readout function");
+  std::unique_ptr<link_type> l{new link_type};
+  l->master = std::make_shared<master_type>(identifier, settings);
+  l->readout = std::move(readout);
+  auto cpu = l->master->conf().template get_optional<int>(READOUT_CPU_KEY);
+  l->cpu = cpu ? *cpu : -1;
+  l->n_events = 0;
+  l->n_stalls = 0;
+  links_.push_back(std::move(l));
+  LOG_INFO(name_, "Added link '" + identifier + "'");
+  return links_.back()->master;
+}
+
+template <class Master, class Event> void multi_link<Master, Event>::start() {
+  if (running_) {
+    return;
+  }
+  // the threads of a previous run that ended on a readout error are still
+  // joinable, and have to be joined before they can be replaced
+  stop();
+  LOG_INFO(name_, "Starting readout of " + std::to_string(links_.size()) +
+                      " links");
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    error_ = nullptr;
+  }
+  running_ = true;
+  for (size_t i{0}; i < links_.size(); ++i) {
+    link_type& l = *links_[i];
+    l.thread = std::thread{&multi_link::readout, this, std::ref(l), i};
+  }
+}
+template <class Master, class Event> void multi_link<Master, Event>::stop() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    running_ = false;
+  }
+  data_cond_.notify_all();
+  space_cond_.notify_all();
+  for (auto& l : links_) {
+    if (l->thread.joinable()) {
+      l->thread.join();
+      LOG_INFO(name_, "Link '" + l->master->name() + "' stopped after " +
+                          std::to_string(l->n_events) + " events (" +
+                          std::to_string(l->n_stalls) + " readout stalls)");
+    }
+  }
+}
+
+template <class Master, class Event>
+auto multi_link<Master, Event>::next() -> event_ptr {
+  std::unique_lock<std::mutex> lock{mutex_};
+  data_cond_.wait(lock, [this] { return !queue_.empty() || !running_; });
+  if (queue_.empty()) {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return nullptr;
+  }
+  event_ptr ev{std::move(queue_.front())};
+  queue_.pop_front();
+  lock.unlock();
+  space_cond_.notify_one();
+  return ev;
+}
+template <class Master, class Event>
+void multi_link<Master, Event>::recycle(event_ptr ev) {
+  if (!ev) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{mutex_};
+  free_.push_back(std::move(ev));
+}
+
+template <class Master, class Event>
+void multi_link<Master, Event>::readout(link_type& l, const size_t index) {
+  pin(l);
+  // the readout goes before any slow-control calls from other threads
+  priority_guard readout_priority{priority::READOUT};
+  uint64_t seq{0};
+  try {
+    while (running_) {
+      event_ptr ev{get_free()};
+      try {
+        l.readout(*l.master, ev->data);
+      } catch (vme::timeout_error&) {
+        // no trigger yet, check if we are still running
+        recycle(std::move(ev));
+        continue;
+      }
+      ev->link = index;
+      ev->seq = seq++;
+      ++l.n_events;
+      if (!push(l, std::move(ev))) {
+        break;
+      }
+    }
+  } catch (...) {
+    LOG_ERROR(name_, "Readout of link '" + l.master->name() + "' failed");
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+      running_ = false;
+    }
+    data_cond_.notify_all();
+    space_cond_.notify_all();
+  }
+}
+
+template <class Master, class Event>
+void multi_link<Master, Event>::pin(link_type& l) const {
+  if (l.cpu < 0) {
+    return;
+  }
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(l.cpu, &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus)) {
+    LOG_WARNING(name_, "Failed to pin the readout thread of '" +
+                           l.master->name() + "' to CPU " +
+                           std::to_string(l.cpu));
+    return;
+  }
+  LOG_INFO(name_, "Readout thread of '" + l.master->name() +
+                      "' pinned to CPU " + std::to_string(l.cpu));
+#else
+  LOG_WARNING(name_, "Thread pinning not supported on this platform");
+#endif
+}
+
+template <class Master, class Event>
+auto multi_link<Master, Event>::get_free() -> event_ptr {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (!free_.empty()) {
+      event_ptr ev{std::move(free_.back())};
+      free_.pop_back();
+      return ev;
+    }
+  }
+  return event_ptr{new tagged_event()};
+}
+
+template <class Master, class Event>
+bool multi_link<Master, Event>::push(link_type& l, event_ptr ev) {
+  std::unique_lock<std::mutex> lock{mutex_};
+  if (queue_.size() >= queue_size_) {
+    ++l.n_stalls;
+    space_cond_.wait(lock, [this] {
+      return queue_.size() < queue_size_ || !running_;
+    });
+  }
+  // an event that was read out before the engine was stopped is still
+  // handed to the consumer, also when that exceeds the queue size
+  const bool running{running_};
+  queue_.push_back(std::move(ev));
+  lock.unlock();
+  data_cond_.notify_one();
+  return running;
+}
+}
+}
+
+#endif
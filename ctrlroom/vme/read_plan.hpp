@@ -0,0 +1,275 @@
+#ifndef CTRLROOM_VME_READ_PLAN_LOADED
+#define CTRLROOM_VME_READ_PLAN_LOADED
+
+#include <ctrlroom/vme/vme64.hpp>
+#include <ctrlroom/vme/master/status.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Read of a set of slave registers in as few VME calls as possible.
+//
+// The registers are added up front (add() returns a handle to the
+// value), read() then
+//  * merges runs of registers with at most <max_gap> unrequested bytes
+//    in between into a single BLT read, when the block transfer mode of
+//    the slave has the same width as its single cycles. By default
+//    (max_gap 0), only contiguous registers are merged. With a larger
+//    gap, the unrequested words in between are read and dropped: only
+//    opt in when none of them are clear-on-read or FIFO registers,
+//  * reads all other registers in a single batch of single cycles
+//    (a single MultiRead call on the CAEN bridges, cf. master/batch.hpp).
+// Split 16-bit registers (split_register<A>) are added by their two
+// halves, and returned as the combined value.
+//
+// Usage:
+//    auto plan = b.plan();
+//    const auto count = plan.add(instructions::TRIG_COUNT.LSB,
+//                                instructions::TRIG_COUNT.MSB);
+//    const auto mode = plan.add(instructions::MODE_REGISTER);
+//    const auto regs = plan.read();
+//    regs.check("Problem reading the trigger registers");
+//    uint16_t n_triggers{regs[count]};
+//
+// The plan is made on the first read(), and re-used by later reads
+// (adding registers invalidates it).
+template <class Slave> class read_plan {
+public:
+  using slave_type = Slave;
+  using address_type = typename slave_type::address_type;
+  using single_data_type = typename slave_type::single_data_type;
+  using blt_data_type = typename slave_type::blt_data_type;
+
+  constexpr static size_t DEFAULT_MAX_GAP{0}; // in bytes
+  constexpr static size_t WIDTH{
+      transfer_spec<slave_type::single_transfer>::WIDTH};
+  // block reads need BLT words that line up with the registers
+  constexpr static bool BLOCK_READS{
+      slave_type::blt_transfer != transfer_mode::DISABLED &&
+      !is_multiplexed<slave_type::blt_transfer>::value &&
+      transfer_spec<slave_type::blt_transfer>::WIDTH == WIDTH};
+
+  // handles to the planned registers
+  struct reg {
+    size_t index;
+  };
+  struct split_reg {
+    size_t lsb;
+    size_t msb;
+  };
+
+  // values read by read(), by handle
+  class result {
+  public:
+    single_data_type operator[](const reg r) const { return values_[r.index]; }
+    uint16_t operator[](const split_reg r) const {
+      return static_cast<uint16_t>((values_[r.lsb] & 0xFF) |
+                                   ((values_[r.msb] & 0xFF) << 8));
+    }
+    vme::status status(const reg r) const { return status_[r.index]; }
+    vme::status status(const split_reg r) const {
+      return status_[r.lsb] != vme::status::SUCCESS ? status_[r.lsb]
+                                                    : status_[r.msb];
+    }
+    // true if all registers were read
+    bool good() const;
+    // throw the vme::error matching the status of the first register
+    // that was not read (if any), naming <what> and its address
+    void check(const std::string& what) const;
+
+  private:
+    friend read_plan;
+    const slave_type* slave_;
+    std::vector<address_type> addresses_;
+    std::vector<single_data_type> values_;
+    std::vector<vme::status> status_;
+  };
+
+  explicit read_plan(const slave_type& s,
+                     const size_t max_gap = DEFAULT_MAX_GAP)
+      : slave_(s), max_gap_{max_gap}, planned_{false} {}
+
+  // add register <a> (relative to the slave base address). Registers
+  // that are added more than once are only read once.
+  reg add(const address_type a);
+  // add a split 16-bit register by its halves (pass the members of the
+  // split_register<A>, the constexpr instructions have no definition)
+  split_reg add(const address_type lsb, const address_type msb) {
+    return {add(lsb).index, add(msb).index};
+  }
+
+  // number of registers
+  size_t size() const { return addresses_.size(); }
+  // number of VME calls needed for read()
+  size_t n_calls() const;
+
+  // read all registers. Failures are reported per register, only
+  // problems affecting the whole batch of single cycles are thrown.
+  result read() const;
+
+private:
+  // registers read as a single BLT read
+  struct block {
+    address_type first;
+    size_t n_words;
+    std::vector<size_t> registers;
+  };
+
+  void plan() const;
+
+  const slave_type& slave_;
+  const size_t max_gap_;
+  std::vector<address_type> addresses_; // by handle
+  mutable bool planned_;
+  mutable std::vector<block> blocks_;
+  // registers read with single cycles
+  mutable std::vector<size_t> singles_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: read_plan
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Slave> bool read_plan<Slave>::result::good() const {
+  return std::all_of(status_.begin(), status_.end(), [](const vme::status s) {
+    return s == vme::status::SUCCESS;
+  });
+}
+
+template <class Slave>
+void read_plan<Slave>::result::check(const std::string& what) const {
+  const auto failed =
+      std::find_if(status_.begin(), status_.end(), [](const vme::status s) {
+        return s != vme::status::SUCCESS;
+      });
+  if (failed == status_.end()) {
+    return;
+  }
+  const size_t i{static_cast<size_t>(failed - status_.begin())};
+  std::ostringstream msg;
+  msg << what << ": read at 0x" << std::hex
+      << slave_->base_address() + addresses_[i] << std::dec << " (register "
+      << i + 1 << " of " << status_.size() << ") failed with "
+      << status_name(*failed);
+  slave_->master()->throw_error(*failed, msg.str());
+}
+
+template <class Slave>
+typename read_plan<Slave>::reg read_plan<Slave>::add(const address_type a) {
+  auto it = std::find(addresses_.begin(), addresses_.end(), a);
+  if (it != addresses_.end()) {
+    return {static_cast<size_t>(it - addresses_.begin())};
+  }
+  addresses_.push_back(a);
+  planned_ = false;
+  return {addresses_.size() - 1};
+}
+
+template <class Slave> size_t read_plan<Slave>::n_calls() const {
+  if (!planned_) {
+    plan();
+  }
+  return blocks_.size() + (singles_.empty() ? 0 : 1);
+}
+
+template <class Slave> void read_plan<Slave>::plan() const {
+  blocks_.clear();
+  singles_.clear();
+  std::vector<size_t> order(addresses_.size());
+  for (size_t i{0}; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](const size_t i, const size_t j) {
+    return addresses_[i] < addresses_[j];
+  });
+  // close the current run: a block if it merged at least 2 registers
+  block run{0, 0, {}};
+  auto close = [&]() {
+    if (run.registers.size() > 1) {
+      blocks_.push_back(run);
+    } else if (run.registers.size() == 1) {
+      singles_.push_back(run.registers.front());
+    }
+    run.registers.clear();
+  };
+  for (const size_t i : order) {
+    const address_type a{addresses_[i]};
+    if (!run.registers.empty()) {
+      const address_type last{addresses_[run.registers.back()]};
+      const size_t offset{static_cast<size_t>(a - run.first)};
+      if (BLOCK_READS && static_cast<size_t>(a - last) <= WIDTH + max_gap_ &&
+          offset % WIDTH == 0 &&
+          offset / WIDTH <
+              transfer_spec<slave_type::blt_transfer>::BLOCK_LENGTH) {
+        run.n_words = offset / WIDTH + 1;
+        run.registers.push_back(i);
+        continue;
+      }
+      close();
+    }
+    run.first = a;
+    run.n_words = 1;
+    run.registers.push_back(i);
+  }
+  close();
+  planned_ = true;
+}
+
+template <class Slave>
+typename read_plan<Slave>::result read_plan<Slave>::read() const {
+  if (!planned_) {
+    plan();
+  }
+  result res;
+  res.slave_ = &slave_;
+  res.addresses_ = addresses_;
+  res.values_.assign(addresses_.size(), 0);
+  res.status_.assign(addresses_.size(), vme::status::SUCCESS);
+  if (!singles_.empty()) {
+    auto batch = slave_.batch();
+    for (const size_t i : singles_) {
+      batch.read(addresses_[i], res.values_[i]);
+    }
+    batch.submit();
+    for (size_t j{0}; j < singles_.size(); ++j) {
+      res.status_[singles_[j]] = batch.cycle_status(j);
+    }
+  }
+  std::vector<blt_data_type> words;
+  for (const auto& b : blocks_) {
+    words.assign(b.n_words, 0);
+    size_t n_done{0};
+    const vme::status st{
+        slave_.master()
+            ->template try_read<slave_type::addressing,
+                                slave_type::blt_transfer>(
+                slave_.base_address() + b.first, words.data(), b.n_words,
+                n_done)};
+    for (const size_t i : b.registers) {
+      const size_t word{static_cast<size_t>(addresses_[i] - b.first) / WIDTH};
+      if (word < n_done) {
+        res.values_[i] = static_cast<single_data_type>(words[word]);
+      } else {
+        // a short read without error is a failure for the missing words
+        res.status_[i] =
+            (st != vme::status::SUCCESS) ? st : vme::status::GENERIC_ERROR;
+      }
+    }
+  }
+  return res;
+}
+}
+}
+
+#endif
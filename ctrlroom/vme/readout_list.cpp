@@ -0,0 +1,10 @@
+#include "readout_list.hpp"
+
+namespace ctrlroom {
+namespace vme {
+const translation_map<readout_entry> READOUT_ENTRY_TRANSLATOR{
+    {"status", readout_entry::STATUS},
+    {"single", readout_entry::SINGLE},
+    {"block", readout_entry::BLOCK}};
+}
+}
@@ -0,0 +1,499 @@
+#ifndef CTRLROOM_VME_READOUT_LIST_LOADED
+#define CTRLROOM_VME_READOUT_LIST_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/assert.hpp>
+#include <ctrlroom/util/configuration.hpp>
+#include <ctrlroom/util/logger.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// what a readout list entry reads for every trigger
+enum class readout_entry {
+  STATUS, // single cycle, read before the data blocks
+  SINGLE, // single cycle, read after the data blocks
+  BLOCK   // block transfer (BLT/MBLT, FIFO or incrementing)
+};
+// readout entry translator is defined in readout_list.cpp
+extern const translation_map<readout_entry> READOUT_ENTRY_TRANSLATOR;
+
+// Per-trigger readout of a crate (all slaves on a single master), as a
+// declarative list of what to read: status registers, single registers
+// and data blocks.
+//
+// The list is compiled once (on the first read(), or explicitly through
+// compile()) into a fixed sequence of master calls:
+//  1. all STATUS entries, as a single batch of single cycles
+//     (a single MultiRead call on the CAEN bridges)
+//  2. all BLOCK entries, in the order they were added, each as a single
+//     exception-free block read (try_read/try_read_fifo) into its
+//     preallocated part of the data buffer
+//  3. all SINGLE entries, as a single batch of single cycles
+// When there are no blocks, the STATUS and SINGLE entries share a
+// single batch. read() then runs the whole sequence without allocating
+// memory and without virtual calls (the block reads are called through
+// function pointers resolved when the entry is added).
+//
+// Failed entries do not throw, their status is reported per entry
+// (communication problems affecting a whole batch are still thrown by
+// the master). A FIFO block ended by a bus error (the FIFO was drained
+// before <max_words>) is not a failure.
+//
+// Usage:
+//    readout_list<caen_bridge> list{bridge};
+//    const size_t ready = list.add_status(adc, instructions::STATUS);
+//    const size_t data = list.add_block(adc, instructions::FIFO, 4096);
+//    list.load(bridge->conf()); // (optional) entries from the settings
+//    while (running) {
+//      bridge->wait_for_irq();
+//      list.read();
+//      process(list.value(ready), list.data<uint64_t>(data),
+//              list.n_words(data));
+//    }
+//
+// CONFIGURATION FILE OPTIONS (for load(), relative to the configuration
+// <conf> it is called with):
+//      * entries: <id>.readout.list ([name0, name1, ...])
+//      * for each entry <name>:
+//        * type: <id>.readout.<name>.type (status, single or block)
+//        * address: <id>.readout.<name>.address (full VME address, e.g.
+//          "0xAA001000")
+//        * addressing mode: <id>.readout.<name>.addressing
+//          (A16, A24 or A32, only A24 or A32 for blocks)
+//        * transfer mode: <id>.readout.<name>.transfer
+//          (D16 or D32, or MBLT for blocks)
+//      * blocks only:
+//        * buffer size (in words of the transfer mode):
+//          <id>.readout.<name>.maxWords
+//        * FIFO readout: <id>.readout.<name>.fifo (defaults to true)
+template <class Master> class readout_list {
+public:
+  constexpr static const char* READOUT_KEY{"readout"};
+  constexpr static const char* LIST_KEY{"list"};
+  constexpr static const char* TYPE_KEY{"type"};
+  constexpr static const char* ADDRESS_KEY{"address"};
+  constexpr static const char* ADDRESSING_KEY{"addressing"};
+  constexpr static const char* TRANSFER_KEY{"transfer"};
+  constexpr static const char* MAX_WORDS_KEY{"maxWords"};
+  constexpr static const char* FIFO_KEY{"fifo"};
+
+  using master_type = Master;
+
+  explicit readout_list(std::shared_ptr<master_type> master);
+
+  // add an entry for an absolute VME <address>, and return its index
+  //  * STATUS/SINGLE: single cycles (up to A32, D32)
+  //  * BLOCK: block read of up to <max_words> words of D
+  //    (D16/D32 BLT or MBLT), from a FIFO port or from incrementing
+  //    addresses
+  template <addressing_mode A, transfer_mode D>
+  size_t add_status(const std::string& name,
+                    const typename address_spec<A>::ptr_type address);
+  template <addressing_mode A, transfer_mode D>
+  size_t add_single(const std::string& name,
+                    const typename address_spec<A>::ptr_type address);
+  template <addressing_mode A, transfer_mode D>
+  size_t add_block(const std::string& name,
+                   const typename address_spec<A>::ptr_type address,
+                   const size_t max_words, const bool fifo = true);
+  // same for register <a> of slave <s>, with the slave's own addressing
+  // and (single or block) transfer modes
+  template <class Slave>
+  size_t add_status(const Slave& s, const typename Slave::address_type a);
+  template <class Slave>
+  size_t add_single(const Slave& s, const typename Slave::address_type a);
+  template <class Slave>
+  size_t add_block(const Slave& s, const typename Slave::address_type a,
+                   const size_t max_words, const bool fifo = true);
+  // runtime version of all of the above (used by load())
+  size_t add(const std::string& name, const readout_entry type,
+             const addressing_mode A, const transfer_mode D,
+             const uint32_t address, const size_t max_words = 0,
+             const bool fifo = true);
+  // add the entries configured in <conf> (cf. CONFIGURATION FILE OPTIONS)
+  void load(const configuration& conf);
+
+  size_t size() const { return entries_.size(); }
+
+  // build the call sequence and allocate the buffers
+  // (called by read() if needed, adding entries invalidates it)
+  void compile();
+  // number of master calls made by a single read()
+  size_t n_calls() const;
+
+  // read all entries, returns the number of entries read successfully
+  size_t read();
+
+  // results of the last read() for entry <i>
+  const std::string& entry_name(const size_t i) const {
+    return entries_[i].name;
+  }
+  vme::status entry_status(const size_t i) const {
+    return results_[i].status;
+  }
+  // true if all entries were read successfully
+  bool good() const;
+  // STATUS/SINGLE value
+  uint32_t value(const size_t i) const { return results_[i].value; }
+  // BLOCK data: <n_words> words of the block transfer width
+  // (the words read before the first error for failed blocks)
+  template <class Word> const Word* data(const size_t i) const {
+    return reinterpret_cast<const Word*>(buffer_.data() +
+                                         entries_[i].offset);
+  }
+  size_t n_words(const size_t i) const { return results_[i].n_words; }
+  size_t n_bytes(const size_t i) const {
+    return results_[i].n_words * entries_[i].width;
+  }
+
+private:
+  // exception-free block read of <n> words to <dest>
+  using block_reader = vme::status (*)(const master_type& m,
+                                       const uint32_t address, void* dest,
+                                       const size_t n, size_t& n_done);
+  template <addressing_mode A, transfer_mode D, bool FIFO>
+  static vme::status read_block(const master_type& m, const uint32_t address,
+                                void* dest, const size_t n,
+                                size_t& n_done) noexcept;
+  block_reader get_reader(const addressing_mode A, const transfer_mode D,
+                          const bool fifo) const;
+
+  struct entry_type {
+    std::string name;
+    readout_entry type;
+    uint32_t address;
+    uint32_t am;    // single cycles only
+    size_t width;   // in bytes
+    size_t max_words;
+    bool fifo;
+    block_reader reader;
+    size_t offset; // of the block data in buffer_ (in words)
+  };
+  struct result_type {
+    vme::status status;
+    uint32_t value;
+    size_t n_words;
+  };
+  using batch_type = typename master_type::batch_type;
+
+  // queue the single-cycle entries of <type> in <batch>
+  void queue(batch_type& batch, const readout_entry type);
+  // submit <batch>, and store the status for the entries in <index>
+  void submit(batch_type& batch, const std::vector<size_t>& index);
+
+  std::shared_ptr<master_type> master_;
+  std::vector<entry_type> entries_;
+  std::vector<result_type> results_;
+  bool compiled_;
+  // compiled call sequence
+  batch_type status_batch_;
+  batch_type single_batch_;
+  std::vector<size_t> status_index_; // entries in status_batch_
+  std::vector<size_t> single_index_; // entries in single_batch_
+  std::vector<size_t> blocks_;
+  // block data, 64-bit words to keep every block aligned for MBLT
+  transfer_vector<uint64_t> buffer_;
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: readout_list
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Master>
+readout_list<Master>::readout_list(std::shared_ptr<master_type> master)
+    : master_{std::move(master)}
+    , compiled_{false}
+    , status_batch_{master_->batch()}
+    , single_batch_{master_->batch()} {
+  tassert(master_, "Invalid pointer to master module");
+}
+
+template <class Master>
+template <addressing_mode A, transfer_mode D>
+size_t readout_list<Master>::add_status(
+    const std::string& name, const typename address_spec<A>::ptr_type address) {
+  return add(name, readout_entry::STATUS, A, D, address);
+}
+template <class Master>
+template <addressing_mode A, transfer_mode D>
+size_t readout_list<Master>::add_single(
+    const std::string& name, const typename address_spec<A>::ptr_type address) {
+  return add(name, readout_entry::SINGLE, A, D, address);
+}
+template <class Master>
+template <addressing_mode A, transfer_mode D>
+size_t readout_list<Master>::add_block(
+    const std::string& name, const typename address_spec<A>::ptr_type address,
+    const size_t max_words, const bool fifo) {
+  return add(name, readout_entry::BLOCK, A, D, address, max_words, fifo);
+}
+template <class Master>
+template <class Slave>
+size_t readout_list<Master>::add_status(const Slave& s,
+                                        const typename Slave::address_type a) {
+  tassert(s.master() == master_, "Slave " + s.name() +
+                                     " is not on the master of the list");
+  return add(s.name(), readout_entry::STATUS, Slave::addressing,
+             Slave::single_transfer, s.base_address() + a);
+}
+template <class Master>
+template <class Slave>
+size_t readout_list<Master>::add_single(const Slave& s,
+                                        const typename Slave::address_type a) {
+  tassert(s.master() == master_, "Slave " + s.name() +
+                                     " is not on the master of the list");
+  return add(s.name(), readout_entry::SINGLE, Slave::addressing,
+             Slave::single_transfer, s.base_address() + a);
+}
+template <class Master>
+template <class Slave>
+size_t readout_list<Master>::add_block(const Slave& s,
+                                       const typename Slave::address_type a,
+                                       const size_t max_words,
+                                       const bool fifo) {
+  tassert(s.master() == master_, "Slave " + s.name() +
+                                     " is not on the master of the list");
+  return add(s.name(), readout_entry::BLOCK, Slave::addressing,
+             Slave::blt_transfer, s.base_address() + a, max_words, fifo);
+}
+
+template <class Master>
+size_t readout_list<Master>::add(const std::string& name,
+                                 const readout_entry type,
+                                 const addressing_mode A,
+                                 const transfer_mode D,
+                                 const uint32_t address,
+                                 const size_t max_words, const bool fifo) {
+  entry_type e{name, type, address, 0, 0, 0, fifo, nullptr, 0};
+  if (type == readout_entry::BLOCK) {
+    if (max_words == 0) {
+      throw master_->invalid_parameter("Empty readout block for " + name);
+    }
+    e.reader = get_reader(A, D, fifo);
+    e.max_words = max_words;
+    e.width = (D == transfer_mode::D16) ? 2 : (D == transfer_mode::D32) ? 4 : 8;
+  } else {
+    switch (A) {
+    case addressing_mode::A16:
+      e.am = address_spec<addressing_mode::A16>::DATA;
+      break;
+    case addressing_mode::A24:
+      e.am = address_spec<addressing_mode::A24>::DATA;
+      break;
+    case addressing_mode::A32:
+      e.am = address_spec<addressing_mode::A32>::DATA;
+      break;
+    default:
+      throw master_->invalid_parameter(
+          "Single cycle readout entries only support up to A32 (for " + name +
+          ")");
+    }
+    if (D == transfer_mode::D16) {
+      e.width = 2;
+    } else if (D == transfer_mode::D32) {
+      e.width = 4;
+    } else {
+      throw master_->invalid_parameter(
+          "Single cycle readout entries only support D16 and D32 (for " +
+          name + ")");
+    }
+  }
+  entries_.push_back(e);
+  compiled_ = false;
+  return entries_.size() - 1;
+}
+
+template <class Master>
+void readout_list<Master>::load(const configuration& conf) {
+  const std::string root{std::string(READOUT_KEY) + "."};
+  const auto names = conf.get_optional_vector<std::string>(root + LIST_KEY);
+  if (!names) {
+    return;
+  }
+  for (const auto& name : *names) {
+    const std::string key{root + name + "."};
+    const readout_entry type{
+        conf.get(key + TYPE_KEY, READOUT_ENTRY_TRANSLATOR)};
+    const std::string address_str{conf.get<std::string>(key + ADDRESS_KEY)};
+    const uint32_t address{
+        static_cast<uint32_t>(std::stoll(address_str, nullptr, 0))};
+    const addressing_mode A{
+        conf.get(key + ADDRESSING_KEY, ADDRESSING_MODE_TRANSLATOR)};
+    const transfer_mode D{
+        conf.get(key + TRANSFER_KEY, TRANSFER_MODE_TRANSLATOR)};
+    size_t max_words{0};
+    bool fifo{true};
+    if (type == readout_entry::BLOCK) {
+      max_words = conf.get<size_t>(key + MAX_WORDS_KEY);
+      if (max_words == 0) {
+        throw conf.value_error(key + MAX_WORDS_KEY, "0");
+      }
+      fifo = conf.get_optional<bool>(key + FIFO_KEY).get_value_or(true);
+    }
+    add(name, type, A, D, address, max_words, fifo);
+  }
+  LOG_INFO(master_->name(), "Loaded " + std::to_string(names->size()) +
+                                " readout list entries");
+}
+
+template <class Master> void readout_list<Master>::compile() {
+  status_batch_.clear();
+  single_batch_.clear();
+  status_index_.clear();
+  single_index_.clear();
+  blocks_.clear();
+  results_.assign(entries_.size(), {vme::status::GENERIC_ERROR, 0, 0});
+  // block buffers, every block starts at a 64-bit boundary
+  size_t n_words{0};
+  for (size_t i{0}; i < entries_.size(); ++i) {
+    auto& e = entries_[i];
+    if (e.type == readout_entry::BLOCK) {
+      e.offset = n_words;
+      n_words += (e.max_words * e.width + sizeof(uint64_t) - 1) /
+                 sizeof(uint64_t);
+      blocks_.push_back(i);
+    }
+  }
+  buffer_.assign(n_words, 0);
+  // single cycles (the batches hold references to results_, which is
+  // not resized until the next compile())
+  queue(status_batch_, readout_entry::STATUS);
+  queue(blocks_.empty() ? status_batch_ : single_batch_, readout_entry::SINGLE);
+  status_index_.reserve(status_batch_.size());
+  single_index_.reserve(single_batch_.size());
+  for (size_t i{0}; i < entries_.size(); ++i) {
+    const auto type = entries_[i].type;
+    if (type == readout_entry::STATUS ||
+        (type == readout_entry::SINGLE && blocks_.empty())) {
+      status_index_.push_back(i);
+    } else if (type == readout_entry::SINGLE) {
+      single_index_.push_back(i);
+    }
+  }
+  compiled_ = true;
+  LOG_INFO(master_->name(), "Readout list compiled: " +
+                                std::to_string(entries_.size()) +
+                                " entries in " + std::to_string(n_calls()) +
+                                " calls, " +
+                                std::to_string(n_words * sizeof(uint64_t)) +
+                                " bytes of block buffers");
+}
+
+template <class Master> size_t readout_list<Master>::n_calls() const {
+  return blocks_.size() + (status_batch_.empty() ? 0 : 1) +
+         (single_batch_.empty() ? 0 : 1);
+}
+
+template <class Master> size_t readout_list<Master>::read() {
+  if (!compiled_) {
+    compile();
+  }
+  submit(status_batch_, status_index_);
+  for (const size_t i : blocks_) {
+    const auto& e = entries_[i];
+    auto& r = results_[i];
+    r.n_words = 0;
+    r.status = e.reader(*master_, e.address, buffer_.data() + e.offset,
+                        e.max_words, r.n_words);
+    // a bus error is the normal end of a FIFO readout
+    if (e.fifo && r.status == vme::status::BUS_ERROR) {
+      r.status = vme::status::SUCCESS;
+    }
+  }
+  submit(single_batch_, single_index_);
+  size_t n_good{0};
+  for (const auto& r : results_) {
+    if (r.status == vme::status::SUCCESS) {
+      ++n_good;
+    }
+  }
+  return n_good;
+}
+
+template <class Master> bool readout_list<Master>::good() const {
+  for (const auto& r : results_) {
+    if (r.status != vme::status::SUCCESS) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class Master>
+void readout_list<Master>::queue(batch_type& batch, const readout_entry type) {
+  for (size_t i{0}; i < entries_.size(); ++i) {
+    const auto& e = entries_[i];
+    if (e.type == type) {
+      batch.read(e.address, e.am, e.width, results_[i].value);
+    }
+  }
+}
+
+template <class Master>
+void readout_list<Master>::submit(batch_type& batch,
+                                  const std::vector<size_t>& index) {
+  if (batch.empty()) {
+    return;
+  }
+  batch.submit();
+  for (size_t j{0}; j < index.size(); ++j) {
+    results_[index[j]].status = batch.cycle_status(j);
+  }
+}
+
+template <class Master>
+template <addressing_mode A, transfer_mode D, bool FIFO>
+vme::status readout_list<Master>::read_block(const master_type& m,
+                                             const uint32_t address,
+                                             void* dest, const size_t n,
+                                             size_t& n_done) noexcept {
+  using value_type = typename transfer_spec<D>::value_type;
+  auto* vals = static_cast<value_type*>(dest);
+  return FIFO ? m.template try_read_fifo<A, D>(address, vals, n, n_done)
+              : m.template try_read<A, D>(address, vals, n, n_done);
+}
+
+template <class Master>
+typename readout_list<Master>::block_reader
+readout_list<Master>::get_reader(const addressing_mode A,
+                                 const transfer_mode D,
+                                 const bool fifo) const {
+  constexpr auto A24 = addressing_mode::A24;
+  constexpr auto A32 = addressing_mode::A32;
+  constexpr auto D16 = transfer_mode::D16;
+  constexpr auto D32 = transfer_mode::D32;
+  constexpr auto MBLT = transfer_mode::MBLT;
+  if (A == A24 && D == D16) {
+    return fifo ? &read_block<A24, D16, true> : &read_block<A24, D16, false>;
+  } else if (A == A24 && D == D32) {
+    return fifo ? &read_block<A24, D32, true> : &read_block<A24, D32, false>;
+  } else if (A == A24 && D == MBLT) {
+    return fifo ? &read_block<A24, MBLT, true> : &read_block<A24, MBLT, false>;
+  } else if (A == A32 && D == D16) {
+    return fifo ? &read_block<A32, D16, true> : &read_block<A32, D16, false>;
+  } else if (A == A32 && D == D32) {
+    return fifo ? &read_block<A32, D32, true> : &read_block<A32, D32, false>;
+  } else if (A == A32 && D == MBLT) {
+    return fifo ? &read_block<A32, MBLT, true> : &read_block<A32, MBLT, false>;
+  }
+  throw master_->invalid_parameter(
+      "Block readout entries only support A24/A32 with D16, D32 or MBLT");
+}
+}
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include "replay_bridge.hpp"
+
+#include <cstring>
+#include <map>
+#include <thread>
+
+using namespace ctrlroom::vme;
+
+namespace {
+const ctrlroom::translation_map<replay_bridge::timing> TIMINGS{
+    {"original", replay_bridge::timing::ORIGINAL},
+    {"fast", replay_bridge::timing::FAST}};
+
+const std::map<trace_op, std::string> OP_NAMES{
+    {trace_op::READ, "READ"},
+    {trace_op::WRITE, "WRITE"},
+    {trace_op::FIFO_READ, "FIFO_READ"},
+    {trace_op::FIFO_WRITE, "FIFO_WRITE"},
+    {trace_op::CBLT_READ, "CBLT_READ"},
+    {trace_op::MULTI_READ, "MULTI_READ"},
+    {trace_op::MULTI_WRITE, "MULTI_WRITE"},
+    {trace_op::IACK, "IACK"},
+    {trace_op::IRQ_CHECK, "IRQ_CHECK"},
+    {trace_op::IRQ_WAIT, "IRQ_WAIT"},
+    {trace_op::PING, "PING"},
+    {trace_op::RMW, "RMW"}};
+
+std::string describe(const trace_op op, const uint64_t address,
+                     const uint32_t am, const size_t width,
+                     const size_t n_requests) {
+  return OP_NAMES.at(op) + " (address: " + std::to_string(address) +
+         ", AM: " + std::to_string(am) + ", width: " + std::to_string(width) +
+         ", requests: " + std::to_string(n_requests) + ")";
+}
+}
+
+replay_bridge::replay_bridge(const std::string& identifier,
+                             const ptree& settings)
+    : replay_bridge::base_type{identifier, settings}
+    , records_{read_trace(conf_.get<std::string>(TRACE_FILE_KEY))}
+    , timing_{conf_.get_optional(REPLAY_TIMING_KEY, TIMINGS)
+                  .get_value_or(timing::FAST)}
+    , pos_{0}
+    , n_mismatches_{0} {
+  LOG_INFO(name(), "Replaying " + std::to_string(records_.size()) +
+                       " trace records from '" +
+                       conf_.get<std::string>(TRACE_FILE_KEY) + "'");
+}
+
+void replay_bridge::wait_for_irq(size_t) const {
+  replay(trace_op::IRQ_WAIT, 0, 0, 0, 1, nullptr);
+}
+
+size_t replay_bridge::position() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return pos_;
+}
+void replay_bridge::rewind() {
+  std::lock_guard<std::mutex> lock{mutex_};
+  pos_ = 0;
+}
+size_t replay_bridge::n_mismatches() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return n_mismatches_;
+}
+
+uint8_t replay_bridge::check_irq() const {
+  uint8_t mask{0};
+  replay(trace_op::IRQ_CHECK, 0, 0, 1, 1, &mask);
+  return mask;
+}
+
+void replay_bridge::ping() const {
+  replay(trace_op::PING, 0, 0, 0, 1, nullptr);
+}
+
+size_t replay_bridge::read_multi(single_cycle* cycles, status* st,
+                                 size_t n) const {
+  return multi(cycles, st, n, true);
+}
+size_t replay_bridge::write_multi(single_cycle* cycles, status* st,
+                                  size_t n) const {
+  return multi(cycles, st, n, false);
+}
+
+size_t replay_bridge::multi(single_cycle* cycles, status* st, size_t n,
+                            const bool read) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  const trace_record& batch = next(
+      read ? trace_op::MULTI_READ : trace_op::MULTI_WRITE, 0, 0, 0, n);
+  wait(batch);
+  throw_status(batch);
+  const trace_op op{read ? trace_op::READ : trace_op::WRITE};
+  size_t n_good{0};
+  for (size_t i{0}; i < n; ++i) {
+    const trace_record& rec = next(op, cycles[i].address, cycles[i].am,
+                                   cycles[i].width, 1);
+    st[i] = rec.result;
+    if (rec.result != status::SUCCESS) {
+      continue;
+    }
+    ++n_good;
+    if (read) {
+      cycles[i].data = rec.value();
+    } else if (cycles[i].data != rec.value()) {
+      ++n_mismatches_;
+      LOG_WARNING(name(), "Write data differs from the trace for " +
+                              describe(op, cycles[i].address, cycles[i].am,
+                                       cycles[i].width, 1));
+    }
+  }
+  return n_good;
+}
+
+size_t replay_bridge::replay(const trace_op op, const uint64_t address,
+                             const uint32_t am, const size_t width,
+                             const size_t n_requests, void* data) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  const trace_record& rec = next(op, address, am, width, n_requests);
+  wait(rec);
+  if (rec.result != status::SUCCESS) {
+    if (!status_sink_) {
+      throw_status(rec);
+    }
+    *status_sink_ = rec.result;
+  }
+  // written data (the first part of the data for RMW)
+  const size_t n_written{rec.is_read() ? 0 : n_requests * width};
+  if (n_written && std::memcmp(data, rec.data.data(), n_written)) {
+    ++n_mismatches_;
+    LOG_WARNING(name(), "Write data differs from the trace for " +
+                            describe(op, address, am, width, n_requests));
+  }
+  // read data
+  if (rec.data.size() > n_written &&
+      (rec.is_read() || op == trace_op::RMW)) {
+    std::memcpy(data, rec.data.data() + n_written,
+                rec.data.size() - n_written);
+  }
+  return rec.n_done;
+}
+
+const trace_record& replay_bridge::next(const trace_op op,
+                                        const uint64_t address,
+                                        const uint32_t am, const size_t width,
+                                        const size_t n_requests) const {
+  if (pos_ >= records_.size()) {
+    throw error("End of trace reached at " +
+                describe(op, address, am, width, n_requests));
+  }
+  const trace_record& rec = records_[pos_];
+  if (rec.op != op || rec.address != address || rec.am != am ||
+      rec.width != width || rec.n_requests != n_requests) {
+    throw error("Trace mismatch at record " + std::to_string(pos_) +
+                ": expected " +
+                describe(rec.op, rec.address, rec.am, rec.width,
+                         rec.n_requests) +
+                ", got " + describe(op, address, am, width, n_requests));
+  }
+  if (pos_ == 0) {
+    start_ = clock_type::now() - std::chrono::nanoseconds(rec.timestamp);
+  }
+  ++pos_;
+  return rec;
+}
+
+void replay_bridge::wait(const trace_record& rec) const {
+  if (timing_ == timing::FAST) {
+    return;
+  }
+  std::this_thread::sleep_until(
+      start_ + std::chrono::nanoseconds(rec.timestamp + rec.duration));
+}
+
+void replay_bridge::throw_status(const trace_record& rec) const {
+  if (rec.result == status::SUCCESS) {
+    return;
+  }
+  const std::string msg{"Replayed error for " +
+                        describe(rec.op, rec.address, rec.am, rec.width,
+                                 rec.n_requests)};
+  throw_error(rec.result, msg);
+}
@@ -0,0 +1,267 @@
+#ifndef CTRLROOM_VME_REPLAY_BRIDGE_LOADED
+#define CTRLROOM_VME_REPLAY_BRIDGE_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/trace.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Replay master module, serving the responses from a VME trace recorded
+// by trace_recorder<> (cf. trace.hpp), so the readout and processing
+// stack can be run without the actual crate.
+//
+// Every call to the replay master is matched against the next record in
+// the trace (type, address, modifier, data width and number of
+// requests); a call that does not match throws a vme::error. Reads
+// return the recorded data, recorded errors are thrown as the matching
+// vme::error, and writes that differ from the recorded data are logged.
+// As a consequence, the calls have to be made in the same order as during
+// the recording (i.e. the same configuration and readout code).
+//
+// Timing:
+//      * ORIGINAL: every call ends at the same time (relative to the
+//        first call) as the recorded call, or immediately if the caller
+//        is already late
+//      * FAST: calls return immediately
+//
+// CONFIGURATION FILE OPTIONS (on top of the master options)
+//      * trace file name: <id>.traceFile
+// optional
+//      * replay timing: <id>.replayTiming ("original" or "fast",
+//        defaults to "fast")
+class replay_bridge : public vme::master<replay_bridge> {
+public:
+  using base_type = vme::master<replay_bridge>;
+
+  constexpr static const char* TRACE_FILE_KEY{"traceFile"};
+  constexpr static const char* REPLAY_TIMING_KEY{"replayTiming"};
+
+  enum class timing { ORIGINAL, FAST };
+
+  replay_bridge(const std::string& identifier, const ptree& settings);
+
+  // wait for the next IRQ
+  void wait_for_irq() const;
+  void wait_for_irq(size_t timeout) const;
+
+  // number of records in the trace, and the number of records
+  // replayed so far
+  size_t size() const { return records_.size(); }
+  size_t position() const;
+  bool done() const { return position() == size(); }
+  // start over from the beginning of the trace
+  void rewind();
+
+  // number of writes with data different from the trace
+  size_t n_mismatches() const;
+
+protected:
+  // Single
+  template <addressing_mode A, transfer_mode D>
+  size_t read_single(const typename address_spec<A>::ptr_type address,
+                     typename transfer_spec<D>::ptr_type val) const {
+    return replay(trace_op::READ, address, address_spec<A>::DATA,
+                  transfer_spec<D>::WIDTH, 1, val);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_single(const typename address_spec<A>::ptr_type address,
+                      typename transfer_spec<D>::ptr_type val) const {
+    return replay(trace_op::WRITE, address, address_spec<A>::DATA,
+                  transfer_spec<D>::WIDTH, 1, val);
+  }
+  // RMW
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const {
+    return replay(trace_op::RMW, address, address_spec<A>::DATA,
+                  transfer_spec<D>::WIDTH, 1, val);
+  }
+  // BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_blt(const typename address_spec<A>::ptr_type address,
+                  typename transfer_spec<D>::ptr_type buf,
+                  size_t n_requests) const {
+    return block<A, D>(trace_op::READ, address, buf, n_requests);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_blt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, D>(trace_op::WRITE, address, buf, n_requests);
+  }
+  // MD32
+  template <addressing_mode A>
+  size_t read_md32(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MD32>(trace_op::READ, address, buf,
+                                         n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_md32(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MD32>(trace_op::WRITE, address, buf,
+                                         n_requests);
+  }
+  // MBLT
+  template <addressing_mode A>
+  size_t read_mblt(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(trace_op::READ, address, buf,
+                                         n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_mblt(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(trace_op::WRITE, address, buf,
+                                         n_requests);
+  }
+  // 2eVME (3U)
+  template <addressing_mode A>
+  size_t read_2evme3(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME>(trace_op::READ, address, buf,
+                                             n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_2evme3(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME>(trace_op::WRITE, address, buf,
+                                             n_requests);
+  }
+  // 2eVME (6U)
+  template <addressing_mode A>
+  size_t read_2evme6(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME>(trace_op::READ, address, buf,
+                                             n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_2evme6(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME>(trace_op::WRITE, address, buf,
+                                             n_requests);
+  }
+  // CBLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, D>(trace_op::CBLT_READ, address, buf, n_requests);
+  }
+  // MULTI (batched single cycles)
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  // IRQ
+  template <transfer_mode D>
+  size_t iack(const irq_level level,
+              typename transfer_spec<D>::ptr_type vector) const {
+    return replay(trace_op::IACK, 0, static_cast<uint32_t>(level),
+                  transfer_spec<D>::WIDTH, 1, vector);
+  }
+  uint8_t check_irq() const;
+  // PING
+  void ping() const;
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const {
+    return block<A, D>(trace_op::FIFO_READ, address, buf, n_requests);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, D>(trace_op::FIFO_WRITE, address, buf, n_requests);
+  }
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(trace_op::FIFO_READ, address, buf,
+                                         n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(trace_op::FIFO_WRITE, address, buf,
+                                         n_requests);
+  }
+
+private:
+  using clock_type = std::chrono::steady_clock;
+
+  template <addressing_mode A, transfer_mode D>
+  size_t block(const trace_op op,
+               const typename address_spec<A>::ptr_type address,
+               typename transfer_spec<D>::ptr_type buf,
+               size_t n_requests) const {
+    return replay(op, address, deduce_block_modifier<A, D>(),
+                  transfer_spec<D>::WIDTH, n_requests, buf);
+  }
+
+  // replay the next record, which should match the call. Read data is
+  // copied to <data>, write data is compared with <data> (for RMW, the
+  // written value is compared, and replaced by the previous value).
+  // Returns the number of completed transactions, or throws the
+  // recorded error (or reports it through the status sink).
+  size_t replay(const trace_op op, const uint64_t address, const uint32_t am,
+                const size_t width, const size_t n_requests,
+                void* data) const;
+  // get the next record and check it against the call
+  // (call with the mutex locked)
+  const trace_record& next(const trace_op op, const uint64_t address,
+                           const uint32_t am, const size_t width,
+                           const size_t n_requests) const;
+  // wait until the recorded end of <rec> (for ORIGINAL timing)
+  void wait(const trace_record& rec) const;
+  // throw the vme::error for a recorded error status
+  void throw_status(const trace_record& rec) const;
+
+  // DRY implementation of read_multi() and write_multi()
+  size_t multi(single_cycle* cycles, vme::status* st, size_t n,
+               const bool read) const;
+
+  const std::vector<trace_record> records_;
+  const timing timing_;
+  mutable size_t pos_;
+  mutable size_t n_mismatches_;
+  // replay time of the start of the trace (set by the first call)
+  mutable clock_type::time_point start_;
+  // calls are replayed one at a time, in order
+  mutable std::mutex mutex_;
+
+  VME_FRIEND_MASTER(base_type);
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: replay_bridge
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+inline void replay_bridge::wait_for_irq() const { wait_for_irq(timeout_); }
+}
+}
+
+#endif
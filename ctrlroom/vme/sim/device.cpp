@@ -0,0 +1,50 @@
+#include "device.hpp"
+
+#include <ctrlroom/vme/master.hpp>
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+device::device(const std::string& name, const configuration& conf,
+               const uint32_t size)
+    : name_{name}
+    , address_{static_cast<uint32_t>(
+          std::stoll(conf.get<std::string>(ADDRESS_KEY), nullptr, 0))}
+    , size_{size}
+    , irq_{conf.get_optional(IRQ_KEY, IRQ_TRANSLATOR)
+               .get_value_or(irq_level::IRQ1)}
+    , irq_vector_{conf.get_optional<uint32_t>(IRQ_VECTOR_KEY).get_value_or(0)} {
+  if (address_ % size_) {
+    throw conf.value_error(ADDRESS_KEY, conf.get<std::string>(ADDRESS_KEY));
+  }
+}
+
+bool device::decodes(const uint32_t address, const uint32_t am,
+                     uint32_t& offset) const {
+  switch (am_addressing(am)) {
+  case addressing_mode::A24:
+    offset = (address - address_) & 0xFFFFFF;
+    break;
+  case addressing_mode::A32:
+    offset = address - address_;
+    break;
+  default:
+    return false;
+  }
+  return offset < size_;
+}
+
+addressing_mode am_addressing(const uint32_t am) {
+  // data, program, BLT and MBLT modifiers (privileged or not)
+  if (am >= 0x38 && am <= 0x3F) {
+    return addressing_mode::A24;
+  }
+  if (am >= 0x08 && am <= 0x0F) {
+    return addressing_mode::A32;
+  }
+  return addressing_mode::A16;
+}
+}
+}
+}
@@ -0,0 +1,95 @@
+#ifndef CTRLROOM_VME_SIM_DEVICE_LOADED
+#define CTRLROOM_VME_SIM_DEVICE_LOADED
+
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/configuration.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+using clock_type = std::chrono::steady_clock;
+
+// Behavioral model of a VME slave, plugged into a sim_bridge
+// (cf. sim_bridge.hpp).
+//
+// A device decodes a window of <size> bytes at its base address, both in
+// A32 (full address) and in A24 (lower 24 bits of the address), like the
+// CAEN boards. Models implement the single cycles at an offset in the
+// window; block transfers are split into single cycles by the bridge.
+// A cycle that the device does not answer (no register at the offset,
+// wrong data width, reading a write-only register, ...) returns false,
+// and ends as a bus error on the bridge.
+//
+// IRQs: a device asserts its IRQ level from irq_time() on (the bridge
+// calls update() first). IRQ waits on the bridge sleep until the first
+// IRQ of all devices, there is no polling.
+//
+// Devices are only accessed by the bridge, with the bridge lock held,
+// so the models do not need any locking of their own.
+//
+// CONFIGURATION FILE OPTIONS (relative to the device configuration,
+// cf. sim_bridge.hpp)
+//      * base address: <dev>.address (e.g. "0xAA000000")
+// optional
+//      * IRQ level: <dev>.irq (IRQ1, ..., IRQ7, defaults to IRQ1)
+//      * IRQ vector (returned by IACK cycles): <dev>.irqVector
+//        (defaults to 0)
+class device {
+public:
+  constexpr static const char* ADDRESS_KEY{"address"};
+  constexpr static const char* IRQ_KEY{"irq"};
+  constexpr static const char* IRQ_VECTOR_KEY{"irqVector"};
+
+  device(const std::string& name, const configuration& conf,
+         const uint32_t size);
+  virtual ~device() {}
+
+  const std::string& name() const { return name_; }
+  uint32_t base_address() const { return address_; }
+  uint32_t size() const { return size_; }
+
+  // true if <address> with address modifier <am> is in the window,
+  // <offset> is the offset in the window
+  bool decodes(const uint32_t address, const uint32_t am,
+               uint32_t& offset) const;
+
+  // single cycle of <width> bytes (1, 2, 4 or 8) at <offset>
+  // returns false for a bus error
+  virtual bool read(const uint32_t offset, const size_t width,
+                    uint64_t& val) = 0;
+  virtual bool write(const uint32_t offset, const size_t width,
+                     const uint64_t val) = 0;
+
+  // bring the model up to <now> (triggers, ...)
+  virtual void update(const clock_type::time_point /*now*/) {}
+  // time from which the IRQ is asserted (time_point::max() if it is not)
+  virtual clock_type::time_point irq_time() const {
+    return clock_type::time_point::max();
+  }
+  irq_level irq() const { return irq_; }
+  // status/ID returned by an IACK cycle
+  virtual uint32_t irq_vector() const { return irq_vector_; }
+
+private:
+  const std::string name_;
+  const uint32_t address_;
+  const uint32_t size_;
+  const irq_level irq_;
+  const uint32_t irq_vector_;
+};
+
+// addressing mode of address modifier <am>: A24 or A32 for the data and
+// block transfer modifiers, A16 otherwise (not decoded by the devices)
+addressing_mode am_addressing(const uint32_t am);
+}
+}
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "discriminator.hpp"
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+namespace {
+using registers = caen_discriminator_impl::instructions<addressing_mode::A32>;
+uint16_t module_type(const caen_discriminator_impl::submodel model) {
+  using caen_discriminator_impl::extra_properties;
+  using caen_discriminator_impl::submodel;
+  return model == submodel::V812
+             ? extra_properties<submodel::V812>::MODULE_TYPE
+             : extra_properties<submodel::V895>::MODULE_TYPE;
+}
+}
+
+discriminator::discriminator(const std::string& name,
+                             const configuration& conf, const submodel model)
+    : device{name, conf, WINDOW_SIZE}
+    , model_{model}
+    , model_type_{static_cast<uint16_t>((properties::MANUFACTURER << 10) |
+                                        module_type(model))}
+    , serial_{static_cast<uint16_t>(
+          ((conf.get_optional<uint16_t>(VERSION_KEY).get_value_or(0) & 0xF)
+           << 12) |
+          (conf.get_optional<uint16_t>(SERIAL_KEY).get_value_or(1) & 0xFFF))}
+    , width_{{0, 0}}
+    , deadtime_{{0, 0}}
+    , majority_{0}
+    , inhibit_{0}
+    , n_test_pulses_{0} {
+  threshold_.fill(0);
+}
+
+bool discriminator::read(const uint32_t offset, const size_t width,
+                         uint64_t& val) {
+  if (width != 2) {
+    return false;
+  }
+  switch (offset) {
+  case registers::FIXED_CODE:
+    val = properties::FIXED_CODE;
+    return true;
+  case registers::MODEL_TYPE:
+    val = model_type_;
+    return true;
+  case registers::SERIAL:
+    val = serial_;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool discriminator::write(const uint32_t offset, const size_t width,
+                          const uint64_t val) {
+  if (width != 2) {
+    return false;
+  }
+  const uint16_t data{static_cast<uint16_t>(val)};
+  if (offset < 2 * properties::N_CHANNELS) {
+    if (offset % 2) {
+      return false;
+    }
+    threshold_[offset / 2] = data & 0xFF;
+    return true;
+  }
+  switch (offset) {
+  case registers::OUTPUT_WIDTH_0_7:
+    width_[0] = data & 0xFF;
+    return true;
+  case registers::OUTPUT_WIDTH_8_15:
+    width_[1] = data & 0xFF;
+    return true;
+  case registers::DEADTIME_0_7:
+  case registers::DEADTIME_8_15:
+    if (model_ != submodel::V812) {
+      return false;
+    }
+    deadtime_[offset == registers::DEADTIME_0_7 ? 0 : 1] = data & 0xFF;
+    return true;
+  case registers::MAJORITY_THRESHOLD:
+    majority_ = data & 0xFF;
+    return true;
+  case registers::PATTERN_INHIBITOR:
+    inhibit_ = data;
+    return true;
+  case registers::TEST_PULSE:
+    ++n_test_pulses_;
+    return true;
+  default:
+    return false;
+  }
+}
+}
+}
+}
@@ -0,0 +1,75 @@
+#ifndef CTRLROOM_VME_SIM_DISCRIMINATOR_LOADED
+#define CTRLROOM_VME_SIM_DISCRIMINATOR_LOADED
+
+#include <ctrlroom/vme/caen_discriminator/spec.hpp>
+#include <ctrlroom/vme/sim/device.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+// Register map of the CAEN V812 (CFD) and V895 (leading edge)
+// discriminators (cf. caen_discriminator/spec.hpp).
+//
+// The configuration registers are write only (reading them is a bus
+// error), the identifier words (FIXED_CODE, MODEL_TYPE and SERIAL) are
+// read only. All registers are D16. The dead time registers only exist
+// on the V812. The written values can be inspected through the accessors
+// below.
+//
+// CONFIGURATION FILE OPTIONS (on top of the device options, cf.
+// device.hpp)
+// optional
+//      * serial number: <dev>.serial (defaults to 1)
+//      * board version: <dev>.version (defaults to 0)
+class discriminator : public device {
+public:
+  constexpr static const char* SERIAL_KEY{"serial"};
+  constexpr static const char* VERSION_KEY{"version"};
+
+  constexpr static uint32_t WINDOW_SIZE{0x100};
+
+  using submodel = caen_discriminator_impl::submodel;
+  using properties = caen_discriminator_impl::properties;
+  using threshold_type =
+      std::array<uint16_t, caen_discriminator_impl::properties::N_CHANNELS>;
+
+  discriminator(const std::string& name, const configuration& conf,
+                const submodel model);
+
+  bool read(const uint32_t offset, const size_t width,
+            uint64_t& val) override;
+  bool write(const uint32_t offset, const size_t width,
+             const uint64_t val) override;
+
+  submodel model() const { return model_; }
+  const threshold_type& thresholds() const { return threshold_; }
+  // output width and dead time for channels 0-7 (<bank> 0) and
+  // 8-15 (<bank> 1)
+  uint16_t output_width(const size_t bank) const { return width_[bank]; }
+  uint16_t deadtime(const size_t bank) const { return deadtime_[bank]; }
+  uint16_t majority_threshold() const { return majority_; }
+  uint16_t inhibit_pattern() const { return inhibit_; }
+  size_t n_test_pulses() const { return n_test_pulses_; }
+
+private:
+  const submodel model_;
+  const uint16_t model_type_;
+  const uint16_t serial_;
+  threshold_type threshold_;
+  std::array<uint16_t, 2> width_;
+  std::array<uint16_t, 2> deadtime_;
+  uint16_t majority_;
+  uint16_t inhibit_;
+  size_t n_test_pulses_;
+};
+}
+}
+}
+
+#endif
@@ -0,0 +1,319 @@
+#include "v1729.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+namespace {
+using registers = caen_v1729_impl::instructions<addressing_mode::A32>;
+using caen_v1729_impl::trigger_type;
+using caen_v1729_impl::trigger_settings;
+
+// MODE_REGISTER bits
+constexpr uint16_t MODE_IRQ{0x1};
+constexpr uint16_t MODE_AUTO_RESTART{0x4};
+// initial pilot frequency (2GHz), survives a reset
+constexpr uint16_t DEFAULT_FP_FREQUENCY{0x1};
+
+uint16_t memory_mask(const caen_v1729_impl::submodel model) {
+  using caen_v1729_impl::extra_properties;
+  using caen_v1729_impl::submodel;
+  return model == submodel::V1729A
+             ? extra_properties<submodel::V1729A>::MEMORY_MASK
+             : extra_properties<submodel::V1729>::MEMORY_MASK;
+}
+}
+
+v1729::v1729(const std::string& name, const configuration& conf,
+             const submodel model)
+    : device{name, conf, WINDOW_SIZE}
+    , model_{model}
+    , mask_{memory_mask(model)}
+    , fpga_version_{
+          conf.get_optional<uint16_t>(FPGA_VERSION_KEY).get_value_or(0x0A)}
+    , trigger_interval_{std::chrono::microseconds(
+          conf.get_optional<size_t>(TRIGGER_INTERVAL_KEY).get_value_or(100))}
+    , baseline_{conf.get_optional<double>(BASELINE_KEY)
+                    .get_value_or((mask_ + 1) / 2)}
+    , noise_{conf.get_optional<double>(NOISE_KEY).get_value_or(2.)}
+    , amplitude_{conf.get_optional<double>(PULSE_AMPLITUDE_KEY)
+                     .get_value_or(500.)}
+    , position_{conf.get_optional<double>(PULSE_POSITION_KEY)
+                    .get_value_or(1000.)}
+    , width_{conf.get_optional<double>(PULSE_WIDTH_KEY).get_value_or(10.)}
+    , vernier_min_{
+          conf.get_optional<uint16_t>(VERNIER_MIN_KEY).get_value_or(1000)}
+    , vernier_max_{
+          conf.get_optional<uint16_t>(VERNIER_MAX_KEY).get_value_or(3000)}
+    , pedestal_(properties::MEMORY_SIZE)
+    , rng_{conf.get_optional<uint32_t>(SEED_KEY).get_value_or(1)}
+    , state_{state::IDLE}
+    , random_trigger_{false}
+    , irq_pending_{false}
+    , read_pos_{0}
+    , trig_rec_{0}
+    , n_triggers_{0} {
+  if (vernier_max_ <= vernier_min_) {
+    throw conf.value_error(VERNIER_MAX_KEY, std::to_string(vernier_max_));
+  }
+  if (width_ <= 0) {
+    throw conf.value_error(PULSE_WIDTH_KEY, std::to_string(width_));
+  }
+  // register map
+  access_.fill(NONE);
+  for (const uint32_t r :
+       {registers::INTERRUPT, registers::FP_FREQUENCY, registers::MODE_REGISTER,
+        registers::TRIGGER_THRESHOLD_DAC, registers::RAM_INT_ADD.LSB,
+        registers::RAM_INT_ADD.MSB, registers::MAT_CTRL_REGISTER.LSB,
+        registers::MAT_CTRL_REGISTER.MSB, registers::PRETRIG.LSB,
+        registers::PRETRIG.MSB, registers::POSTTRIG.LSB,
+        registers::POSTTRIG.MSB, registers::TRIGGER_TYPE,
+        registers::TRIGGER_CHANNEL_SOURCE, registers::FAST_READ_MODES,
+        registers::NB_OF_COLS_TO_READ, registers::CHANNEL_MASK,
+        registers::VALP_CP_REGISTER, registers::VALI_CP_REGISTER,
+        registers::EEPROM_WRITE, registers::POST_STOP_LATENCY,
+        registers::POST_LATENCY_PRETRIG, registers::NUMBER_OF_CHANNELS,
+        registers::RATE_REG}) {
+    access_[r >> 8] = READ | WRITE;
+  }
+  // TRIGGER_THRESHOLD_DAC_CH (0x2800 - 0x2B00)
+  for (uint32_t r{0x2800}; r <= 0x2B00; r += 0x100) {
+    access_[r >> 8] = READ | WRITE;
+  }
+  for (const uint32_t r :
+       {registers::FPGA_VERSION, registers::FPGA_EVOLUTION,
+        registers::TRIG_REC, registers::EEPROM_POLL, registers::EEPROM_READ,
+        registers::TRIG_COUNT.LSB, registers::TRIG_COUNT.MSB,
+        registers::TRIG_RATE.LSB, registers::TRIG_RATE.MSB,
+        registers::TRIG_COUNT_RATE_BLOCK}) {
+    access_[r >> 8] = READ;
+  }
+  for (const uint32_t r :
+       {registers::RESET, registers::LOAD_TRIGGER_THRESHOLD_DAC,
+        registers::START_ACQUISITION, registers::SOFTWARE_TRIGGER}) {
+    access_[r >> 8] = WRITE;
+  }
+  access_[registers::RAM_DATA >> 8] = READ;
+  // fixed pedestal pattern (+-16 counts around the baseline)
+  std::uniform_real_distribution<double> offset{-16., 16.};
+  for (auto& p : pedestal_) {
+    p = baseline_ + offset(rng_);
+  }
+  registers_.fill(0);
+  registers_[registers::FP_FREQUENCY >> 8] = DEFAULT_FP_FREQUENCY;
+}
+
+bool v1729::read(const uint32_t offset, const size_t width, uint64_t& val) {
+  if ((offset & 0xFF) || offset >= (N_REGISTERS << 8) ||
+      !(access_[offset >> 8] & READ)) {
+    return false;
+  }
+  switch (offset) {
+  case registers::RAM_DATA:
+    return pop(width, val);
+  case registers::INTERRUPT:
+    val = irq_pending_;
+    return true;
+  case registers::FPGA_VERSION:
+    val = fpga_version_;
+    return true;
+  case registers::TRIG_REC:
+    val = trig_rec_;
+    return true;
+  case registers::TRIG_COUNT.LSB:
+    val = n_triggers_ & 0xFF;
+    return true;
+  case registers::TRIG_COUNT.MSB:
+    val = (n_triggers_ >> 8) & 0xFF;
+    return true;
+  default:
+    if (width > 4) {
+      return false;
+    }
+    val = reg(offset);
+    return true;
+  }
+}
+
+bool v1729::write(const uint32_t offset, const size_t width,
+                  const uint64_t val) {
+  if ((offset & 0xFF) || offset >= (N_REGISTERS << 8) ||
+      !(access_[offset >> 8] & WRITE) || width > 4) {
+    return false;
+  }
+  switch (offset) {
+  case registers::RESET:
+    reset();
+    return true;
+  case registers::START_ACQUISITION:
+    arm();
+    return true;
+  case registers::SOFTWARE_TRIGGER:
+    if (state_ == state::ARMED &&
+        (reg(registers::TRIGGER_TYPE) & 0x3) != trigger_type::EXTERNAL) {
+      trigger_time_ = now_;
+    }
+    return true;
+  case registers::LOAD_TRIGGER_THRESHOLD_DAC:
+    return true;
+  case registers::INTERRUPT:
+    irq_pending_ = false;
+    return true;
+  default:
+    registers_[offset >> 8] = static_cast<uint16_t>(val);
+    return true;
+  }
+}
+
+void v1729::update(const clock_type::time_point now) {
+  now_ = now;
+  if (state_ == state::ARMED && now_ >= trigger_time_) {
+    acquire();
+  }
+}
+
+clock_type::time_point v1729::irq_time() const {
+  if (!(reg(registers::MODE_REGISTER) & MODE_IRQ)) {
+    return clock_type::time_point::max();
+  }
+  if (state_ == state::ARMED) {
+    return trigger_time_;
+  }
+  if (state_ == state::DONE && irq_pending_) {
+    return trigger_time_;
+  }
+  return clock_type::time_point::max();
+}
+
+void v1729::reset() {
+  const uint16_t fp_frequency{reg(registers::FP_FREQUENCY)};
+  registers_.fill(0);
+  registers_[registers::FP_FREQUENCY >> 8] = fp_frequency;
+  state_ = state::IDLE;
+  irq_pending_ = false;
+  memory_.clear();
+  read_pos_ = 0;
+}
+
+void v1729::arm() {
+  const uint16_t type{reg(registers::TRIGGER_TYPE)};
+  state_ = state::ARMED;
+  irq_pending_ = false;
+  random_trigger_ = false;
+  if ((type & 0x3) == trigger_type::SOFTWARE) {
+    if (type & trigger_settings::RANDOM) {
+      random_trigger_ = true;
+      trigger_time_ = now_;
+    } else {
+      trigger_time_ = clock_type::time_point::max();
+    }
+  } else {
+    trigger_time_ = now_ + trigger_interval_;
+  }
+}
+
+void v1729::acquire() {
+  ++n_triggers_;
+  state_ = state::DONE;
+  irq_pending_ = true;
+  read_pos_ = 0;
+  std::uniform_real_distribution<double> uniform{0., 1.};
+  const double vernier_range{static_cast<double>(vernier_max_ - vernier_min_)};
+  // vernier calibration: only the vernier values
+  if (reg(registers::NB_OF_COLS_TO_READ) == 0) {
+    memory_.resize(properties::VERNIER_MEMORY_SIZE);
+    for (auto& v : memory_) {
+      v = vernier_min_ + static_cast<uint16_t>(uniform(rng_) * vernier_range);
+    }
+    return;
+  }
+  constexpr size_t N_ROWS{properties::N_CELLS * properties::ROWS_PER_CELL};
+  constexpr size_t N_SAMPLES{N_ROWS - properties::MEMORY_DATA_SKIP};
+  memory_.assign(properties::MEMORY_SIZE, 0);
+  // stop position and verniers
+  // (cf. caen_v1729_impl::buffer::calibrate())
+  const uint16_t posttrig{static_cast<uint16_t>(
+      reg(registers::POSTTRIG.LSB) | (reg(registers::POSTTRIG.MSB) << 8))};
+  const size_t stop_cell{static_cast<size_t>(uniform(rng_) *
+                                             properties::N_CELLS)};
+  trig_rec_ = static_cast<uint16_t>((posttrig + stop_cell) & mask_);
+  const uint16_t vernier{static_cast<uint16_t>(
+      vernier_min_ + uniform(rng_) * vernier_range)};
+  for (size_t i{0}; i < properties::N_CHANNELS; ++i) {
+    memory_[properties::MEMORY_VERNIER_INDEX + i] = vernier;
+  }
+  const size_t vernier_rows{static_cast<size_t>(
+      properties::ROWS_PER_CELL * (vernier - vernier_min_) / vernier_range)};
+  const size_t end_row{(properties::N_CELLS - stop_cell) *
+                           properties::ROWS_PER_CELL -
+                       vernier_rows};
+  // samples, in order of time (the last MEMORY_DATA_SKIP samples wrap
+  // around to the start of the buffer, and are not read out)
+  std::normal_distribution<double> noise{0., noise_};
+  for (size_t i{0}; i < N_ROWS; ++i) {
+    const size_t row{(i + end_row + properties::ROWS_PER_CELL +
+                      properties::MEMORY_DATA_SKIP) %
+                     N_ROWS};
+    double pulse{0};
+    if (!random_trigger_ && i < N_SAMPLES) {
+      const double x{(i - position_) / width_};
+      pulse = amplitude_ * std::exp(-0.5 * x * x);
+    }
+    for (size_t chan{0}; chan < properties::N_CHANNELS; ++chan) {
+      // channels are stored 3 -> 0 in the D16 word order
+      const size_t idx{properties::MEMORY_HEADER_SIZE +
+                       row * properties::N_CHANNELS +
+                       (properties::N_CHANNELS - chan - 1)};
+      const double val{pedestal_[idx] + noise(rng_) - pulse};
+      memory_[idx] = static_cast<uint16_t>(
+          std::min<double>(std::max<double>(std::round(val), 0.), mask_));
+    }
+  }
+}
+
+bool v1729::pop(const size_t width, uint64_t& val) {
+  if (state_ != state::DONE) {
+    return false;
+  }
+  irq_pending_ = false;
+  const size_t n_words{width / 2};
+  if (read_pos_ + n_words <= memory_.size()) {
+    // D32: 2 words, the first in the upper half (cf. channel_index),
+    // MBLT: 2 D32 words, the first in the lower half (little endian)
+    const uint16_t* w{&memory_[read_pos_]};
+    switch (n_words) {
+    case 1:
+      val = w[0];
+      break;
+    case 2:
+      val = (static_cast<uint64_t>(w[0]) << 16) | w[1];
+      break;
+    case 4:
+      val = (static_cast<uint64_t>(w[2]) << 48) |
+            (static_cast<uint64_t>(w[3]) << 32) |
+            (static_cast<uint64_t>(w[0]) << 16) | w[1];
+      break;
+    default:
+      return false;
+    }
+    read_pos_ += n_words;
+    return true;
+  }
+  if (read_pos_ != memory_.size() || width > 4) {
+    return false;
+  }
+  // TRIG_REC after the data (in the upper half for D32), ends the
+  // readout
+  val = static_cast<uint64_t>(trig_rec_) << (8 * (width - 2));
+  state_ = state::IDLE;
+  if (reg(registers::MODE_REGISTER) & MODE_AUTO_RESTART) {
+    arm();
+  }
+  return true;
+}
+}
+}
+}
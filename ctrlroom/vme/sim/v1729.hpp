@@ -0,0 +1,140 @@
+#ifndef CTRLROOM_VME_SIM_V1729_LOADED
+#define CTRLROOM_VME_SIM_V1729_LOADED
+
+#include <ctrlroom/vme/caen_v1729/spec.hpp>
+#include <ctrlroom/vme/sim/device.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+namespace sim {
+
+// Behavioral model of the CAEN V1729(a) digitizer
+// (cf. caen_v1729/spec.hpp for the memory layout).
+//
+// Acquisition:
+//      * START_ACQUISITION arms the board. A random software trigger
+//        (TRIGGER_TYPE SOFTWARE|RANDOM) fires immediately, a software
+//        trigger on SOFTWARE_TRIGGER, internal and external triggers
+//        <dev>.triggerInterval after arming.
+//      * On a trigger, the circular buffer is filled: a fixed per-cell
+//        pedestal pattern, gaussian noise and (for all but random
+//        triggers) a synthetic gaussian pulse on all channels, with the
+//        stop position (TRIG_REC) and the verniers drawn at random,
+//        consistent with each other. The IRQ is asserted (if enabled
+//        in MODE_REGISTER), and cleared by the first RAM_DATA read or a
+//        write to INTERRUPT.
+//      * RAM_DATA is a FIFO: the header and data words (D16: 1 word,
+//        D32: 2 words, MBLT: 4 words per read, in the order expected
+//        by caen_v1729_impl::channel_index), followed by TRIG_REC, which
+//        restarts the acquisition if auto-restart is enabled in
+//        MODE_REGISTER. Reading an empty FIFO is a bus error.
+//      * With NB_OF_COLS_TO_READ = 0 (vernier calibration), the FIFO
+//        holds VERNIER_MEMORY_SIZE vernier values instead.
+// Registers that do not exist, reads of write-only registers (strobes)
+// and writes of read-only registers are bus errors.
+//
+// CONFIGURATION FILE OPTIONS (on top of the device options, cf.
+// device.hpp)
+// optional
+//      * FPGA version: <dev>.fpgaVersion (defaults to 0x0A)
+//      * internal/external trigger delay (in [us]):
+//        <dev>.triggerInterval (defaults to 100)
+//      * pedestal (in ADC counts): <dev>.baseline (defaults to half the
+//        range)
+//      * noise RMS (in ADC counts): <dev>.noise (defaults to 2)
+//      * pulse amplitude (in ADC counts, negative pulses):
+//        <dev>.pulseAmplitude (defaults to 500)
+//      * pulse position and width (in samples): <dev>.pulsePosition
+//        (defaults to 1000), <dev>.pulseWidth (defaults to 10)
+//      * vernier range: <dev>.vernierMin, <dev>.vernierMax (defaults to
+//        1000 and 3000)
+//      * random seed: <dev>.seed (defaults to 1)
+class v1729 : public device {
+public:
+  constexpr static const char* FPGA_VERSION_KEY{"fpgaVersion"};
+  constexpr static const char* TRIGGER_INTERVAL_KEY{"triggerInterval"};
+  constexpr static const char* BASELINE_KEY{"baseline"};
+  constexpr static const char* NOISE_KEY{"noise"};
+  constexpr static const char* PULSE_AMPLITUDE_KEY{"pulseAmplitude"};
+  constexpr static const char* PULSE_POSITION_KEY{"pulsePosition"};
+  constexpr static const char* PULSE_WIDTH_KEY{"pulseWidth"};
+  constexpr static const char* VERNIER_MIN_KEY{"vernierMin"};
+  constexpr static const char* VERNIER_MAX_KEY{"vernierMax"};
+  constexpr static const char* SEED_KEY{"seed"};
+
+  constexpr static uint32_t WINDOW_SIZE{0x10000};
+
+  using submodel = caen_v1729_impl::submodel;
+  using properties = caen_v1729_impl::properties;
+
+  v1729(const std::string& name, const configuration& conf,
+        const submodel model);
+
+  bool read(const uint32_t offset, const size_t width,
+            uint64_t& val) override;
+  bool write(const uint32_t offset, const size_t width,
+             const uint64_t val) override;
+  void update(const clock_type::time_point now) override;
+  clock_type::time_point irq_time() const override;
+
+  submodel model() const { return model_; }
+  size_t n_triggers() const { return n_triggers_; }
+  // stop position of the last acquisition
+  uint16_t trig_rec() const { return trig_rec_; }
+
+private:
+  enum class state { IDLE, ARMED, DONE };
+  // register access (by register index, i.e. offset >> 8)
+  enum access : uint8_t { NONE = 0x0, READ = 0x1, WRITE = 0x2 };
+  constexpr static size_t N_REGISTERS{0x40};
+
+  uint16_t reg(const uint32_t offset) const {
+    return registers_[offset >> 8];
+  }
+  void reset();
+  void arm();
+  void acquire();
+  // next RAM_DATA read of <width> bytes
+  bool pop(const size_t width, uint64_t& val);
+
+  const submodel model_;
+  const uint16_t mask_;
+  const uint16_t fpga_version_;
+  const clock_type::duration trigger_interval_;
+  const double baseline_;
+  const double noise_;
+  const double amplitude_;
+  const double position_;
+  const double width_;
+  const uint16_t vernier_min_;
+  const uint16_t vernier_max_;
+
+  std::array<uint8_t, N_REGISTERS> access_;
+  std::array<uint16_t, N_REGISTERS> registers_;
+  // fixed pedestal pattern of the memory cells
+  std::vector<double> pedestal_;
+  std::mt19937 rng_;
+
+  clock_type::time_point now_;
+  state state_;
+  bool random_trigger_;
+  clock_type::time_point trigger_time_;
+  bool irq_pending_;
+  // FIFO contents of the last acquisition
+  std::vector<uint16_t> memory_;
+  size_t read_pos_;
+  uint16_t trig_rec_;
+  size_t n_triggers_;
+};
+}
+}
+}
+
+#endif
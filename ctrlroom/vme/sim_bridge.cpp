@@ -0,0 +1,342 @@
+#include "sim_bridge.hpp"
+
+#include <ctrlroom/vme/sim/discriminator.hpp>
+#include <ctrlroom/vme/sim/v1729.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+using namespace ctrlroom::vme;
+
+namespace {
+// delays up to this long are spun, longer ones are slept
+constexpr std::chrono::microseconds MAX_SPIN_DELAY{100};
+
+// create the device model for the configuration of device <name>
+std::unique_ptr<sim::device> make_device(const std::string& name,
+                                         const ctrlroom::configuration& conf) {
+  const std::string model{conf.model()};
+  if (model == "V1729") {
+    return std::unique_ptr<sim::device>{
+        new sim::v1729{name, conf, caen_v1729_impl::submodel::V1729}};
+  } else if (model == "V1729A") {
+    return std::unique_ptr<sim::device>{
+        new sim::v1729{name, conf, caen_v1729_impl::submodel::V1729A}};
+  } else if (model == "V812") {
+    return std::unique_ptr<sim::device>{new sim::discriminator{
+        name, conf, caen_discriminator_impl::submodel::V812}};
+  } else if (model == "V895") {
+    return std::unique_ptr<sim::device>{new sim::discriminator{
+        name, conf, caen_discriminator_impl::submodel::V895}};
+  }
+  throw conf.value_error("model", model);
+}
+
+// transfer time per byte for the configured link bandwidth
+// (1 MB/s is 1000 ns per byte)
+double ns_per_byte(const ctrlroom::configuration& conf) {
+  const double bandwidth{conf.get_optional<double>(
+                             sim_bridge::LINK_BANDWIDTH_KEY)
+                             .get_value_or(0)};
+  if (bandwidth < 0) {
+    throw conf.value_error(sim_bridge::LINK_BANDWIDTH_KEY,
+                           std::to_string(bandwidth));
+  }
+  return bandwidth > 0 ? 1e3 / bandwidth : 0.;
+}
+
+// value <i> of <width> bytes in <buf>
+uint64_t load(const void* buf, const size_t i, const size_t width) {
+  switch (width) {
+  case 1:
+    return static_cast<const uint8_t*>(buf)[i];
+  case 2:
+    return static_cast<const uint16_t*>(buf)[i];
+  case 4:
+    return static_cast<const uint32_t*>(buf)[i];
+  default:
+    return static_cast<const uint64_t*>(buf)[i];
+  }
+}
+void store(void* buf, const size_t i, const size_t width, const uint64_t val) {
+  switch (width) {
+  case 1:
+    static_cast<uint8_t*>(buf)[i] = static_cast<uint8_t>(val);
+    break;
+  case 2:
+    static_cast<uint16_t*>(buf)[i] = static_cast<uint16_t>(val);
+    break;
+  case 4:
+    static_cast<uint32_t*>(buf)[i] = static_cast<uint32_t>(val);
+    break;
+  default:
+    static_cast<uint64_t*>(buf)[i] = val;
+  }
+}
+}
+
+sim_bridge::sim_bridge(const std::string& identifier, const ptree& settings)
+    : sim_bridge::base_type{identifier, settings}
+    , call_latency_{conf_.get_optional<size_t>(CALL_LATENCY_KEY)
+                        .get_value_or(0)}
+    , cycle_latency_{conf_.get_optional<size_t>(CYCLE_LATENCY_KEY)
+                         .get_value_or(0)}
+    , ns_per_byte_{ns_per_byte(conf_)}
+    , bus_error_rate_{
+          conf_.get_optional<double>(BUS_ERROR_RATE_KEY).get_value_or(0)}
+    , rng_{conf_.get_optional<uint32_t>(SEED_KEY).get_value_or(1)}
+    , n_bus_errors_{0} {
+  if (bus_error_rate_ < 0 || bus_error_rate_ >= 1) {
+    throw conf_.value_error(BUS_ERROR_RATE_KEY,
+                            std::to_string(bus_error_rate_));
+  }
+  const auto names = conf_.get_optional_vector<std::string>(
+      std::string(DEVICES_KEY) + "." + LIST_KEY);
+  if (names) {
+    for (const auto& dev : *names) {
+      const configuration dev_conf{
+          identifier + "." + DEVICES_KEY + "." + dev, settings};
+      const sim::device& d = add_device(make_device(dev, dev_conf));
+      LOG_INFO(name(), "Simulating " + dev_conf.model() + " '" + dev +
+                           "' at " + std::to_string(d.base_address()));
+    }
+  }
+}
+
+void sim_bridge::wait_for_irq(size_t timeout) const {
+  const auto start = transfer_stats::now();
+  const auto deadline = start + std::chrono::milliseconds(timeout);
+  uint8_t mask{0};
+  for (const irq_level level : irq_) {
+    mask |= static_cast<uint8_t>(level);
+  }
+  // first IRQ on one of our levels
+  auto first = clock_type::time_point::max();
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    for (const auto& dev : devices_) {
+      if (mask & static_cast<uint8_t>(dev->irq())) {
+        first = std::min(first, dev->irq_time());
+      }
+    }
+  }
+  if (first > deadline) {
+    std::this_thread::sleep_until(deadline);
+    stats_.record_irq_timeout();
+    throw timeout_error("No IRQ within " + std::to_string(timeout) + " ms");
+  }
+  std::this_thread::sleep_until(first);
+  stats_.record_irq(irq_phase::BLOCK, start);
+}
+
+sim::device& sim_bridge::device(const std::string& name) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (const auto& dev : devices_) {
+    if (dev->name() == name) {
+      return *dev;
+    }
+  }
+  throw invalid_parameter("No simulated device called " + name);
+}
+size_t sim_bridge::n_devices() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return devices_.size();
+}
+size_t sim_bridge::n_bus_errors() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return n_bus_errors_;
+}
+
+size_t sim_bridge::read_multi(single_cycle* cycles, status* st,
+                              size_t n) const {
+  return multi(cycles, st, n, true);
+}
+size_t sim_bridge::write_multi(single_cycle* cycles, status* st,
+                               size_t n) const {
+  return multi(cycles, st, n, false);
+}
+
+uint8_t sim_bridge::check_irq() const {
+  uint8_t mask{0};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    const auto now = clock_type::now();
+    for (const auto& dev : devices_) {
+      if (dev->irq_time() <= now) {
+        mask |= static_cast<uint8_t>(dev->irq());
+      }
+    }
+  }
+  delay(1, 0);
+  return mask;
+}
+
+void sim_bridge::ping() const { delay(0, 0); }
+
+size_t sim_bridge::single(const uint32_t address, const uint32_t am,
+                          const size_t width, void* val,
+                          const bool read) const {
+  bool ok{false};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    uint64_t v{read ? 0 : load(val, 0, width)};
+    ok = cycle(address, am, width, v, read);
+    if (ok && read) {
+      store(val, 0, width, v);
+    }
+  }
+  delay(1, width);
+  return ok ? 1 : bus_error_after(0, address);
+}
+
+size_t sim_bridge::rmw(const uint32_t address, const uint32_t am,
+                       const size_t width, void* val) const {
+  bool ok{false};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    uint64_t previous{0};
+    ok = cycle(address, am, width, previous, true);
+    if (ok) {
+      uint64_t v{load(val, 0, width)};
+      ok = cycle(address, am, width, v, false);
+    }
+    if (ok) {
+      store(val, 0, width, previous);
+    }
+  }
+  delay(2, 2 * width);
+  return ok ? 1 : bus_error_after(0, address);
+}
+
+size_t sim_bridge::transfer(const uint32_t address, const uint32_t am,
+                            const size_t width, void* buf,
+                            const size_t n_requests, const bool read,
+                            const bool fifo) const {
+  size_t n_done{0};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    for (; n_done < n_requests; ++n_done) {
+      const uint32_t addr{static_cast<uint32_t>(
+          fifo ? address : address + n_done * width)};
+      uint64_t v{read ? 0 : load(buf, n_done, width)};
+      if (!cycle(addr, am, width, v, read)) {
+        break;
+      }
+      if (read) {
+        store(buf, n_done, width, v);
+      }
+    }
+  }
+  delay(1, n_done * width);
+  return n_done == n_requests ? n_done : bus_error_after(n_done, address);
+}
+
+size_t sim_bridge::multi(single_cycle* cycles, status* st, size_t n,
+                         const bool read) const {
+  size_t n_good{0};
+  size_t n_bytes{0};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    for (size_t i{0}; i < n; ++i) {
+      uint64_t v{cycles[i].data};
+      if (!cycle(cycles[i].address, cycles[i].am, cycles[i].width, v, read)) {
+        st[i] = status::BUS_ERROR;
+        continue;
+      }
+      st[i] = status::SUCCESS;
+      if (read) {
+        cycles[i].data = static_cast<uint32_t>(v);
+      }
+      ++n_good;
+      n_bytes += cycles[i].width;
+    }
+  }
+  delay(n, n_bytes);
+  return n_good;
+}
+
+uint32_t sim_bridge::acknowledge(const irq_level level) const {
+  bool found{false};
+  uint32_t vector{0};
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    update();
+    const auto now = clock_type::now();
+    for (const auto& dev : devices_) {
+      if (dev->irq() == level && dev->irq_time() <= now) {
+        found = true;
+        vector = dev->irq_vector();
+        break;
+      }
+    }
+  }
+  delay(1, 0);
+  if (found) {
+    return vector;
+  }
+  throw bus_error("No device answered the IACK cycle for IRQ level " +
+                  std::to_string(static_cast<int>(level)));
+}
+
+bool sim_bridge::cycle(const uint32_t address, const uint32_t am,
+                       const size_t width, uint64_t& val,
+                       const bool read) const {
+  if (bus_error_rate_ > 0 &&
+      std::uniform_real_distribution<double>{0, 1}(rng_) < bus_error_rate_) {
+    ++n_bus_errors_;
+    return false;
+  }
+  uint32_t offset{0};
+  for (const auto& dev : devices_) {
+    if (dev->decodes(address, am, offset)) {
+      if (read ? dev->read(offset, width, val)
+               : dev->write(offset, width, val)) {
+        return true;
+      }
+      break;
+    }
+  }
+  ++n_bus_errors_;
+  return false;
+}
+
+void sim_bridge::update() const {
+  const auto now = clock_type::now();
+  for (const auto& dev : devices_) {
+    dev->update(now);
+  }
+}
+
+void sim_bridge::delay(const size_t n_cycles, const size_t n_bytes) const {
+  const auto d =
+      call_latency_ + static_cast<int64_t>(n_cycles) * cycle_latency_ +
+      std::chrono::nanoseconds(
+          static_cast<int64_t>(std::llround(n_bytes * ns_per_byte_)));
+  if (d.count() <= 0) {
+    return;
+  }
+  const auto end = clock_type::now() + d;
+  if (d > MAX_SPIN_DELAY) {
+    std::this_thread::sleep_until(end);
+    return;
+  }
+  while (clock_type::now() < end) {
+  }
+}
+
+size_t sim_bridge::bus_error_after(const size_t n_done,
+                                   const uint32_t address) const {
+  if (status_sink_) {
+    *status_sink_ = status::BUS_ERROR;
+    return n_done;
+  }
+  throw bus_error("Bus error at " + std::to_string(address) + " after " +
+                  std::to_string(n_done) + " cycles");
+}
@@ -0,0 +1,313 @@
+#ifndef CTRLROOM_VME_SIM_BRIDGE_LOADED
+#define CTRLROOM_VME_SIM_BRIDGE_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/sim/device.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// Simulated VME crate: a master module serving all VME cycles from
+// behavioral models of the slaves (cf. sim/device.hpp), so the whole
+// stack (boards, readout, processing) can be run and profiled without
+// CAENVMElib and without a crate.
+//
+// Devices:
+//      * sim::v1729: CAEN V1729/V1729A digitizer (sim/v1729.hpp)
+//      * sim::discriminator: CAEN V812/V895 register map
+//        (sim/discriminator.hpp)
+// created from the settings (see below), or added through add_device()
+// (any model derived from sim::device).
+//
+// Cycles that no device answers end with a bus error (thrown, or
+// reported through the status sink for the exception-free calls), as do
+// cycles the device does not answer, and (at random) a fraction
+// <id>.busErrorRate of all cycles. Block transfers stop at the first
+// bus error; CBLT transfers are not simulated (no device is part of a
+// chain, they end immediately).
+//
+// Timing model: every call takes
+//      <id>.callLatency + n_cycles * <id>.cycleLatency
+//          + n_bytes / <id>.linkBandwidth
+// where a block transfer counts as a single cycle. The caller is held
+// (spinning for short delays, sleeping for longer ones) until the
+// simulated end of the call. All delays default to 0 (no timing).
+//
+// IRQs: wait_for_irq() sleeps until the first device asserts one of the
+// configured IRQ levels (<id>.IRQ), or times out.
+//
+// CONFIGURATION FILE OPTIONS (on top of the master options)
+// optional
+//      * devices: <id>.devices.list ([name0, name1, ...])
+//      * for each device <name>: <id>.devices.<name>.model (V1729,
+//        V1729A, V812 or V895), and the device options (cf.
+//        sim/device.hpp and the model headers)
+//      * latency per call (in [ns]): <id>.callLatency (defaults to 0)
+//      * latency per VME cycle (in [ns]): <id>.cycleLatency (defaults to
+//        0)
+//      * link bandwidth (in [MB/s]): <id>.linkBandwidth (defaults to 0,
+//        unlimited)
+//      * fraction of cycles ending in a random bus error:
+//        <id>.busErrorRate (defaults to 0)
+//      * random seed (for the bus errors): <id>.seed (defaults to 1)
+class sim_bridge : public vme::master<sim_bridge> {
+public:
+  using base_type = vme::master<sim_bridge>;
+
+  constexpr static const char* DEVICES_KEY{"devices"};
+  constexpr static const char* LIST_KEY{"list"};
+  constexpr static const char* CALL_LATENCY_KEY{"callLatency"};
+  constexpr static const char* CYCLE_LATENCY_KEY{"cycleLatency"};
+  constexpr static const char* LINK_BANDWIDTH_KEY{"linkBandwidth"};
+  constexpr static const char* BUS_ERROR_RATE_KEY{"busErrorRate"};
+  constexpr static const char* SEED_KEY{"seed"};
+
+  sim_bridge(const std::string& identifier, const ptree& settings);
+
+  // wait for the next IRQ
+  void wait_for_irq() const;
+  void wait_for_irq(size_t timeout) const;
+
+  // add a device model, and return it (throws if its window overlaps
+  // with another device)
+  template <class Device> Device& add_device(std::unique_ptr<Device> dev);
+  // the device called <name> (throws if there is none)
+  sim::device& device(const std::string& name);
+  template <class Device> Device& device(const std::string& name) {
+    return dynamic_cast<Device&>(device(name));
+  }
+  size_t n_devices() const;
+
+  // number of cycles that ended in a bus error
+  size_t n_bus_errors() const;
+
+protected:
+  // Single
+  template <addressing_mode A, transfer_mode D>
+  size_t read_single(const typename address_spec<A>::ptr_type address,
+                     typename transfer_spec<D>::ptr_type val) const {
+    return single(address, address_spec<A>::DATA, transfer_spec<D>::WIDTH,
+                  val, true);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_single(const typename address_spec<A>::ptr_type address,
+                      typename transfer_spec<D>::ptr_type val) const {
+    return single(address, address_spec<A>::DATA, transfer_spec<D>::WIDTH,
+                  val, false);
+  }
+  // RMW
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const {
+    return rmw(address, address_spec<A>::DATA, transfer_spec<D>::WIDTH, val);
+  }
+  // BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_blt(const typename address_spec<A>::ptr_type address,
+                  typename transfer_spec<D>::ptr_type buf,
+                  size_t n_requests) const {
+    return block<A, D>(address, buf, n_requests, true, false);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_blt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, D>(address, buf, n_requests, false, false);
+  }
+  // MD32
+  template <addressing_mode A>
+  size_t read_md32(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MD32>(address, buf, n_requests, true,
+                                         false);
+  }
+  template <addressing_mode A>
+  size_t write_md32(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MD32>(address, buf, n_requests, false,
+                                         false);
+  }
+  // MBLT
+  template <addressing_mode A>
+  size_t read_mblt(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(address, buf, n_requests, true,
+                                         false);
+  }
+  template <addressing_mode A>
+  size_t write_mblt(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(address, buf, n_requests, false,
+                                         false);
+  }
+  // 2eVME (3U): not decoded by the devices (bus error)
+  template <addressing_mode A>
+  size_t read_2evme3(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME>(address, buf, n_requests, true,
+                                             false);
+  }
+  template <addressing_mode A>
+  size_t write_2evme3(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME>(address, buf, n_requests, false,
+                                             false);
+  }
+  // 2eVME (6U): not decoded by the devices (bus error)
+  template <addressing_mode A>
+  size_t read_2evme6(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME>(address, buf, n_requests, true,
+                                             false);
+  }
+  template <addressing_mode A>
+  size_t write_2evme6(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME>(address, buf, n_requests, false,
+                                             false);
+  }
+  // CBLT (no chains in the simulation, ends immediately)
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type,
+                   typename transfer_spec<D>::ptr_type, size_t) const {
+    delay(1, 0);
+    return 0;
+  }
+  // MULTI (batched single cycles)
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const;
+  // IRQ
+  template <transfer_mode D>
+  size_t iack(const irq_level level,
+              typename transfer_spec<D>::ptr_type vector) const {
+    *vector = static_cast<typename transfer_spec<D>::value_type>(
+        acknowledge(level));
+    return 1;
+  }
+  uint8_t check_irq() const;
+  // PING
+  void ping() const;
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const {
+    return block<A, D>(address, buf, n_requests, true, true);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, D>(address, buf, n_requests, false, true);
+  }
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(address, buf, n_requests, true,
+                                         true);
+  }
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const {
+    return block<A, transfer_mode::MBLT>(address, buf, n_requests, false,
+                                         true);
+  }
+
+private:
+  using clock_type = sim::clock_type;
+
+  // single cycle on <val> (of <width> bytes)
+  size_t single(const uint32_t address, const uint32_t am, const size_t width,
+                void* val, const bool read) const;
+  size_t rmw(const uint32_t address, const uint32_t am, const size_t width,
+             void* val) const;
+  template <addressing_mode A, transfer_mode D>
+  size_t block(const typename address_spec<A>::ptr_type address,
+               typename transfer_spec<D>::ptr_type buf, size_t n_requests,
+               const bool read, const bool fifo) const {
+    return transfer(address, deduce_block_modifier<A, D>(),
+                    transfer_spec<D>::WIDTH, buf, n_requests, read, fifo);
+  }
+  // block of <n_requests> cycles on <buf>, at incrementing addresses or
+  // at the same address (<fifo>)
+  size_t transfer(const uint32_t address, const uint32_t am,
+                  const size_t width, void* buf, const size_t n_requests,
+                  const bool read, const bool fifo) const;
+  // DRY implementation of read_multi() and write_multi()
+  size_t multi(single_cycle* cycles, vme::status* st, size_t n,
+               const bool read) const;
+  uint32_t acknowledge(const irq_level level) const;
+
+  // run a single cycle on the device at <address> (call with the mutex
+  // locked), false for a bus error
+  bool cycle(const uint32_t address, const uint32_t am, const size_t width,
+             uint64_t& val, const bool read) const;
+  // bring all devices up to now (call with the mutex locked)
+  void update() const;
+  // hold the caller for a call of <n_cycles> cycles moving <n_bytes>
+  void delay(const size_t n_cycles, const size_t n_bytes) const;
+  // report a bus error after <n_done> cycles (status sink or throw)
+  size_t bus_error_after(const size_t n_done, const uint32_t address) const;
+
+  std::vector<std::unique_ptr<sim::device>> devices_;
+  const std::chrono::nanoseconds call_latency_;
+  const std::chrono::nanoseconds cycle_latency_;
+  const double ns_per_byte_;
+  const double bus_error_rate_;
+  mutable std::mt19937 rng_;
+  mutable size_t n_bus_errors_;
+  // devices are accessed one call at a time (IRQ waits are not
+  // scheduled)
+  mutable std::mutex mutex_;
+
+  VME_FRIEND_MASTER(base_type);
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: sim_bridge
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+inline void sim_bridge::wait_for_irq() const { wait_for_irq(timeout_); }
+
+template <class Device>
+Device& sim_bridge::add_device(std::unique_ptr<Device> dev) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (const auto& d : devices_) {
+    if (dev->base_address() < d->base_address() + d->size() &&
+        d->base_address() < dev->base_address() + dev->size()) {
+      throw invalid_parameter("Simulated device " + dev->name() +
+                              " overlaps with " + d->name());
+    }
+  }
+  Device& ref{*dev};
+  devices_.push_back(std::move(dev));
+  return ref;
+}
+}
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <ctrlroom/board.hpp>
 #include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/read_plan.hpp>
 
 #include <ctrlroom/util/assert.hpp>
 #include <ctrlroom/util/logger.hpp>
@@ -12,21 +13,48 @@
 #include <memory>
 #include <cstddef>
 #include <array>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace ctrlroom {
 namespace vme {
 
+// batch of single cycles relative to a slave base address,
+// see master/batch.hpp
+template <class Slave> class slave_batch;
+
+// Generic VME slave module, at a base address on the master's bus.
+// CONFIGURATION FILE OPTIONS:
+//      * Base address: <id>.address (hex string)
+// optional
+//      * MCST base address (A32): <id>.mcstAddress (hex string), for
+//        boards that are part of a multicast group (cf. mcst_group.hpp).
+//        Enabling the MCST address on the board itself is board specific.
+//      * Write shadow: <id>.shadowWrites (true, false; defaults to false)
+//        Remember the last value written to every register, and skip
+//        writes that would not change it. Only for registers that are
+//        not modified by the board itself. Command registers (RESET,
+//        START, ...) should be written with strobe(). Block and FIFO
+//        writes forget the shadow values of the registers they cover,
+//        MCST writes update the shadow (cf. write_multicast()).
 template <class Master, addressing_mode A, transfer_mode DSingle,
           transfer_mode DBLT = transfer_mode::DISABLED>
 class slave : public board {
 public:
   constexpr static const char* ADDRESS_KEY{"address"};
+  constexpr static const char* MCST_ADDRESS_KEY{"mcstAddress"};
+  constexpr static const char* SHADOW_WRITES_KEY{"shadowWrites"};
 
   using base_type = board;
   using master_type = Master;
   using address_type = typename address_spec<A>::ptr_type;
   using single_data_type = typename transfer_spec<DSingle>::value_type;
   using blt_data_type = typename transfer_spec<DBLT>::value_type;
+  using batch_type = slave_batch<slave>;
+  using plan_type = read_plan<slave>;
+  using mcst_address_type =
+      typename address_spec<addressing_mode::A32>::ptr_type;
 
   constexpr static addressing_mode addressing{A};
   constexpr static transfer_mode single_transfer{DSingle};
@@ -39,21 +67,196 @@ public:
   size_t read(address_type a, single_data_type& val) const {
     return master_->template read<A, DSingle>(address_ + a, val);
   }
-  size_t write(address_type a, single_data_type val) const {
+  // with the write shadow enabled, writes that would not change the
+  // register are skipped (returning 1, as if the write was done)
+  size_t write(address_type a, single_data_type val) const;
+  // always write <val> to <a>, bypassing the write shadow
+  // (for command registers)
+  size_t strobe(address_type a, single_data_type val) const {
     return master_->template write<A, DSingle>(address_ + a, val);
   }
+  // replace the bits in <mask> of register <a> with those in <bits>
+  // through RMW cycles, without a window for other threads sharing the
+  // master (cf. master<>::modify()). Returns the previous value.
+  // Needs the write shadow: the modification starts from the shadow
+  // value, so it takes a single RMW cycle (the register is only read
+  // first while its value is not known yet). Modifications that would
+  // not change the register are skipped. Throws a vme::invalid_parameter
+  // without the write shadow.
+  // As for master<>::modify(), a register that changed behind the
+  // shadow briefly gets a value based on the stale shadow value written
+  // to it before the retry, so only use it on plain settings registers,
+  // not on command registers.
+  single_data_type modify(address_type a, single_data_type mask,
+                          single_data_type bits) const;
+  single_data_type set_bits(address_type a, single_data_type bits) const {
+    return modify(a, bits, bits);
+  }
+  single_data_type clear_bits(address_type a, single_data_type bits) const {
+    return modify(a, bits, 0);
+  }
   template <class Integer, size_t N>
   size_t read(address_type a, std::array<Integer, N>& vals) const {
     return master_->template read<A, DBLT>(address_ + a, vals);
   }
+  // block writes forget the shadow values of the registers they cover
   template <class Integer, size_t N>
   size_t write(address_type a, std::array<Integer, N>& vals) const {
+    invalidate_shadow(a, N * sizeof(Integer));
+    return master_->template write<A, DBLT>(address_ + a, vals);
+  }
+  // get an (empty) batch of single cycles for this slave
+  batch_type batch() const { return batch_type{*this}; }
+  // get an (empty) register read plan for this slave, merging registers
+  // with up to <max_gap> unrequested bytes in between into block reads
+  // (contiguous registers only by default, cf. read_plan.hpp)
+  plan_type plan(const size_t max_gap = plan_type::DEFAULT_MAX_GAP) const {
+    return plan_type{*this, max_gap};
+  }
+
+  // write shadow: the last value written to <a> (if known), without
+  // touching the bus
+  bool shadow_writes() const { return shadow_writes_; }
+  optional<single_data_type> shadow(address_type a) const;
+  // record a value known to be in register <a>, without writing it
+  void set_shadow(address_type a, single_data_type val) const;
+  // forget the shadow values, e.g. after a board reset
+  void invalidate_shadow() const;
+  void invalidate_shadow(address_type a) const;
+  // forget the shadow values of the registers overlapping the <n_bytes>
+  // starting at <a>
+  void invalidate_shadow(address_type a, size_t n_bytes) const;
+
+  address_type base_address() const { return address_; }
+  const std::shared_ptr<master_type>& master() const { return master_; }
+
+  // multicast (MCST) write to register <a> of all boards sharing the
+  // MCST address of this board (cf. <id>.mcstAddress)
+  // Only the write shadow of this board is updated, write through an
+  // mcst_group to update the shadows of all boards (cf. mcst_group.hpp).
+  bool has_mcst() const { return has_mcst_; }
+  mcst_address_type mcst_address() const { return mcst_address_; }
+  size_t write_multicast(address_type a, single_data_type val) const;
+
+  // block transfers to/from a contiguous range of <n> values, or a
+  // (pre-sized) std::vector
+  template <class Integer>
+  size_t read(address_type a, Integer* vals, size_t n) const {
+    return master_->template read<A, DBLT>(address_ + a, vals, n);
+  }
+  template <class Integer, class Alloc>
+  size_t read(address_type a, std::vector<Integer, Alloc>& vals) const {
+    return master_->template read<A, DBLT>(address_ + a, vals);
+  }
+  template <class Integer>
+  size_t write(address_type a, Integer* vals, size_t n) const {
+    invalidate_shadow(a, n * sizeof(Integer));
+    return master_->template write<A, DBLT>(address_ + a, vals, n);
+  }
+  template <class Integer, class Alloc>
+  size_t write(address_type a, std::vector<Integer, Alloc>& vals) const {
+    invalidate_shadow(a, vals.size() * sizeof(Integer));
     return master_->template write<A, DBLT>(address_ + a, vals);
   }
+  // FIFO block transfers (non-incrementing address)
+  template <class Integer, size_t N>
+  size_t read_fifo(address_type a, std::array<Integer, N>& vals) const {
+    return master_->template read_fifo<A, DBLT>(address_ + a, vals);
+  }
+  template <class Integer>
+  size_t read_fifo(address_type a, Integer* vals, size_t n) const {
+    return master_->template read_fifo<A, DBLT>(address_ + a, vals, n);
+  }
+  template <class Integer, class Alloc>
+  size_t read_fifo(address_type a, std::vector<Integer, Alloc>& vals) const {
+    return master_->template read_fifo<A, DBLT>(address_ + a, vals);
+  }
+  template <class Integer, size_t N>
+  size_t write_fifo(address_type a, std::array<Integer, N>& vals) const {
+    invalidate_shadow(a);
+    return master_->template write_fifo<A, DBLT>(address_ + a, vals);
+  }
+  template <class Integer>
+  size_t write_fifo(address_type a, Integer* vals, size_t n) const {
+    invalidate_shadow(a);
+    return master_->template write_fifo<A, DBLT>(address_ + a, vals, n);
+  }
+  template <class Integer, class Alloc>
+  size_t write_fifo(address_type a, std::vector<Integer, Alloc>& vals) const {
+    invalidate_shadow(a);
+    return master_->template write_fifo<A, DBLT>(address_ + a, vals);
+  }
 
 protected:
   std::shared_ptr<master_type> master_;
   const address_type address_;
+  bool has_mcst_;
+  mcst_address_type mcst_address_;
+
+  friend batch_type;
+
+private:
+  // true if the shadow says <a> already holds <val>
+  bool shadowed(address_type a, single_data_type val) const;
+
+  const bool shadow_writes_;
+  mutable std::map<address_type, single_data_type> shadow_;
+  mutable std::mutex shadow_mutex_;
+};
+
+template <class Slave> class slave_batch {
+public:
+  using slave_type = Slave;
+  using master_batch_type = typename slave_type::master_type::batch_type;
+  using address_type = typename slave_type::address_type;
+  using single_data_type = typename slave_type::single_data_type;
+
+  explicit slave_batch(const slave_type& s)
+      : slave_(s), batch_{s.master_->batch()}, address_{s.address_} {}
+
+  void read(address_type a, single_data_type& val) {
+    batch_.template read<slave_type::addressing, slave_type::single_transfer>(
+        address_ + a, val);
+  }
+  // writes that would not change the register are skipped when the
+  // write shadow of the slave is enabled
+  void write(address_type a, single_data_type val);
+  // always write (command registers)
+  void strobe(address_type a, single_data_type val) {
+    batch_.template write<slave_type::addressing, slave_type::single_transfer>(
+        address_ + a, val);
+  }
+  // the cycles queued after the fence are only executed if all cycles
+  // before it succeeded
+  void fence() { batch_.fence(); }
+
+  // the write shadow of the slave is updated for the successful writes
+  size_t submit();
+  vme::status cycle_status(const size_t i) const {
+    return batch_.cycle_status(i);
+  }
+  bool good() const { return batch_.good(); }
+  size_t first_failed() const { return batch_.first_failed(); }
+  void check(const std::string& what) const { batch_.check(what); }
+  size_t size() const { return batch_.size(); }
+  bool empty() const { return batch_.empty(); }
+  void clear() {
+    batch_.clear();
+    shadow_updates_.clear();
+  }
+
+private:
+  // queued writes that update the write shadow after submit()
+  struct shadow_update {
+    size_t cycle;
+    address_type address;
+    single_data_type val;
+  };
+
+  const slave_type& slave_;
+  master_batch_type batch_;
+  const address_type address_;
+  std::vector<shadow_update> shadow_updates_;
 };
 }
 }
@@ -72,8 +275,17 @@ slave<Master, A, DSingle, DBLT>::slave(const std::string& identifier,
     : base_type{identifier, settings}
     , master_{master}
     , address_{static_cast<address_type>(
-          std::stoll(conf_.get<std::string>(ADDRESS_KEY), nullptr, 0))} {
+          std::stoll(conf_.get<std::string>(ADDRESS_KEY), nullptr, 0))}
+    , has_mcst_{false}
+    , mcst_address_{0}
+    , shadow_writes_{conf_.get<bool>(SHADOW_WRITES_KEY, false)} {
   tassert(master, "Invalid pointer to master module");
+  auto mcst = conf_.get_optional<std::string>(MCST_ADDRESS_KEY);
+  if (mcst) {
+    has_mcst_ = true;
+    mcst_address_ =
+        static_cast<mcst_address_type>(std::stoll(*mcst, nullptr, 0));
+  }
   LOG_INFO(name(), "Initializing slave module");
 }
 template <class Master, addressing_mode A, transfer_mode DSingle,
@@ -81,6 +293,186 @@ template <class Master, addressing_mode A, transfer_mode DSingle,
 slave<Master, A, DSingle, DBLT>::~slave() {
   LOG_INFO(name(), "Releasing control");
 }
+
+// multicast write
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+size_t slave<Master, A, DSingle, DBLT>::write_multicast(
+    address_type a, single_data_type val) const {
+  tassert(has_mcst_, "No MCST address configured for " + name());
+  size_t n{0};
+  try {
+    n = master_->template write_multicast<DSingle>(mcst_address_ + a, val);
+  } catch (vme::error&) {
+    // unknown state after a failed write
+    invalidate_shadow(a);
+    throw;
+  }
+  if (n) {
+    set_shadow(a, val);
+  } else {
+    invalidate_shadow(a);
+  }
+  return n;
+}
+
+// write shadow
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+size_t slave<Master, A, DSingle, DBLT>::write(address_type a,
+                                              single_data_type val) const {
+  if (!shadow_writes_) {
+    return master_->template write<A, DSingle>(address_ + a, val);
+  }
+  if (shadowed(a, val)) {
+    return 1;
+  }
+  const size_t n{master_->template write<A, DSingle>(address_ + a, val)};
+  if (n) {
+    set_shadow(a, val);
+  }
+  return n;
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+typename slave<Master, A, DSingle, DBLT>::single_data_type
+slave<Master, A, DSingle, DBLT>::modify(address_type a, single_data_type mask,
+                                        single_data_type bits) const {
+  if (!shadow_writes_) {
+    throw master_->invalid_parameter(
+        name() + ": modify() of register " + std::to_string(a) +
+        " needs the write shadow (" + SHADOW_WRITES_KEY + ")");
+  }
+  single_data_type old{0};
+  try {
+    auto expected = shadow(a);
+    if (!expected) {
+      master_->template read<A, DSingle>(address_ + a, old);
+      expected = old;
+    }
+    if ((*expected & mask) == (bits & mask)) {
+      set_shadow(a, *expected);
+      return *expected;
+    }
+    old = master_->template modify<A, DSingle>(address_ + a, mask, bits,
+                                               *expected);
+  } catch (vme::error&) {
+    // unknown state after a failed modification
+    invalidate_shadow(a);
+    throw;
+  }
+  set_shadow(a, static_cast<single_data_type>((old & ~mask) | (bits & mask)));
+  return old;
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+optional<typename slave<Master, A, DSingle, DBLT>::single_data_type>
+slave<Master, A, DSingle, DBLT>::shadow(address_type a) const {
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  auto it = shadow_.find(a);
+  if (it == shadow_.end()) {
+    return {};
+  }
+  return it->second;
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void slave<Master, A, DSingle, DBLT>::set_shadow(address_type a,
+                                                 single_data_type val) const {
+  if (!shadow_writes_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  shadow_[a] = val;
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void slave<Master, A, DSingle, DBLT>::invalidate_shadow() const {
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  shadow_.clear();
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void slave<Master, A, DSingle, DBLT>::invalidate_shadow(address_type a) const {
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  shadow_.erase(a);
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+void slave<Master, A, DSingle, DBLT>::invalidate_shadow(address_type a,
+                                                        size_t n_bytes) const {
+  if (!shadow_writes_ || !n_bytes) {
+    return;
+  }
+  constexpr size_t width{sizeof(single_data_type)};
+  // registers starting up to <width> - 1 bytes before <a> overlap as well
+  const address_type first{
+      static_cast<address_type>(a >= width - 1 ? a - (width - 1) : 0)};
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  auto it = shadow_.lower_bound(first);
+  while (it != shadow_.end() && it->first < a + n_bytes) {
+    if (it->first + width > a) {
+      it = shadow_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+template <class Master, addressing_mode A, transfer_mode DSingle,
+          transfer_mode DBLT>
+bool slave<Master, A, DSingle, DBLT>::shadowed(address_type a,
+                                               single_data_type val) const {
+  if (!shadow_writes_) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock{shadow_mutex_};
+  auto it = shadow_.find(a);
+  return it != shadow_.end() && it->second == val;
+}
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: slave_batch
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Slave>
+void slave_batch<Slave>::write(address_type a, single_data_type val) {
+  if (slave_.shadow_writes()) {
+    // the last queued write to <a> takes precedence over the shadow
+    bool queued{false};
+    for (auto it = shadow_updates_.rbegin(); it != shadow_updates_.rend();
+         ++it) {
+      if (it->address == a) {
+        queued = true;
+        if (it->val == val) {
+          return;
+        }
+        break;
+      }
+    }
+    if (!queued && slave_.shadowed(a, val)) {
+      return;
+    }
+    shadow_updates_.push_back({batch_.size(), a, val});
+  }
+  batch_.template write<slave_type::addressing, slave_type::single_transfer>(
+      address_ + a, val);
+}
+template <class Slave> size_t slave_batch<Slave>::submit() {
+  const size_t n_good{batch_.submit()};
+  for (const auto& u : shadow_updates_) {
+    if (batch_.cycle_status(u.cycle) == vme::status::SUCCESS) {
+      slave_.set_shadow(u.address, u.val);
+    } else {
+      // unknown state after a failed write
+      slave_.invalidate_shadow(u.address);
+    }
+  }
+  return n_good;
+}
 }
 }
 
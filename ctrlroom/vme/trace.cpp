@@ -0,0 +1,203 @@
+#include "trace.hpp"
+
+#include <ctrlroom/util/io.hpp>
+
+#include <cstring>
+#include <limits>
+
+using namespace ctrlroom::vme;
+
+namespace {
+constexpr char MAGIC[8] = {'C', 'R', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint32_t VERSION{1};
+// size of the fixed part of a record in the file
+constexpr size_t RECORD_SIZE{32};
+
+// (de)serialize a single field at <pos>
+template <class T> void put(char*& pos, const T val) {
+  std::memcpy(pos, &val, sizeof(T));
+  pos += sizeof(T);
+}
+template <class T> void get(const char*& pos, T& val) {
+  std::memcpy(&val, pos, sizeof(T));
+  pos += sizeof(T);
+}
+template <class T> void put_value(char* dest, const uint32_t val) {
+  const T v{static_cast<T>(val)};
+  std::memcpy(dest, &v, sizeof(T));
+}
+template <class T> uint32_t get_value(const char* src) {
+  T v{0};
+  std::memcpy(&v, src, sizeof(T));
+  return v;
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// trace_record
+////////////////////////////////////////////////////////////////////////////////
+bool trace_record::is_read() const {
+  switch (op) {
+  case trace_op::READ:
+  case trace_op::FIFO_READ:
+  case trace_op::CBLT_READ:
+  case trace_op::IACK:
+  case trace_op::IRQ_CHECK:
+    return true;
+  default:
+    return false;
+  }
+}
+size_t trace_record::data_size() const {
+  // the data of a batch is in the cycle records
+  if (op == trace_op::MULTI_READ || op == trace_op::MULTI_WRITE) {
+    return 0;
+  }
+  if (op == trace_op::RMW) {
+    return static_cast<size_t>(n_requests + n_done) * width;
+  }
+  return static_cast<size_t>(is_read() ? n_done : n_requests) * width;
+}
+uint32_t trace_record::value() const {
+  if (data.size() < width) {
+    return 0;
+  }
+  switch (width) {
+  case 1:
+    return get_value<uint8_t>(data.data());
+  case 2:
+    return get_value<uint16_t>(data.data());
+  default:
+    return get_value<uint32_t>(data.data());
+  }
+}
+void trace_record::set_value(const uint32_t val) {
+  data.resize(width);
+  switch (width) {
+  case 1:
+    put_value<uint8_t>(data.data(), val);
+    break;
+  case 2:
+    put_value<uint16_t>(data.data(), val);
+    break;
+  default:
+    put_value<uint32_t>(data.data(), val);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// trace_writer
+////////////////////////////////////////////////////////////////////////////////
+trace_writer::trace_writer(const std::string& fname)
+    : fname_{fname}, buffer_(BUFFER_SIZE), start_{now()}, n_records_{0} {
+  out_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+  out_.open(fname_, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out_) {
+    throw io_write_error{"Failed to open trace file '" + fname_ + "'."};
+  }
+  out_.write(MAGIC, sizeof(MAGIC));
+  out_.write(reinterpret_cast<const char*>(&VERSION), sizeof(VERSION));
+}
+trace_writer::~trace_writer() { out_.flush(); }
+
+void trace_writer::write(trace_record& rec, const time_point start,
+                         const void* data) {
+  const time_point stop{now()};
+  const uint64_t duration{static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start)
+          .count())};
+  rec.timestamp = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(start - start_)
+          .count());
+  rec.duration = static_cast<uint32_t>(
+      duration < std::numeric_limits<uint32_t>::max()
+          ? duration
+          : std::numeric_limits<uint32_t>::max());
+  char header[RECORD_SIZE];
+  char* pos{header};
+  put(pos, rec.timestamp);
+  put(pos, rec.address);
+  put(pos, rec.n_requests);
+  put(pos, rec.n_done);
+  put(pos, rec.duration);
+  put(pos, static_cast<uint8_t>(rec.op));
+  put(pos, rec.am);
+  put(pos, rec.width);
+  put(pos, static_cast<int8_t>(rec.result));
+  const size_t n_data{data ? rec.data_size() : 0};
+  std::lock_guard<std::mutex> lock{mutex_};
+  out_.write(header, RECORD_SIZE);
+  if (n_data) {
+    out_.write(static_cast<const char*>(data), n_data);
+  }
+  if (!out_) {
+    throw io_write_error{"Failed to write to trace file '" + fname_ + "'."};
+  }
+  ++n_records_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// read_trace
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+std::vector<trace_record> read_trace(const std::string& fname) {
+  std::ifstream in{fname, std::ios::in | std::ios::binary};
+  if (!in) {
+    throw io_read_error{"Failed to open trace file '" + fname + "'."};
+  }
+  char magic[sizeof(MAGIC)];
+  uint32_t version{0};
+  in.read(magic, sizeof(MAGIC));
+  in.read(reinterpret_cast<char*>(&version), sizeof(version));
+  if (!in || std::memcmp(magic, MAGIC, sizeof(MAGIC))) {
+    throw io_read_error{"Not a VME trace file: '" + fname + "'."};
+  }
+  if (version != VERSION) {
+    throw io_read_error{"Unsupported trace file version " +
+                        std::to_string(version) + " in '" + fname + "'."};
+  }
+  std::vector<trace_record> records;
+  bool truncated{false};
+  char header[RECORD_SIZE];
+  while (in.read(header, RECORD_SIZE)) {
+    trace_record rec;
+    const char* pos{header};
+    uint8_t op{0};
+    int8_t result{0};
+    get(pos, rec.timestamp);
+    get(pos, rec.address);
+    get(pos, rec.n_requests);
+    get(pos, rec.n_done);
+    get(pos, rec.duration);
+    get(pos, op);
+    get(pos, rec.am);
+    get(pos, rec.width);
+    get(pos, result);
+    if (op > static_cast<uint8_t>(trace_op::RMW)) {
+      throw io_read_error{"Invalid record " + std::to_string(records.size()) +
+                          " in trace file '" + fname + "'."};
+    }
+    rec.op = static_cast<trace_op>(op);
+    rec.result = static_cast<vme::status>(result);
+    rec.data.resize(rec.data_size());
+    if (!rec.data.empty() &&
+        !in.read(rec.data.data(),
+                 static_cast<std::streamsize>(rec.data.size()))) {
+      truncated = true;
+      break;
+    }
+    records.push_back(std::move(rec));
+  }
+  // a partial record header
+  if (in.gcount() != 0) {
+    truncated = true;
+  }
+  if (truncated) {
+    throw io_read_error{"Truncated trace file '" + fname + "' (after " +
+                        std::to_string(records.size()) + " records)."};
+  }
+  return records;
+}
+}
+}
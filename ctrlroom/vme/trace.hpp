@@ -0,0 +1,114 @@
+#ifndef CTRLROOM_VME_TRACE_LOADED
+#define CTRLROOM_VME_TRACE_LOADED
+
+#include <ctrlroom/vme/master/status.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ctrlroom {
+namespace vme {
+
+// VME cycle traces, as written by trace_recorder<> (trace_recorder.hpp)
+// and served by replay_bridge (replay_bridge.hpp).
+//
+// Binary file format (native byte order):
+//  * header: 8-byte magic "CRTRACE" + '\0', uint32_t format version
+//  * one record per call to the master implementation:
+//      uint64_t timestamp    [ns] since the start of the trace
+//      uint64_t address      VME address (0 for IRQ and PING records)
+//      uint32_t n_requests   requested transactions
+//      uint32_t n_done       completed transactions
+//      uint32_t duration     [ns] (saturated)
+//      uint8_t  op           trace_op
+//      uint8_t  am           address modifier (IRQ level for IACK)
+//      uint8_t  width        data width in bytes
+//      int8_t   result       vme::status
+//    followed by the data: <n_done> x <width> bytes for reads,
+//    <n_requests> x <width> bytes for writes.
+//
+// A batch of single cycles is stored as a MULTI_READ/MULTI_WRITE record
+// (<n_requests> cycles, <n_done> successful ones, no data), followed by
+// a READ/WRITE record for every cycle. A batch that failed as a whole
+// (e.g. a communication error) has no cycle records.
+enum class trace_op : uint8_t {
+  READ,        // single or block read
+  WRITE,       // single or block write
+  FIFO_READ,   // FIFO block read
+  FIFO_WRITE,  // FIFO block write
+  CBLT_READ,   // chained block read
+  MULTI_READ,  // batch of single reads
+  MULTI_WRITE, // batch of single writes
+  IACK,        // interrupt acknowledge
+  IRQ_CHECK,   // check the IRQ lines (data: the 8-bit mask)
+  IRQ_WAIT,    // wait for an IRQ
+  PING,        // link round-trip probe
+  RMW          // read-modify-write (data: the written value, followed by
+               // the previous value)
+};
+
+struct trace_record {
+  uint64_t timestamp;
+  uint64_t address;
+  uint32_t n_requests;
+  uint32_t n_done;
+  uint32_t duration;
+  trace_op op;
+  uint8_t am;
+  uint8_t width;
+  vme::status result;
+  std::vector<char> data;
+
+  // true for the ops that move data from the slave to the master
+  bool is_read() const;
+  // expected number of data bytes for this record
+  size_t data_size() const;
+  // get/set the first data word as an unsigned value (for single cycles,
+  // width <= 4 bytes)
+  uint32_t value() const;
+  void set_value(const uint32_t val);
+};
+
+// Thread-safe trace writer, the trace starts when the writer is created
+class trace_writer {
+public:
+  using clock_type = std::chrono::steady_clock;
+  using time_point = clock_type::time_point;
+
+  constexpr static size_t BUFFER_SIZE{1 << 20}; // in bytes
+
+  explicit trace_writer(const std::string& fname);
+  ~trace_writer();
+
+  static time_point now() { return clock_type::now(); }
+
+  // write <rec> for a call that started at <start>
+  // (timestamp and duration are filled in by the writer).
+  // <data> should point to rec.data_size() bytes (can be nullptr when
+  // there is no data).
+  void write(trace_record& rec, const time_point start, const void* data);
+
+  const std::string& file_name() const { return fname_; }
+  size_t n_records() const { return n_records_; }
+
+private:
+  const std::string fname_;
+  std::vector<char> buffer_;
+  std::ofstream out_;
+  const time_point start_;
+  size_t n_records_;
+  std::mutex mutex_;
+};
+
+// read a complete trace file. Throws an io_read_error for invalid
+// or truncated files.
+std::vector<trace_record> read_trace(const std::string& fname);
+}
+}
+
+#endif
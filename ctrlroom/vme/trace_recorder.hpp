@@ -0,0 +1,444 @@
+#ifndef CTRLROOM_VME_TRACE_RECORDER_LOADED
+#define CTRLROOM_VME_TRACE_RECORDER_LOADED
+
+#include <ctrlroom/vme/master.hpp>
+#include <ctrlroom/vme/trace.hpp>
+#include <ctrlroom/vme/vme64.hpp>
+
+#include <ctrlroom/util/logger.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ctrlroom {
+namespace vme {
+
+// Recording wrapper around any master implementation (e.g. caen_bridge),
+// logging every call to the master to a binary trace file
+// (cf. trace.hpp). The trace can be replayed later on by a replay_bridge
+// (replay_bridge.hpp), without the actual crate.
+//
+// The wrapper is a master module in its own right, and owns the wrapped
+// master (created from the same settings). It can be used anywhere the
+// wrapped master can:
+//    using master_type = trace_recorder<caen_bridge>;
+//    auto m = std::make_shared<master_type>("vme", settings);
+//    caen_v1729<master_type> adc{"adc", settings, m};
+//
+// Recording adds a copy of the data moved by every call and a (buffered)
+// file write, it is meant for debugging and profiling, not for production
+// readout.
+//
+// CONFIGURATION FILE OPTIONS (on top of the options of the wrapped master)
+//      * trace file name: <id>.traceFile
+template <class Inner>
+class trace_recorder : public vme::master<trace_recorder<Inner>> {
+public:
+  using base_type = vme::master<trace_recorder<Inner>>;
+  using inner_type = Inner;
+
+  constexpr static const char* TRACE_FILE_KEY{"traceFile"};
+
+  trace_recorder(const std::string& identifier, const ptree& settings);
+  ~trace_recorder();
+
+  // the wrapped master (calls made directly on the inner master are
+  // not recorded)
+  inner_type& inner() { return inner_; }
+  const inner_type& inner() const { return inner_; }
+
+  // number of records written so far
+  size_t n_records() const { return writer_.n_records(); }
+
+  // wait for the next IRQ
+  void wait_for_irq() const;
+  void wait_for_irq(size_t timeout) const;
+
+protected:
+  // Single
+  template <addressing_mode A, transfer_mode D>
+  size_t read_single(const typename address_spec<A>::ptr_type address,
+                     typename transfer_spec<D>::ptr_type val) const;
+  template <addressing_mode A, transfer_mode D>
+  size_t write_single(const typename address_spec<A>::ptr_type address,
+                      typename transfer_spec<D>::ptr_type val) const;
+  // RMW
+  template <addressing_mode A, transfer_mode D>
+  size_t rmw_single(const typename address_spec<A>::ptr_type address,
+                    typename transfer_spec<D>::ptr_type val) const;
+  // BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_blt(const typename address_spec<A>::ptr_type address,
+                  typename transfer_spec<D>::ptr_type buf,
+                  size_t n_requests) const {
+    return block<A, D, forward_read>(address, buf, n_requests);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_blt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, D, forward_write>(address, buf, n_requests);
+  }
+  // MD32
+  template <addressing_mode A>
+  size_t read_md32(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MD32, forward_read>(address, buf,
+                                                       n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_md32(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MD32>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MD32, forward_write>(address, buf,
+                                                        n_requests);
+  }
+  // MBLT
+  template <addressing_mode A>
+  size_t read_mblt(const typename address_spec<A>::ptr_type address,
+                   transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, transfer_mode::MBLT, forward_read>(address, buf,
+                                                       n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_mblt(const typename address_spec<A>::ptr_type address,
+                    transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                    size_t n_requests) const {
+    return block<A, transfer_mode::MBLT, forward_write>(address, buf,
+                                                        n_requests);
+  }
+  // 2eVME (3U)
+  template <addressing_mode A>
+  size_t read_2evme3(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME, forward_read>(address, buf,
+                                                           n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_2evme3(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U3_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U3_2eVME, forward_write>(address, buf,
+                                                            n_requests);
+  }
+  // 2eVME (6U)
+  template <addressing_mode A>
+  size_t read_2evme6(const typename address_spec<A>::ptr_type address,
+                     transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                     size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME, forward_read>(address, buf,
+                                                           n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_2evme6(const typename address_spec<A>::ptr_type address,
+                      transfer_spec<transfer_mode::U6_2eVME>::ptr_type buf,
+                      size_t n_requests) const {
+    return block<A, transfer_mode::U6_2eVME, forward_write>(address, buf,
+                                                            n_requests);
+  }
+  // CBLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_cblt(const typename address_spec<A>::ptr_type address,
+                   typename transfer_spec<D>::ptr_type buf,
+                   size_t n_requests) const {
+    return block<A, D, forward_chained_read>(address, buf, n_requests);
+  }
+  // MULTI (batched single cycles)
+  size_t read_multi(single_cycle* cycles, vme::status* st, size_t n) const {
+    return multi(cycles, st, n, true);
+  }
+  size_t write_multi(single_cycle* cycles, vme::status* st, size_t n) const {
+    return multi(cycles, st, n, false);
+  }
+  // IRQ
+  template <transfer_mode D>
+  size_t iack(const irq_level level,
+              typename transfer_spec<D>::ptr_type vector) const;
+  uint8_t check_irq() const;
+  // PING
+  void ping() const;
+  // FIFO BLT
+  template <addressing_mode A, transfer_mode D>
+  size_t read_fifo_blt(const typename address_spec<A>::ptr_type address,
+                       typename transfer_spec<D>::ptr_type buf,
+                       size_t n_requests) const {
+    return block<A, D, forward_fifo_read>(address, buf, n_requests);
+  }
+  template <addressing_mode A, transfer_mode D>
+  size_t write_fifo_blt(const typename address_spec<A>::ptr_type address,
+                        typename transfer_spec<D>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, D, forward_fifo_write>(address, buf, n_requests);
+  }
+  // FIFO MBLT
+  template <addressing_mode A>
+  size_t read_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                        transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                        size_t n_requests) const {
+    return block<A, transfer_mode::MBLT, forward_fifo_read>(address, buf,
+                                                            n_requests);
+  }
+  template <addressing_mode A>
+  size_t write_fifo_mblt(const typename address_spec<A>::ptr_type address,
+                         transfer_spec<transfer_mode::MBLT>::ptr_type buf,
+                         size_t n_requests) const {
+    return block<A, transfer_mode::MBLT, forward_fifo_write>(address, buf,
+                                                             n_requests);
+  }
+
+private:
+  // forwarders to the public block transfer interface of the inner
+  // master, for every type of traced block transfer
+  struct forward_read {
+    constexpr static trace_op OP{trace_op::READ};
+    template <addressing_mode A, transfer_mode D, class Ptr>
+    static size_t call(const inner_type& m,
+                       const typename address_spec<A>::ptr_type address,
+                       Ptr buf, size_t n) {
+      return m.template read<A, D>(address, buf, n);
+    }
+  };
+  struct forward_write {
+    constexpr static trace_op OP{trace_op::WRITE};
+    template <addressing_mode A, transfer_mode D, class Ptr>
+    static size_t call(const inner_type& m,
+                       const typename address_spec<A>::ptr_type address,
+                       Ptr buf, size_t n) {
+      return m.template write<A, D>(address, buf, n);
+    }
+  };
+  struct forward_fifo_read {
+    constexpr static trace_op OP{trace_op::FIFO_READ};
+    template <addressing_mode A, transfer_mode D, class Ptr>
+    static size_t call(const inner_type& m,
+                       const typename address_spec<A>::ptr_type address,
+                       Ptr buf, size_t n) {
+      return m.template read_fifo<A, D>(address, buf, n);
+    }
+  };
+  struct forward_fifo_write {
+    constexpr static trace_op OP{trace_op::FIFO_WRITE};
+    template <addressing_mode A, transfer_mode D, class Ptr>
+    static size_t call(const inner_type& m,
+                       const typename address_spec<A>::ptr_type address,
+                       Ptr buf, size_t n) {
+      return m.template write_fifo<A, D>(address, buf, n);
+    }
+  };
+  struct forward_chained_read {
+    constexpr static trace_op OP{trace_op::CBLT_READ};
+    template <addressing_mode A, transfer_mode D, class Ptr>
+    static size_t call(const inner_type& m,
+                       const typename address_spec<A>::ptr_type address,
+                       Ptr buf, size_t n) {
+      return m.template read_chained<A, D>(address, buf, n);
+    }
+  };
+  // forward a block transfer to the inner master
+  template <addressing_mode A, transfer_mode D, class Forward>
+  size_t block(const typename address_spec<A>::ptr_type address,
+               typename transfer_spec<D>::ptr_type buf,
+               size_t n_requests) const;
+  // DRY implementation of read_multi() and write_multi()
+  size_t multi(single_cycle* cycles, vme::status* st, size_t n,
+               const bool read) const;
+
+  // run <call> on the inner master, and record the outcome in <rec>.
+  // <data> points to the data of the call (or nullptr). Errors thrown by
+  // <call> are recorded and rethrown.
+  template <class Call>
+  size_t traced(trace_record& rec, const void* data, Call call) const;
+
+  static trace_record make_record(const trace_op op, const uint64_t address,
+                                  const uint32_t am, const size_t width,
+                                  const size_t n_requests) {
+    return {0,
+            address,
+            static_cast<uint32_t>(n_requests),
+            0,
+            0,
+            op,
+            static_cast<uint8_t>(am),
+            static_cast<uint8_t>(width),
+            status::SUCCESS,
+            {}};
+  }
+
+  inner_type inner_;
+  mutable trace_writer writer_;
+
+  VME_FRIEND_MASTER(base_type);
+};
+}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// implementation: trace_recorder
+////////////////////////////////////////////////////////////////////////////////
+namespace ctrlroom {
+namespace vme {
+
+template <class Inner>
+trace_recorder<Inner>::trace_recorder(const std::string& identifier,
+                                      const ptree& settings)
+    : base_type{identifier, settings}
+    , inner_{identifier, settings}
+    , writer_{this->conf_.template get<std::string>(TRACE_FILE_KEY)} {
+  // block the transfers exactly as the (possibly autotuned) inner master
+  this->mblt_block_length_ = inner_.mblt_block_length();
+  LOG_INFO(this->name(), "Recording VME trace to '" + writer_.file_name() +
+                             "'");
+}
+template <class Inner> trace_recorder<Inner>::~trace_recorder() {
+  LOG_INFO(this->name(), "Recorded " + std::to_string(writer_.n_records()) +
+                             " trace records");
+}
+
+template <class Inner>
+void trace_recorder<Inner>::wait_for_irq() const {
+  wait_for_irq(this->timeout_);
+}
+template <class Inner>
+void trace_recorder<Inner>::wait_for_irq(size_t timeout) const {
+  trace_record rec{make_record(trace_op::IRQ_WAIT, 0, 0, 0, 1)};
+  traced(rec, nullptr, [&]() -> size_t {
+    inner_.wait_for_irq(timeout);
+    return 1;
+  });
+}
+
+template <class Inner>
+template <addressing_mode A, transfer_mode D>
+size_t trace_recorder<Inner>::read_single(
+    const typename address_spec<A>::ptr_type address,
+    typename transfer_spec<D>::ptr_type val) const {
+  trace_record rec{make_record(trace_op::READ, address, address_spec<A>::DATA,
+                               transfer_spec<D>::WIDTH, 1)};
+  return traced(rec, val, [&]() -> size_t {
+    return inner_.template read<A, D>(address, *val);
+  });
+}
+template <class Inner>
+template <addressing_mode A, transfer_mode D>
+size_t trace_recorder<Inner>::write_single(
+    const typename address_spec<A>::ptr_type address,
+    typename transfer_spec<D>::ptr_type val) const {
+  trace_record rec{make_record(trace_op::WRITE, address, address_spec<A>::DATA,
+                               transfer_spec<D>::WIDTH, 1)};
+  return traced(rec, val, [&]() -> size_t {
+    return inner_.template write<A, D>(address, *val);
+  });
+}
+
+template <class Inner>
+template <addressing_mode A, transfer_mode D>
+size_t trace_recorder<Inner>::rmw_single(
+    const typename address_spec<A>::ptr_type address,
+    typename transfer_spec<D>::ptr_type val) const {
+  trace_record rec{make_record(trace_op::RMW, address, address_spec<A>::DATA,
+                               transfer_spec<D>::WIDTH, 1)};
+  // written value, followed by the previous value
+  typename transfer_spec<D>::value_type data[2] = {*val, 0};
+  return traced(rec, data, [&]() -> size_t {
+    const size_t n{inner_.template read_modify_write<A, D>(address, *val)};
+    data[1] = *val;
+    return n;
+  });
+}
+
+template <class Inner>
+template <transfer_mode D>
+size_t
+trace_recorder<Inner>::iack(const irq_level level,
+                            typename transfer_spec<D>::ptr_type vector) const {
+  trace_record rec{make_record(trace_op::IACK, 0, static_cast<uint32_t>(level),
+                               transfer_spec<D>::WIDTH, 1)};
+  return traced(rec, vector, [&]() -> size_t {
+    *vector = inner_.template acknowledge_irq<D>(level);
+    return 1;
+  });
+}
+template <class Inner> uint8_t trace_recorder<Inner>::check_irq() const {
+  trace_record rec{make_record(trace_op::IRQ_CHECK, 0, 0, 1, 1)};
+  uint8_t mask{0};
+  traced(rec, &mask, [&]() -> size_t {
+    mask = inner_.pending_irqs();
+    return 1;
+  });
+  return mask;
+}
+template <class Inner> void trace_recorder<Inner>::ping() const {
+  trace_record rec{make_record(trace_op::PING, 0, 0, 0, 1)};
+  traced(rec, nullptr, [&]() -> size_t {
+    inner_.probe_link();
+    return 1;
+  });
+}
+
+template <class Inner>
+template <addressing_mode A, transfer_mode D, class Forward>
+size_t trace_recorder<Inner>::block(
+    const typename address_spec<A>::ptr_type address,
+    typename transfer_spec<D>::ptr_type buf, size_t n_requests) const {
+  trace_record rec{make_record(Forward::OP, address,
+                               deduce_block_modifier<A, D>(),
+                               transfer_spec<D>::WIDTH, n_requests)};
+  return traced(rec, buf, [&]() -> size_t {
+    return Forward::template call<A, D>(inner_, address, buf, n_requests);
+  });
+}
+
+template <class Inner>
+size_t trace_recorder<Inner>::multi(single_cycle* cycles, vme::status* st,
+                                    size_t n, const bool read) const {
+  const trace_op op{read ? trace_op::MULTI_READ : trace_op::MULTI_WRITE};
+  auto batch = inner_.batch();
+  for (size_t i{0}; i < n; ++i) {
+    if (read) {
+      batch.read(cycles[i].address, cycles[i].am, cycles[i].width,
+                 cycles[i].data);
+    } else {
+      batch.write(cycles[i].address, cycles[i].am, cycles[i].width,
+                  cycles[i].data);
+    }
+  }
+  // the batch itself, followed by a record for every cycle
+  trace_record rec{make_record(op, 0, 0, 0, n)};
+  const size_t n_good{
+      traced(rec, nullptr, [&]() -> size_t { return batch.submit(); })};
+  for (size_t i{0}; i < n; ++i) {
+    st[i] = batch.cycle_status(i);
+    trace_record cycle{make_record(read ? trace_op::READ : trace_op::WRITE,
+                                   cycles[i].address, cycles[i].am,
+                                   cycles[i].width, 1)};
+    cycle.result = st[i];
+    cycle.n_done = (st[i] == status::SUCCESS) ? 1 : 0;
+    cycle.set_value(cycles[i].data);
+    writer_.write(cycle, trace_writer::now(), cycle.data.data());
+  }
+  return n_good;
+}
+
+template <class Inner>
+template <class Call>
+size_t trace_recorder<Inner>::traced(trace_record& rec, const void* data,
+                                     Call call) const {
+  const auto start = trace_writer::now();
+  try {
+    rec.n_done = static_cast<uint32_t>(call());
+  } catch (vme::error& e) {
+    rec.result = error_status(e);
+    writer_.write(rec, start, data);
+    throw;
+  }
+  writer_.write(rec, start, data);
+  return rec.n_done;
+}
+}
+}
+
+#endif
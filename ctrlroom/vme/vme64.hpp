@@ -1,6 +1,7 @@
 #ifndef CTRLROOM_VME_VME64_LOADED
 #define CTRLROOM_VME_VME64_LOADED
 
+#include <cstddef>
 #include <cstdint>
 #include <type_traits>
 
@@ -77,9 +78,11 @@ template <addressing_mode A, transfer_mode D> constexpr uint32_t xam_code();
 template <addressing_mode A> struct split_register;
 
 // data transfer spec
-// Interface: transfer_spec<D>::value_type      <- data type
-//                            ::WIDTH           <- data width
-//                            ::BLOCK_LENGTH    <- maximum block length
+// Interface: transfer_spec<D>::value_type        <- data type
+//                            ::WIDTH             <- data width
+//                            ::BLOCK_LENGTH      <- maximum block length
+//                            ::FIFO_BLOCK_LENGTH <- maximum block length
+//                                                   for FIFO transfers
 template <transfer_mode D> struct transfer_spec;
 
 // data transfer trait to for a compile-time check for multiplexed modes
@@ -168,12 +171,20 @@ template <> struct address_spec<addressing_mode::A64> {
 };
 
 namespace transfer_spec_impl {
-template <class IntegerType, size_t BlockLength /* in bytes */> struct data {
+template <class IntegerType, size_t BlockLength /* in bytes */,
+          size_t FifoBlockLength = BlockLength /* in bytes */>
+struct data {
   using value_type = IntegerType;
   using ptr_type = value_type*;
   static constexpr size_t WIDTH{sizeof(value_type)};
   static constexpr size_t BLOCK_LENGTH{BlockLength / sizeof(value_type)};
+  static constexpr size_t FIFO_BLOCK_LENGTH{FifoBlockLength /
+                                            sizeof(value_type)};
 };
+// FIFO (non-incrementing) block transfers never cross an address boundary,
+// so they are only limited by what the bridge can handle in a single
+// call.
+constexpr size_t FIFO_BLOCK_BYTES{16 * 1024};
 }
 
 template <addressing_mode A> struct split_register {
@@ -188,6 +199,7 @@ template <addressing_mode A> struct split_register {
 // data value type      -> ::value_type
 // data width           -> ::WIDTH
 // (max) block length   -> ::BLOCK_LENGTH
+// (max) FIFO length    -> ::FIFO_BLOCK_LENGTH
 template <transfer_mode D> struct transfer_spec {};
 // DISABLED
 template <>
@@ -196,19 +208,23 @@ struct transfer_spec<transfer_mode::DISABLED>
 // D08_O
 template <>
 struct transfer_spec<transfer_mode::D08_O>
-    : transfer_spec_impl::data<int8_t, 256> {};
+    : transfer_spec_impl::data<int8_t, 256,
+                               transfer_spec_impl::FIFO_BLOCK_BYTES> {};
 // D08_EO
 template <>
 struct transfer_spec<transfer_mode::D08_EO>
-    : transfer_spec_impl::data<int8_t, 256> {};
+    : transfer_spec_impl::data<int8_t, 256,
+                               transfer_spec_impl::FIFO_BLOCK_BYTES> {};
 // D16
 template <>
 struct transfer_spec<transfer_mode::D16>
-    : transfer_spec_impl::data<int16_t, 256> {};
+    : transfer_spec_impl::data<int16_t, 256,
+                               transfer_spec_impl::FIFO_BLOCK_BYTES> {};
 // D32
 template <>
 struct transfer_spec<transfer_mode::D32>
-    : transfer_spec_impl::data<int32_t, 256> {};
+    : transfer_spec_impl::data<int32_t, 256,
+                               transfer_spec_impl::FIFO_BLOCK_BYTES> {};
 // MD32
 template <>
 struct transfer_spec<transfer_mode::MD32>
@@ -218,6 +234,9 @@ struct transfer_spec<transfer_mode::MD32>
 //       because the CAEN VX1718 starts huccuping when reading more
 //       than 96 64-bit words (even though in theory it should be able
 //       to split the blocks in hardware...)
+//       This is only the default value, the actual MBLT block length
+//       (also used for FIFO MBLT transfers) is a setting of the master
+//       (cf. master<>::mblt_block_length()).
 template <>
 struct transfer_spec<transfer_mode::MBLT>
     : transfer_spec_impl::data<int64_t, 96 * sizeof(int64_t)> {};
@@ -287,6 +306,26 @@ template <> struct is_multiplexed<transfer_mode::MD32> : std::true_type {};
 template <> struct is_multiplexed<transfer_mode::MBLT> : std::true_type {};
 template <> struct is_multiplexed<transfer_mode::U3_2eVME> : std::true_type {};
 template <> struct is_multiplexed<transfer_mode::U6_2eVME> : std::true_type {};
+
+// is_cblt<>
+// chained block transfers (CBLT) are A32 D32 BLT or MBLT cycles to the
+// common CBLT address of the chain, terminated by a bus error from the
+// last board in the chain
+template <addressing_mode A, transfer_mode D>
+struct is_cblt : std::false_type {};
+template <>
+struct is_cblt<addressing_mode::A32, transfer_mode::D32> : std::true_type {};
+template <>
+struct is_cblt<addressing_mode::A32, transfer_mode::MBLT> : std::true_type {};
+
+// is_mcst<>
+// multicast writes (MCST) are A32 single write cycles to the common MCST
+// address of a group of boards, and are accepted by all of them
+template <transfer_mode D>
+struct is_mcst
+    : std::integral_constant<bool, !is_multiplexed<D>::value &&
+                                       D != transfer_mode::DISABLED &&
+                                       D != transfer_mode::D08_O> {};
 }
 }
 